@@ -52,8 +52,16 @@ This package contains unit tests for the CardDAV Buteo sync plugin.
 /opt/tests/buteo/plugins/carddav/cdavtool
 /opt/tests/buteo/plugins/carddav/tests.xml
 /opt/tests/buteo/plugins/carddav/tst_replyparser
+/opt/tests/buteo/plugins/carddav/tst_requestgenerator
+/opt/tests/buteo/plugins/carddav/tst_networkemulator
+/opt/tests/buteo/plugins/carddav/tst_remotecontactchanges
+/opt/tests/buteo/plugins/carddav/tst_syncstatesnapshot
+/opt/tests/buteo/plugins/carddav/tst_carddav
+/opt/tests/buteo/plugins/carddav/tst_syncer
 /opt/tests/buteo/plugins/carddav/data/replyparser_userprincipal_empty.xml
 /opt/tests/buteo/plugins/carddav/data/replyparser_userprincipal_single-well-formed.xml
+/opt/tests/buteo/plugins/carddav/data/replyparser_userprincipal_with-home-set.xml
+/opt/tests/buteo/plugins/carddav/data/replyparser_userprincipal_home-set-not-found.xml
 /opt/tests/buteo/plugins/carddav/data/replyparser_addressbookhome_empty.xml
 /opt/tests/buteo/plugins/carddav/data/replyparser_addressbookhome_single-well-formed.xml
 /opt/tests/buteo/plugins/carddav/data/replyparser_addressbookinformation_empty.xml
@@ -66,9 +74,12 @@ This package contains unit tests for the CardDAV Buteo sync plugin.
 /opt/tests/buteo/plugins/carddav/data/replyparser_synctokendelta_empty.xml
 /opt/tests/buteo/plugins/carddav/data/replyparser_synctokendelta_single-well-formed-add-mod-rem.xml
 /opt/tests/buteo/plugins/carddav/data/replyparser_synctokendelta_single-well-formed-addition.xml
+/opt/tests/buteo/plugins/carddav/data/replyparser_synctokendelta_truncated.xml
 /opt/tests/buteo/plugins/carddav/data/replyparser_contactmetadata_empty.xml
 /opt/tests/buteo/plugins/carddav/data/replyparser_contactmetadata_single-well-formed-add-mod-rem-unch.xml
 /opt/tests/buteo/plugins/carddav/data/replyparser_contactmetadata_single-vcf-and-non-vcf.xml
+/opt/tests/buteo/plugins/carddav/data/replyparser_contactmetadata_truncated.xml
+/opt/tests/buteo/plugins/carddav/data/replyparser_contactmetadata_contentlength.xml
 /opt/tests/buteo/plugins/carddav/data/replyparser_contactdata_empty.xml
 /opt/tests/buteo/plugins/carddav/data/replyparser_contactdata_single-well-formed.xml
 /opt/tests/buteo/plugins/carddav/data/replyparser_contactdata_single-hs-utc-iso8601-bday.xml
@@ -82,3 +93,5 @@ This package contains unit tests for the CardDAV Buteo sync plugin.
 /opt/tests/buteo/plugins/carddav/data/replyparser_contactdata_single-contact-multiple-rev.xml
 /opt/tests/buteo/plugins/carddav/data/replyparser_contactdata_single-contact-multiple-uid.xml
 /opt/tests/buteo/plugins/carddav/data/replyparser_contactdata_single-contact-multiple-xgender.xml
+/opt/tests/buteo/plugins/carddav/data/replyparser_supportedreportset_empty.xml
+/opt/tests/buteo/plugins/carddav/data/replyparser_supportedreportset_single-well-formed.xml
@@ -87,6 +87,7 @@ void Auth::signIn(int accountId)
         emit signInError();
         return;
     }
+    m_service = srv;
 
     // determine the remote URL from the account settings, and then sign in.
     Accounts::AccountService globalSrv(m_account, Accounts::Service());
@@ -221,3 +222,38 @@ void Auth::setCredentialsNeedUpdate(int accountId)
         }
     }
 }
+
+QVariant Auth::serviceValue(const QString &key) const
+{
+    if (!m_account || !m_service.isValid()) {
+        return QVariant();
+    }
+
+    Accounts::AccountService accSrv(m_account, m_service);
+    return accSrv.value(key);
+}
+
+void Auth::setServiceValue(const QString &key, const QVariant &value)
+{
+    QVariantMap values;
+    values.insert(key, value);
+    setServiceValues(values);
+}
+
+void Auth::setServiceValues(const QVariantMap &values)
+{
+    if (!m_account || !m_service.isValid()) {
+        return;
+    }
+
+    m_account->selectService(m_service);
+    for (QVariantMap::const_iterator it = values.constBegin(); it != values.constEnd(); ++it) {
+        if (it.value().isValid()) {
+            m_account->setValue(it.key(), it.value());
+        } else {
+            m_account->remove(it.key());
+        }
+    }
+    m_account->selectService(Accounts::Service());
+    m_account->syncAndBlock();
+}
@@ -42,6 +42,11 @@ public:
     void signIn(int accountId);
     void setCredentialsNeedUpdate(int accountId);
 
+    // settings of the carddav service of the signed-in account
+    QVariant serviceValue(const QString &key) const;
+    void setServiceValue(const QString &key, const QVariant &value);
+    void setServiceValues(const QVariantMap &values);
+
 Q_SIGNALS:
     void signInCompleted(const QString &serverUrl, const QString &addressbookPath, const QString &username, const QString &password, const QString &accessToken, bool ignoreSslErrors);
     void signInError();
@@ -53,6 +58,7 @@ private Q_SLOTS:
 private:
     Accounts::Manager m_manager;
     Accounts::Account *m_account;
+    Accounts::Service m_service;
     SignOn::Identity *m_ident;
     SignOn::AuthSession *m_session;
     QString m_serverUrl;
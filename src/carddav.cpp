@@ -21,6 +21,7 @@
  */
 
 #include "carddav_p.h"
+#include "syncstatesnapshot_p.h"
 #include "syncer_p.h"
 
 #include "logging.h"
@@ -30,6 +31,9 @@
 #include <QByteArray>
 #include <QBuffer>
 #include <QTimer>
+#include <QDateTime>
+#include <QElapsedTimer>
+#include <QFile>
 
 #include <QContact>
 #include <QContactGuid>
@@ -80,18 +84,34 @@ namespace {
         }
     }
 
-    QContactId matchingContactFromList(const QContact &c, const QList<QContact> &contacts) {
-        const QString uri = c.detail<QContactSyncTarget>().syncTarget();
-        for (const QContact &other : contacts) {
-            if (!uri.isEmpty() && uri == other.detail<QContactSyncTarget>().syncTarget()) {
-                return other.id();
-            }
+    void debugDumpData(const QByteArray &data)
+    {
+        // avoid decoding the (possibly large) response unless it will be logged.
+        if (lcCardDavProtocol().isDebugEnabled()) {
+            debugDumpData(QString::fromUtf8(data));
         }
-        return QContactId();
     }
+
+    // The maximum number of results requested per sync-collection report,
+    // and the maximum number of contacts requested per multiget report.
+    // These bound the size of each response for very large addressbooks.
+    const int SyncCollectionPageSize = 500;
+    const int MultigetPageSize = 100;
+
+    // the largest response expected to a sync-collection report limited to
+    // a single result, see CardDav::probeSyncCollectionLimit().
+    const qint64 SyncCollectionLimitProbeSize = 16 * 1024;
+
+    // the size assumed for a vCard whose size was not reported in the listing.
+    const qint64 EstimatedVCardSize = 4 * 1024;
+
+    // the most listing data held for addressbooks which the adaptor has not
+    // reached yet, after which further listings are requested once needed.
+    const qint64 MaxPrefetchedListingBytes = 4 * 1024 * 1024;
 }
 
 CardDavVCardConverter::CardDavVCardConverter()
+    : m_captureUnsupportedProperties(true)
 {
 }
 
@@ -114,8 +134,11 @@ QStringList CardDavVCardConverter::supportedPropertyNames()
     return supportedProperties;
 }
 
-QPair<QContact, QStringList> CardDavVCardConverter::convertVCardToContact(const QString &vcard, bool *ok)
+QPair<QContact, QStringList> CardDavVCardConverter::convertVCardToContact(const QString &vcard, bool *ok, bool captureUnsupportedProperties)
 {
+    // contacts from read-only addressbooks are never upsynced,
+    // so there is no need to preserve their unsupported properties.
+    m_captureUnsupportedProperties = captureUnsupportedProperties;
     m_unsupportedProperties.clear();
     QVersitReader reader(vcard.toUtf8());
     reader.startReading();
@@ -326,8 +349,10 @@ void CardDavVCardConverter::propertyProcessed(const QVersitDocument &, const QVe
     // cache the unsupported property string, and remove any detail
     // which was added by the default handler for this property.
     *alreadyProcessed = true;
-    QString unsupportedProperty = convertPropertyToString(property);
-    m_tempUnsupportedProperties.append(unsupportedProperty);
+    if (m_captureUnsupportedProperties) {
+        QString unsupportedProperty = convertPropertyToString(property);
+        m_tempUnsupportedProperties.append(unsupportedProperty);
+    }
     updatedDetails->clear();
 }
 
@@ -433,9 +458,15 @@ CardDav::CardDav(Syncer *parent,
     , m_parser(new ReplyParser(q, m_converter))
     , m_serverUrl(serverUrl)
     , m_addressbookPath(addressbookPath)
-    , m_discoveryStage(CardDav::DiscoveryStarted)
     , m_addressbooksListOnly(false)
     , m_triedAddressbookPathAsHomeSetUrl(false)
+    , m_usingDiscoveryCache(false)
+    , m_discoveryComplete(false)
+    , m_discoveryProbeContext(Q_NULLPTR)
+    , m_discoveryError(0)
+    , m_activePrefetches(0)
+    , m_pendingListingComparisons(0)
+    , m_listingsChanged(false)
 {
 }
 
@@ -450,8 +481,15 @@ CardDav::CardDav(Syncer *parent,
     , m_parser(new ReplyParser(q, m_converter))
     , m_serverUrl(serverUrl)
     , m_addressbookPath(addressbookPath)
-    , m_discoveryStage(CardDav::DiscoveryStarted)
     , m_addressbooksListOnly(false)
+    , m_triedAddressbookPathAsHomeSetUrl(false)
+    , m_usingDiscoveryCache(false)
+    , m_discoveryComplete(false)
+    , m_discoveryProbeContext(Q_NULLPTR)
+    , m_discoveryError(0)
+    , m_activePrefetches(0)
+    , m_pendingListingComparisons(0)
+    , m_listingsChanged(false)
 {
 }
 
@@ -467,6 +505,32 @@ void CardDav::errorOccurred(int httpError)
     emit error(httpError);
 }
 
+bool CardDav::retryRequest(QNetworkReply *reply, const char *responseSlot)
+{
+    return m_request->retryRequest(reply, this, [this, responseSlot] (QNetworkReply *retry) {
+        connect(retry, SIGNAL(sslErrors(QList<QSslError>)), this, SLOT(sslErrorsOccurred(QList<QSslError>)));
+        connect(retry, SIGNAL(finished()), this, responseSlot);
+    });
+}
+
+void CardDav::abortRequests()
+{
+    qCDebug(lcCardDav) << Q_FUNC_INFO << "aborting outstanding requests";
+    m_request->abortRequests(this);
+
+    // release any partially downloaded or upsynced data.
+    m_prefetchedListings.clear();
+    m_queuedPrefetches.clear();
+    m_activePrefetches = 0;
+    m_listingComparisonHandler = nullptr;
+    m_queuedListingComparisons.clear();
+    m_pendingListingComparisons = 0;
+    m_unchangedListings.clear();
+    m_downsyncedChanges.clear();
+    m_upsyncedChanges.clear();
+    m_upsyncRequests.clear();
+}
+
 void CardDav::determineAddressbooksList()
 {
     m_addressbooksListOnly = true;
@@ -485,6 +549,17 @@ void CardDav::determineRemoteAMR()
         //     ii) fetch etags, manually calculate delta
         // e) fetch full contacts for delta.
 
+        // The results of steps (a) and (b) are cached from the previous sync.
+        QString serverUrl;
+        QString homeSetPath;
+        if (q->loadDiscoveryCache(&serverUrl, &m_principalPath, &homeSetPath)) {
+            qCDebug(lcCardDav) << Q_FUNC_INFO << "using cached discovery results for" << serverUrl;
+            m_usingDiscoveryCache = true;
+            m_serverUrl = serverUrl;
+            fetchAddressbooksInformation(homeSetPath);
+            return;
+        }
+
         // We start by fetching user information.
         fetchUserInformation();
     } else {
@@ -497,10 +572,6 @@ void CardDav::fetchUserInformation()
 {
     qCDebug(lcCardDav) << Q_FUNC_INFO << "requesting principal urls for user";
 
-    // we need to specify the .well-known/carddav endpoint if it's the first
-    // request (so we have not yet been redirected to the correct endpoint)
-    // and if the path is empty/unknown.
-
     /*
         RFC 6764 section 6.5:
 
@@ -522,6 +593,11 @@ void CardDav::fetchUserInformation()
           to the request on the initial "context path", clients MAY try
           repeating the request on the "root" URI "/" or prompt the user
           for a suitable path.
+
+      Rather than trying each candidate context path in turn, we probe
+      all of them concurrently.  The candidates are ranked in the order in
+      which they would otherwise be tried, and a valid answer is only used
+      once every candidate of a better rank has failed.
     */
 
     QUrl serverUrl(m_serverUrl);
@@ -530,23 +606,109 @@ void CardDav::fetchUserInformation()
         m_serverUrl = QStringLiteral("https://%1/").arg(m_serverUrl);
         serverUrl = QUrl(m_serverUrl);
     }
-    const QString wellKnownUrl = serverUrl.port() == -1
-                               ? QStringLiteral("%1://%2/.well-known/carddav").arg(serverUrl.scheme()).arg(serverUrl.host())
-                               : QStringLiteral("%1://%2:%3/.well-known/carddav").arg(serverUrl.scheme()).arg(serverUrl.host()).arg(serverUrl.port());
-    bool firstRequest = m_discoveryStage == CardDav::DiscoveryStarted;
-    m_serverUrl = firstRequest && (serverUrl.path().isEmpty() || serverUrl.path() == QStringLiteral("/"))
-                ? wellKnownUrl
-                : m_serverUrl;
-    QNetworkReply *reply = m_request->currentUserInformation(m_serverUrl);
-    if (!reply) {
+    const QString rootUrl = serverUrl.port() == -1
+                          ? QStringLiteral("%1://%2/").arg(serverUrl.scheme()).arg(serverUrl.host())
+                          : QStringLiteral("%1://%2:%3/").arg(serverUrl.scheme()).arg(serverUrl.host()).arg(serverUrl.port());
+    const QString wellKnownUrl = rootUrl + QStringLiteral(".well-known/carddav");
+
+    QStringList candidates;
+    if (!serverUrl.path().isEmpty() && serverUrl.path() != QStringLiteral("/")) {
+        // the user supplied an initial context path.
+        candidates.append(m_serverUrl);
+    }
+    if (!candidates.contains(wellKnownUrl)) {
+        candidates.append(wellKnownUrl);
+    }
+    candidates.append(rootUrl);
+
+    m_discoveryComplete = false;
+    m_discoveryError = 0;
+    m_pendingDiscoveryProbes.clear();
+    m_contextResponses.clear();
+    m_discoveryProbes.clear();
+    // retries of the probes are scheduled in this context, so that they can be cancelled.
+    delete m_discoveryProbeContext;
+    m_discoveryProbeContext = new QObject(this);
+    for (int rank = 0; rank < candidates.size(); ++rank) {
+        probeContextPath(candidates.at(rank), rank);
+    }
+    if (m_pendingDiscoveryProbes.isEmpty()) {
         emit error();
+    }
+}
+
+void CardDav::probeContextPath(const QString &contextUrl, int rank)
+{
+    qCDebug(lcCardDav) << Q_FUNC_INFO << "probing context path" << contextUrl;
+    QNetworkReply *reply = m_request->currentUserInformation(contextUrl);
+    if (!reply) {
         return;
     }
 
+    m_pendingDiscoveryProbes[rank] += 1;
+    m_discoveryProbes.append(reply);
+    reply->setProperty("contextUrl", contextUrl);
+    reply->setProperty("contextRank", rank);
     connect(reply, SIGNAL(sslErrors(QList<QSslError>)), this, SLOT(sslErrorsOccurred(QList<QSslError>)));
     connect(reply, SIGNAL(finished()), this, SLOT(userInformationResponse()));
 }
 
+void CardDav::discoveryErrorOccurred(int httpError)
+{
+    // report the most informative error, i.e. prefer e.g. 401 to 404.
+    if (m_discoveryError == 0 || m_discoveryError == 404 || m_discoveryError == 405) {
+        m_discoveryError = httpError;
+    }
+}
+
+void CardDav::contextPathFailed(int rank, int httpError)
+{
+    discoveryErrorOccurred(httpError);
+    contextPathFinished(rank);
+}
+
+void CardDav::contextPathFinished(int rank)
+{
+    QMap<int, int>::iterator pending = m_pendingDiscoveryProbes.find(rank);
+    if (pending != m_pendingDiscoveryProbes.end() && --pending.value() == 0) {
+        m_pendingDiscoveryProbes.erase(pending);
+    }
+
+    // use the best ranked valid answer, once no better ranked probe is outstanding.
+    while (!m_discoveryComplete && !m_contextResponses.isEmpty()
+            && (m_pendingDiscoveryProbes.isEmpty()
+                || m_contextResponses.firstKey() < m_pendingDiscoveryProbes.firstKey())) {
+        const QPair<QString, QByteArray> response = m_contextResponses.take(m_contextResponses.firstKey());
+        useContextPath(response.first, response.second);
+    }
+
+    if (!m_discoveryComplete && m_pendingDiscoveryProbes.isEmpty()) {
+        qCWarning(lcCardDav) << Q_FUNC_INFO << "no context path yielded a valid principal";
+        m_discoveryComplete = true;
+        errorOccurred(m_discoveryError);
+    }
+}
+
+void CardDav::contextPathSucceeded(const QString &contextUrl)
+{
+    // the other probes, and any retries of them, are no longer required.
+    qCDebug(lcCardDav) << Q_FUNC_INFO << "using context path" << contextUrl;
+    m_discoveryComplete = true;
+    m_pendingDiscoveryProbes.clear();
+    m_contextResponses.clear();
+    m_serverUrl = contextUrl;
+    delete m_discoveryProbeContext;
+    m_discoveryProbeContext = Q_NULLPTR;
+    const QList<QPointer<QNetworkReply> > probes = m_discoveryProbes;
+    m_discoveryProbes.clear();
+    for (const QPointer<QNetworkReply> &probe : probes) {
+        if (probe && !probe->isFinished()) {
+            disconnect(probe, 0, this, 0);
+            probe->abort();
+        }
+    }
+}
+
 void CardDav::sslErrorsOccurred(const QList<QSslError> &errors)
 {
     QNetworkReply *reply = qobject_cast<QNetworkReply*>(sender());
@@ -562,38 +724,26 @@ void CardDav::sslErrorsOccurred(const QList<QSslError> &errors)
 void CardDav::userInformationResponse()
 {
     QNetworkReply *reply = qobject_cast<QNetworkReply*>(sender());
+    const QString contextUrl = reply->property("contextUrl").toString();
+    const int rank = reply->property("contextRank").toInt();
     const QByteArray data = reply->readAll();
+    if (m_discoveryComplete) {
+        // another context path has already provided the answer.
+        return;
+    }
+
     if (reply->error() != QNetworkReply::NoError) {
-        int httpError = reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
-        qCWarning(lcCardDav) << Q_FUNC_INFO << "error:" << reply->error() << "(" << httpError << ") to request" << m_serverUrl;
-        debugDumpData(QString::fromUtf8(data));
-        QUrl oldServerUrl(m_serverUrl);
-        if (m_discoveryStage == CardDav::DiscoveryStarted && (httpError == 404 || httpError == 405)) {
-            if (!oldServerUrl.path().endsWith(QStringLiteral(".well-known/carddav"))) {
-                // From RFC 6764: If the initial "context path" derived from a TXT record
-                // generates HTTP errors when targeted by requests, the client
-                // SHOULD repeat its "bootstrapping" procedure using the
-                // appropriate ".well-known" URI instead.
-                qCDebug(lcCardDav) << Q_FUNC_INFO << "got HTTP response" << httpError << "to initial discovery request; trying well-known URI";
-                m_serverUrl = oldServerUrl.port() == -1
-                            ? QStringLiteral("%1://%2/.well-known/carddav").arg(oldServerUrl.scheme()).arg(oldServerUrl.host())
-                            : QStringLiteral("%1://%2:%3/.well-known/carddav").arg(oldServerUrl.scheme()).arg(oldServerUrl.host()).arg(oldServerUrl.port());
-                fetchUserInformation(); // set initial context path to well-known URI.
-            } else {
-                // From RFC 6764: if the server returns a 404 HTTP status response to the
-                // request on the initial context path, clients may try repeating the request
-                // on the root URI.
-                // We also do this on HTTP 405 in case some implementation is non-spec-conformant.
-                qCDebug(lcCardDav) << Q_FUNC_INFO << "got HTTP response" << httpError << "to well-known request; trying root URI";
-                m_discoveryStage = CardDav::DiscoveryTryRoot;
-                m_serverUrl = oldServerUrl.port() == -1
-                            ? QStringLiteral("%1://%2/").arg(oldServerUrl.scheme()).arg(oldServerUrl.host())
-                            : QStringLiteral("%1://%2:%3/").arg(oldServerUrl.scheme()).arg(oldServerUrl.host()).arg(oldServerUrl.port());
-                fetchUserInformation();
-            }
+        if (m_request->retryRequest(reply, m_discoveryProbeContext, [this] (QNetworkReply *retry) {
+                    m_discoveryProbes.append(retry);
+                    connect(retry, SIGNAL(sslErrors(QList<QSslError>)), this, SLOT(sslErrorsOccurred(QList<QSslError>)));
+                    connect(retry, SIGNAL(finished()), this, SLOT(userInformationResponse()));
+                })) {
             return;
         }
-        errorOccurred(httpError);
+        int httpError = reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+        qCWarning(lcCardDav) << Q_FUNC_INFO << "error:" << reply->error() << "(" << httpError << ") to request" << contextUrl;
+        debugDumpData(data);
+        contextPathFailed(rank, httpError);
         return;
     }
 
@@ -611,46 +761,63 @@ void CardDav::userInformationResponse()
         const bool validPathRedirect = orig.path().endsWith(QStringLiteral(".well-known/carddav"))
                                     || orig.path() == redir.path(); // e.g. scheme change.
         if (!hostChanged && !pathChanged && !schemeChanged && !portChanged) {
-            // circular redirect, avoid the endless loop by aborting sync.
+            // circular redirect, avoid the endless loop by abandoning this context path.
             qCWarning(lcCardDav) << Q_FUNC_INFO << "redirect specified is circular:" << redir.toString();
-            errorOccurred(301);
+            contextPathFailed(rank, 301);
         } else if (hostChanged || !validPathRedirect) {
-            // possibly unsafe redirect.  for security, assume it's malicious and abort sync.
+            // possibly unsafe redirect.  for security, assume it's malicious and abandon it.
             qCWarning(lcCardDav) << Q_FUNC_INFO << "unexpected redirect from:" << orig.toString() << "to:" << redir.toString();
-            errorOccurred(301);
+            contextPathFailed(rank, 301);
         } else {
-            // redirect as required, and change our server URL to point to the redirect URL.
+            // redirect as required; the redirect URL replaces this context path.
             qCDebug(lcCardDav) << Q_FUNC_INFO << "redirecting from:" << orig.toString() << "to:" << redir.toString();
-            m_serverUrl = redir.url();
-            m_discoveryStage = CardDav::DiscoveryRedirected;
-            fetchUserInformation();
+            probeContextPath(redir.url(), rank);
+            contextPathFailed(rank, 301);
         }
         return;
     }
 
+    // the response is used once no better ranked context path is outstanding.
+    m_contextResponses.insert(rank, qMakePair(contextUrl, data));
+    contextPathFinished(rank);
+}
+
+void CardDav::useContextPath(const QString &contextUrl, const QByteArray &data)
+{
     ReplyParser::ResponseType responseType = ReplyParser::UserPrincipalResponse;
-    const QString userPath = m_parser->parseUserPrincipal(data, &responseType);
+    QString addressbooksHomePath;
+    const QString userPath = m_parser->parseUserPrincipal(data, &responseType, &addressbooksHomePath);
     if (responseType == ReplyParser::UserPrincipalResponse) {
         // the server responded with the expected user principal information.
         if (userPath.isEmpty()) {
-            qCWarning(lcCardDav) << Q_FUNC_INFO << "unable to parse user principal from response";
-            emit error();
+            qCWarning(lcCardDav) << Q_FUNC_INFO << "unable to parse user principal from response to" << contextUrl;
+            discoveryErrorOccurred(0);
             return;
         }
-        fetchAddressbookUrls(userPath);
+        contextPathSucceeded(contextUrl);
+        m_principalPath = userPath;
+        if (!addressbooksHomePath.isEmpty()) {
+            // the context path is the principal, and the server reported
+            // the home set in the same response.  Skip the next discovery step.
+            qCDebug(lcCardDav) << Q_FUNC_INFO << "home set reported with user principal:" << addressbooksHomePath;
+            fetchAddressbooksInformation(addressbooksHomePath);
+        } else {
+            fetchAddressbookUrls(userPath);
+        }
     } else if (responseType == ReplyParser::AddressbookInformationResponse) {
         // the server responded with addressbook information instead
         // of user principal information.  Skip the next discovery step.
         QList<ReplyParser::AddressBookInformation> infos = m_parser->parseAddressbookInformation(data, QString());
         if (infos.isEmpty()) {
             qCWarning(lcCardDav) << Q_FUNC_INFO << "unable to parse addressbook info from user principal response";
-            emit error();
+            discoveryErrorOccurred(0);
             return;
         }
+        contextPathSucceeded(contextUrl);
         emit addressbooksList(infos);
     } else {
         qCWarning(lcCardDav) << Q_FUNC_INFO << "unknown response from user principal request";
-        emit error();
+        discoveryErrorOccurred(0);
     }
 }
 
@@ -672,10 +839,13 @@ void CardDav::addressbookUrlsResponse()
     QNetworkReply *reply = qobject_cast<QNetworkReply*>(sender());
     const QByteArray data = reply->readAll();
     if (reply->error() != QNetworkReply::NoError) {
+        if (retryRequest(reply, SLOT(addressbookUrlsResponse()))) {
+            return;
+        }
         int httpError = reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
         qCWarning(lcCardDav) << Q_FUNC_INFO << "error:" << reply->error()
                    << "(" << httpError << ")";
-        debugDumpData(QString::fromUtf8(data));
+        debugDumpData(data);
         errorOccurred(httpError);
         return;
     }
@@ -710,14 +880,32 @@ void CardDav::addressbooksInformationResponse()
     QString addressbooksHomePath = reply->property("addressbooksHomePath").toString();
     const QByteArray data = reply->readAll();
     if (reply->error() != QNetworkReply::NoError) {
+        if (retryRequest(reply, SLOT(addressbooksInformationResponse()))) {
+            return;
+        }
         int httpError = reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
         qCWarning(lcCardDav) << Q_FUNC_INFO << "error:" << reply->error()
                    << "(" << httpError << ")";
-        debugDumpData(QString::fromUtf8(data));
+        debugDumpData(data);
+        if (m_usingDiscoveryCache && (httpError == 301 || httpError == 404)) {
+            // the home set has moved.  An authentication failure is reported
+            // as such, since rediscovery with the same credentials would fail too.
+            restartDiscovery();
+            return;
+        }
         errorOccurred(httpError);
         return;
     }
 
+    if (m_usingDiscoveryCache
+            && !reply->attribute(QNetworkRequest::RedirectionTargetAttribute).toUrl().isEmpty()) {
+        qCDebug(lcCardDav) << Q_FUNC_INFO << "cached home set" << addressbooksHomePath << "has moved";
+        restartDiscovery();
+        return;
+    }
+    const QString discoveredHomePath = m_addressbookPath.isEmpty() && !m_usingDiscoveryCache
+                                     ? addressbooksHomePath : QString();
+
     // if we didn't parse the addressbooks home path via discovery, but instead were provided it by the user,
     // then don't pass the path to the parser, as it uses it for cycle detection.
     if (m_addressbookPath == addressbooksHomePath) {
@@ -732,15 +920,213 @@ void CardDav::addressbooksInformationResponse()
             qCDebug(lcCardDav) << Q_FUNC_INFO << "Given path is not addressbook path; trying as home set url";
             m_triedAddressbookPathAsHomeSetUrl = true;
             fetchAddressbookUrls(m_addressbookPath);
+        } else if (m_usingDiscoveryCache) {
+            qCDebug(lcCardDav) << Q_FUNC_INFO << "no addressbooks found in cached home set" << addressbooksHomePath;
+            restartDiscovery();
         } else {
             qCWarning(lcCardDav) << Q_FUNC_INFO << "unable to parse addressbook info from response";
             emit error();
         }
     } else {
+        if (!discoveredHomePath.isEmpty() && !m_principalPath.isEmpty()) {
+            // avoid the discovery round-trips during the next sync.
+            q->storeDiscoveryCache(m_serverUrl, m_principalPath, discoveredHomePath);
+        }
         emit addressbooksList(infos);
     }
 }
 
+void CardDav::restartDiscovery()
+{
+    qCDebug(lcCardDav) << Q_FUNC_INFO << "cached discovery results are stale, restarting discovery";
+    q->clearDiscoveryCache();
+    m_usingDiscoveryCache = false;
+    m_principalPath.clear();
+    m_serverUrl = q->m_serverUrl;
+    fetchUserInformation();
+}
+
+void CardDav::probeCapabilities(const QString &addressbookUrl)
+{
+    // The sequence for determining the server capabilities is:
+    // a) OPTIONS request, to check that the server supports CardDAV.
+    // b) supported-report-set request, to determine which REPORTs
+    //    are supported and whether the Prefer header is honoured.
+    // c) test sync-collection REPORT with a limit of one result,
+    //    to determine whether the server supports paged listings.
+    qCDebug(lcCardDav) << Q_FUNC_INFO << "probing server capabilities via addressbook" << addressbookUrl;
+    m_probedCapabilities.clear();
+    QNetworkReply *reply = m_request->serverOptions(m_serverUrl, addressbookUrl);
+    if (!reply) {
+        capabilitiesDetermined(QStringList(), false);
+        return;
+    }
+
+    reply->setProperty("addressbookUrl", addressbookUrl);
+    connect(reply, SIGNAL(sslErrors(QList<QSslError>)), this, SLOT(sslErrorsOccurred(QList<QSslError>)));
+    connect(reply, SIGNAL(finished()), this, SLOT(optionsResponse()));
+}
+
+void CardDav::optionsResponse()
+{
+    QNetworkReply *reply = qobject_cast<QNetworkReply*>(sender());
+    const QString addressbookUrl = reply->property("addressbookUrl").toString();
+    if (reply->error() != QNetworkReply::NoError) {
+        if (retryRequest(reply, SLOT(optionsResponse()))) {
+            return;
+        }
+        // not all servers support OPTIONS; carry on probing.
+        qCWarning(lcCardDav) << Q_FUNC_INFO << "error:" << reply->error()
+                   << "(" << reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt() << ")";
+    } else {
+        const QByteArray davClasses = reply->rawHeader("DAV");
+        if (!davClasses.contains("addressbook")) {
+            qCWarning(lcCardDav) << Q_FUNC_INFO << "server does not advertise CardDAV support:" << davClasses;
+        }
+        const QByteArray allow = reply->rawHeader("Allow");
+        if (!allow.isEmpty() && !allow.contains("REPORT")) {
+            // no REPORT requests are supported at all.
+            qCWarning(lcCardDav) << Q_FUNC_INFO << "server does not allow REPORT requests:" << allow;
+            capabilitiesDetermined(QStringList(), true);
+            return;
+        }
+    }
+
+    probeSupportedReports(addressbookUrl);
+}
+
+void CardDav::probeSupportedReports(const QString &addressbookUrl)
+{
+    QNetworkReply *reply = m_request->supportedReportSet(m_serverUrl, addressbookUrl);
+    if (!reply) {
+        capabilitiesDetermined(QStringList(), false);
+        return;
+    }
+
+    reply->setProperty("addressbookUrl", addressbookUrl);
+    connect(reply, SIGNAL(sslErrors(QList<QSslError>)), this, SLOT(sslErrorsOccurred(QList<QSslError>)));
+    connect(reply, SIGNAL(finished()), this, SLOT(supportedReportSetResponse()));
+}
+
+void CardDav::supportedReportSetResponse()
+{
+    QNetworkReply *reply = qobject_cast<QNetworkReply*>(sender());
+    const QString addressbookUrl = reply->property("addressbookUrl").toString();
+    const QByteArray data = reply->readAll();
+    if (reply->error() != QNetworkReply::NoError) {
+        if (retryRequest(reply, SLOT(supportedReportSetResponse()))) {
+            return;
+        }
+        // we cannot determine the capabilities, so fall back to the
+        // default behaviour, and try probing again next sync.
+        qCWarning(lcCardDav) << Q_FUNC_INFO << "error:" << reply->error()
+                   << "(" << reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt() << ")";
+        debugDumpData(data);
+        capabilitiesDetermined(QStringList(), false);
+        return;
+    }
+
+    // Whether the server honours a partial address-data request (i.e. only
+    // returns the requested vCard properties) cannot be determined up front,
+    // so it is assumed until a multiget which requests them is rejected.
+    const QStringList reports = m_parser->parseSupportedReportSet(data);
+    m_probedCapabilities.append(CAPABILITY_PARTIALADDRESSDATA);
+    if (reports.contains(QStringLiteral("sync-collection"))) {
+        m_probedCapabilities.append(CAPABILITY_SYNCCOLLECTION);
+    }
+    if (reply->rawHeader("Preference-Applied").contains("return=minimal")) {
+        m_probedCapabilities.append(CAPABILITY_RETURNMINIMAL);
+    }
+
+    if (m_probedCapabilities.contains(CAPABILITY_SYNCCOLLECTION)) {
+        probeSyncCollectionLimit(addressbookUrl);
+    } else {
+        capabilitiesDetermined(m_probedCapabilities, true);
+    }
+}
+
+void CardDav::probeSyncCollectionLimit(const QString &addressbookUrl)
+{
+    QNetworkReply *reply = m_request->syncTokenDelta(m_serverUrl, addressbookUrl, QString(), 1);
+    if (!reply) {
+        capabilitiesDetermined(m_probedCapabilities, true);
+        return;
+    }
+
+    reply->setProperty("addressbookUrl", addressbookUrl);
+    connect(reply, SIGNAL(sslErrors(QList<QSslError>)), this, SLOT(sslErrorsOccurred(QList<QSslError>)));
+    connect(reply, SIGNAL(downloadProgress(qint64,qint64)), this, SLOT(syncCollectionLimitProgress(qint64,qint64)));
+    connect(reply, SIGNAL(finished()), this, SLOT(syncCollectionLimitResponse()));
+}
+
+void CardDav::syncCollectionLimitProgress(qint64 bytesReceived, qint64 bytesTotal)
+{
+    // a listing of a single contact is small.  If the server ignores the
+    // limit it sends the listing of the whole addressbook, so stop it early.
+    QNetworkReply *reply = qobject_cast<QNetworkReply*>(sender());
+    if (bytesReceived > SyncCollectionLimitProbeSize || bytesTotal > SyncCollectionLimitProbeSize) {
+        qCDebug(lcCardDav) << Q_FUNC_INFO << "server ignores the sync-collection limit";
+        reply->setProperty("limitIgnored", true);
+        reply->abort();
+    }
+}
+
+void CardDav::syncCollectionLimitResponse()
+{
+    QNetworkReply *reply = qobject_cast<QNetworkReply*>(sender());
+    const QString addressbookUrl = reply->property("addressbookUrl").toString();
+    const QByteArray data = reply->readAll();
+    if (reply->property("limitIgnored").toBool()) {
+        capabilitiesDetermined(m_probedCapabilities, true);
+        return;
+    }
+    if (reply->error() != QNetworkReply::NoError) {
+        if (retryRequest(reply, SLOT(syncCollectionLimitResponse()))) {
+            return;
+        }
+        // the server rejected the limit.
+        qCDebug(lcCardDav) << Q_FUNC_INFO << "server does not support sync-collection limits:" << reply->error()
+                 << "(" << reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt() << ")";
+        capabilitiesDetermined(m_probedCapabilities, true);
+        return;
+    }
+
+    // the server honours the limit if it truncated the listing,
+    // or if the addressbook has no more than one contact anyway.
+    QString newSyncToken;
+    bool truncated = false;
+    const QList<ReplyParser::ContactInformation> infos = m_parser->parseSyncTokenDelta(data, addressbookUrl, &newSyncToken, &truncated);
+    if (truncated || infos.size() <= 1) {
+        m_probedCapabilities.append(CAPABILITY_SYNCCOLLECTIONLIMIT);
+    }
+    capabilitiesDetermined(m_probedCapabilities, true);
+}
+
+void CardDav::capabilitiesDetermined(const QStringList &capabilities, bool probed)
+{
+    if (probed) {
+        qCDebug(lcCardDav) << Q_FUNC_INFO << "server capabilities:" << capabilities;
+        q->storeServerCapabilities(capabilities);
+    } else {
+        // assume the server supports everything, as we did before probing.
+        // we will try to probe again during the next sync.
+        qCWarning(lcCardDav) << Q_FUNC_INFO << "unable to determine server capabilities";
+        q->m_serverCapabilities = QStringList() << CAPABILITY_SYNCCOLLECTION
+                                                << CAPABILITY_SYNCCOLLECTIONLIMIT
+                                                << CAPABILITY_PARTIALADDRESSDATA;
+        q->m_serverCapabilitiesProbed = true;
+    }
+
+    const QList<std::function<bool ()> > pending = m_pendingDownsyncs;
+    m_pendingDownsyncs.clear();
+    for (const std::function<bool ()> &downsync : pending) {
+        if (!downsync()) {
+            emit error();
+            return;
+        }
+    }
+}
+
 bool CardDav::downsyncAddressbookContent(
         const QString &addressbookUrl,
         const QString &newSyncToken,
@@ -748,65 +1134,382 @@ bool CardDav::downsyncAddressbookContent(
         const QString &oldSyncToken,
         const QString &oldCtag)
 {
+    if (!q->m_serverCapabilitiesProbed) {
+        // determine the server capabilities first, so that we can choose
+        // the best strategy for this (and every other) addressbook.
+        m_pendingDownsyncs.append([this, addressbookUrl, newSyncToken, newCtag, oldSyncToken, oldCtag] () {
+            return downsyncAddressbookContent(addressbookUrl, newSyncToken, newCtag, oldSyncToken, oldCtag);
+        });
+        if (m_pendingDownsyncs.size() == 1) {
+            probeCapabilities(addressbookUrl);
+        }
+        return true;
+    }
+
+    if (!newSyncToken.isEmpty() && !q->m_serverCapabilities.contains(CAPABILITY_SYNCCOLLECTION)) {
+        // the server reports a sync token, but doesn't support the sync-collection report.
+        qCDebug(lcCardDav) << Q_FUNC_INFO << "ignoring sync-token for addressbook" << addressbookUrl
+                           << "as the server does not support sync-collection";
+        return downsyncAddressbookContent(addressbookUrl, QString(), newCtag, QString(), oldCtag);
+    }
+
     if (newSyncToken.isEmpty() && newCtag.isEmpty()) {
         // we cannot use either sync-token or ctag for this addressbook.
         // we need to manually calculate the complete delta.
         qCDebug(lcCardDav) << "No sync-token or ctag given for addressbook:" << addressbookUrl << ", manual delta detection required";
+    }
+
+    switch (listingType(newSyncToken, newCtag, oldSyncToken, oldCtag)) {
+    case MetadataListing:
+        // do etag request and then manually calculate deltas.
+        // on first time sync, the delta will be all remote additions.
         return fetchContactMetadata(addressbookUrl);
-    } else if (newSyncToken.isEmpty()) {
-        // we cannot use sync-token for this addressbook, but instead ctag.
-        if (oldCtag.isEmpty()) {
-            // first time sync
-            // do etag request, the delta will be all remote additions
-            return fetchContactMetadata(addressbookUrl);
-        } else if (oldCtag != newCtag) {
-            // changes have occurred since last sync
-            // perform etag request and then manually calculate deltas.
-            return fetchContactMetadata(addressbookUrl);
-        } else {
-            // no changes have occurred in this addressbook since last sync
+    case FullDeltaListing:
+        // first time sync with a server which supports webdav-sync.
+        // perform slow sync / full report, by passing an empty sync token to the server.
+        return fetchImmediateDelta(addressbookUrl, QString(), true);
+    case DeltaListing:
+        // changes have occurred since last sync.
+        // perform immediate delta sync, by passing the old sync token to the server.
+        return fetchImmediateDelta(addressbookUrl, oldSyncToken, false);
+    case NoListing:
+    default:
+        if (q->hasSkippedContacts(q->m_currentCollections.value(addressbookUrl))) {
+            // the contacts skipped by a memory-bounded sync are fetched anyway.
             qCDebug(lcCardDav) << Q_FUNC_INFO << "no changes since last sync for"
-                     << addressbookUrl << "from account" << q->m_accountId;
+                     << addressbookUrl << "but fetching previously skipped contacts";
             QTimer::singleShot(0, this, [this, addressbookUrl] () {
-                calculateContactChanges(addressbookUrl, QList<QContact>(), QList<QContact>());
+                fetchContacts(addressbookUrl);
             });
             return true;
         }
+        // no changes have occurred in this addressbook since last sync
+        qCDebug(lcCardDav) << Q_FUNC_INFO << "no changes since last sync for"
+                 << addressbookUrl << "from account" << q->m_accountId;
+        QTimer::singleShot(0, this, [this, addressbookUrl] () {
+            calculateContactChanges(addressbookUrl, QList<QContact>(), QList<QContact>());
+        });
+        return true;
+    }
+}
+
+CardDav::ListingType CardDav::listingType(
+        const QString &newSyncToken,
+        const QString &newCtag,
+        const QString &oldSyncToken,
+        const QString &oldCtag)
+{
+    if (newSyncToken.isEmpty()) {
+        // we cannot use sync-token for this addressbook, but instead ctag.
+        return newCtag.isEmpty() || oldCtag.isEmpty() || oldCtag != newCtag
+                ? MetadataListing
+                : NoListing;
+    }
+
+    // the server supports webdav-sync for this addressbook.
+    return oldSyncToken.isEmpty() ? FullDeltaListing
+         : oldSyncToken != newSyncToken ? DeltaListing
+         : NoListing;
+}
+
+void CardDav::prefetchContactListings(const QList<QContactCollection> &addressbooks)
+{
+    // the adaptor determines the changes of one addressbook at a time,
+    // so an account with many changed addressbooks would otherwise wait
+    // for each listing in turn.  Request the listings of all of them up
+    // front instead (a few at a time), and use them once the adaptor
+    // gets to each addressbook.  This requires the server capabilities,
+    // which are only known here if they were stored by a previous sync.
+    if (!q->m_serverCapabilitiesProbed) {
+        return;
+    }
+
+    if (q->m_memoryBudget > 0) {
+        // a memory-bounded sync holds only the listing of the current addressbook.
+        return;
+    }
+
+    const bool syncCollection = q->m_serverCapabilities.contains(CAPABILITY_SYNCCOLLECTION);
+    for (const QContactCollection &addressbook : addressbooks) {
+        const QString addressbookUrl = addressbook.extendedMetaData(COLLECTION_EXTENDEDMETADATA_KEY_REMOTEPATH).toString();
+        if (addressbookUrl.isEmpty() || m_prefetchedListings.contains(addressbookUrl)
+                || m_unchangedListings.contains(addressbookUrl)) {
+            continue;
+        }
+        const QPair<QString, QString> previous = q->m_previousCtagSyncToken.value(addressbookUrl);
+        const QString newSyncToken = syncCollection ? addressbook.extendedMetaData(KEY_SYNCTOKEN).toString() : QString();
+        const QString oldSyncToken = syncCollection ? previous.second : QString();
+        const ListingType type = listingType(newSyncToken, addressbook.extendedMetaData(KEY_CTAG).toString(),
+                                             oldSyncToken, previous.first);
+        if (type == NoListing) {
+            continue;
+        }
+
+        PrefetchedListing listing;
+        listing.type = type;
+        listing.syncToken = type == DeltaListing ? oldSyncToken : QString();
+        m_prefetchedListings.insert(addressbookUrl, listing);
+        m_queuedPrefetches.append(addressbookUrl);
+    }
+
+    startPrefetches();
+}
+
+void CardDav::startPrefetches()
+{
+    // the prefetches share the limit on concurrent requests with the contact
+    // pages being fetched, which take precedence as the adaptor awaits them.
+    const int maxConcurrent = q->m_maxConcurrentListings;
+    while (!m_queuedPrefetches.isEmpty()
+            && m_activePrefetches + activeContactsPages() < maxConcurrent
+            && prefetchedBytes() < MaxPrefetchedListingBytes) {
+        const QString addressbookUrl = m_queuedPrefetches.takeFirst();
+        PrefetchedListing &listing(m_prefetchedListings[addressbookUrl]);
+        qCDebug(lcCardDav) << Q_FUNC_INFO << "prefetching contact listing for addressbook" << addressbookUrl;
+        const int limit = q->m_serverCapabilities.contains(CAPABILITY_SYNCCOLLECTIONLIMIT) ? SyncCollectionPageSize : 0;
+        QNetworkReply *reply = listing.type == MetadataListing
+                ? m_request->contactEtags(m_serverUrl, addressbookUrl)
+                : m_request->syncTokenDelta(m_serverUrl, addressbookUrl, listing.syncToken, limit);
+        if (!reply) {
+            // the listing will be requested when the adaptor gets to this addressbook.
+            m_prefetchedListings.remove(addressbookUrl);
+            continue;
+        }
+
+        listing.requested = true;
+        m_activePrefetches += 1;
+        reply->setProperty("addressbookUrl", addressbookUrl);
+        connect(reply, SIGNAL(sslErrors(QList<QSslError>)), this, SLOT(sslErrorsOccurred(QList<QSslError>)));
+        connect(reply, SIGNAL(finished()), this, SLOT(prefetchResponse()));
+    }
+}
+
+void CardDav::compareContactListings(const QStringList &addressbookUrls, const std::function<void (bool)> &handler)
+{
+    // Addressbooks without a ctag or sync token can only be checked for
+    // changes by listing their contacts.  Compare the listings against the
+    // snapshots stored by the previous sync, rather than against the local
+    // contacts, so that unchanged addressbooks can be detected before the
+    // adaptor loads the local contacts of every addressbook.  If the sync
+    // cycle runs anyway, the listings of the unchanged addressbooks are
+    // neither requested again nor compared against the local contacts,
+    // see fetchContactMetadata().
+    m_listingComparisonHandler = handler;
+    m_queuedListingComparisons = addressbookUrls;
+    m_pendingListingComparisons = 0;
+    m_listingsChanged = false;
+    startListingComparisons();
+}
+
+void CardDav::startListingComparisons()
+{
+    // the listings are requested a few at a time, as when prefetching them.
+    const int maxConcurrent = q->m_maxConcurrentListings;
+    while (!m_queuedListingComparisons.isEmpty() && m_pendingListingComparisons < maxConcurrent) {
+        const QString addressbookUrl = m_queuedListingComparisons.takeFirst();
+        QNetworkReply *reply = m_request->contactEtags(m_serverUrl, addressbookUrl);
+        if (!reply) {
+            // the remaining addressbooks are listed by the sync cycle.
+            m_queuedListingComparisons.clear();
+            m_listingsChanged = true;
+            break;
+        }
+        m_pendingListingComparisons += 1;
+        reply->setProperty("addressbookUrl", addressbookUrl);
+        connect(reply, SIGNAL(sslErrors(QList<QSslError>)), this, SLOT(sslErrorsOccurred(QList<QSslError>)));
+        connect(reply, SIGNAL(finished()), this, SLOT(listingComparisonResponse()));
+    }
+
+    if (m_listingComparisonHandler && m_pendingListingComparisons == 0) {
+        const std::function<void (bool)> handler = m_listingComparisonHandler;
+        m_listingComparisonHandler = nullptr;
+        handler(m_listingsChanged);
+    }
+}
+
+void CardDav::listingComparisonResponse()
+{
+    QNetworkReply *reply = qobject_cast<QNetworkReply*>(sender());
+    const QString addressbookUrl = reply->property("addressbookUrl").toString();
+    const QByteArray data = reply->readAll();
+    m_pendingListingComparisons -= 1;
+    if (q->m_syncAborted) {
+        return;
+    }
+
+    if (reply->error() != QNetworkReply::NoError) {
+        // the sync cycle will report any persistent error.
+        qCDebug(lcCardDav) << Q_FUNC_INFO << "unable to list contacts of addressbook" << addressbookUrl
+                           << ":" << reply->error();
+        m_listingsChanged = true;
     } else {
-        // the server supports webdav-sync for this addressbook.
-        // attempt to perform synctoken sync
-        if (oldSyncToken.isEmpty()) {
-            // first time sync
-            // perform slow sync / full report
-            return fetchContactMetadata(addressbookUrl);
-        } else if (oldSyncToken != newSyncToken) {
-            // changes have occurred since last sync.
-            // perform immediate delta sync, by passing the old sync token to the server.
-            return fetchImmediateDelta(addressbookUrl, oldSyncToken);
-        } else {
-            // no changes have occurred in this addressbook since last sync
-            qCDebug(lcCardDav) << Q_FUNC_INFO << "no changes since last sync for"
-                     << addressbookUrl << "from account" << q->m_accountId;
-            QTimer::singleShot(0, this, [this, addressbookUrl] () {
-                calculateContactChanges(addressbookUrl, QList<QContact>(), QList<QContact>());
-            });
-            return true;
+        // all of the listings are compared, as the sync cycle requires the
+        // listing of each addressbook if any of them has changed.
+        bool truncated = false;
+        const QList<ReplyParser::ContactInformation> infos = m_parser->parseContactMetadata(
+                data, addressbookUrl, ReplyParser::LocalContactIndex(), &truncated);
+        SyncStateSnapshot snapshot;
+        bool changed = truncated
+                || !snapshot.open(SyncStateSnapshot::filePath(q->m_accountId, addressbookUrl))
+                || snapshot.size() != infos.size();
+        QString etag;
+        for (int i = 0; !changed && i < infos.size(); ++i) {
+            changed = !snapshot.find(infos.at(i).uri, &etag) || etag != infos.at(i).etag;
+        }
+        qCDebug(lcCardDav) << Q_FUNC_INFO << "addressbook" << addressbookUrl
+                           << (changed ? "has changed" : "is unchanged") << "since the previous sync";
+        if (!changed) {
+            m_unchangedListings.insert(addressbookUrl);
+        } else if (q->m_memoryBudget <= 0 && !m_prefetchedListings.contains(addressbookUrl)
+                && prefetchedBytes() + data.size() <= MaxPrefetchedListingBytes) {
+            // the sync cycle would request the same listing, so keep it as a prefetched listing.
+            PrefetchedListing listing;
+            listing.type = MetadataListing;
+            listing.requested = true;
+            listing.finished = true;
+            listing.data = data;
+            m_prefetchedListings.insert(addressbookUrl, listing);
         }
+        m_listingsChanged = m_listingsChanged || changed;
     }
+
+    startListingComparisons();
 }
 
-bool CardDav::fetchImmediateDelta(const QString &addressbookUrl, const QString &syncToken)
+void CardDav::releasePrefetchedListings()
 {
+    // any listings which the sync cycle did not use are no longer required.
+    m_prefetchedListings.clear();
+    m_queuedPrefetches.clear();
+    m_unchangedListings.clear();
+}
+
+qint64 CardDav::prefetchedBytes() const
+{
+    qint64 bytes = 0;
+    for (const PrefetchedListing &listing : m_prefetchedListings) {
+        bytes += listing.data.size();
+    }
+    return bytes;
+}
+
+int CardDav::activeContactsPages() const
+{
+    int pages = 0;
+    for (const DownsyncedContacts &downsynced : m_downsyncedChanges) {
+        pages += downsynced.activePages;
+    }
+    return pages;
+}
+
+void CardDav::prefetchResponse()
+{
+    QNetworkReply *reply = qobject_cast<QNetworkReply*>(sender());
+    const QString addressbookUrl = reply->property("addressbookUrl").toString();
+    const QByteArray data = reply->readAll();
+    m_activePrefetches -= 1;
+    if (q->m_syncAborted) {
+        return;
+    }
+    startPrefetches();
+
+    QHash<QString, PrefetchedListing>::iterator it = m_prefetchedListings.find(addressbookUrl);
+    if (it == m_prefetchedListings.end()) {
+        // the listing was discarded, and has been requested normally instead.
+        return;
+    }
+
+    if (reply->error() != QNetworkReply::NoError) {
+        // request the listing normally (with retries) once it is needed.
+        qCDebug(lcCardDav) << Q_FUNC_INFO << "failed to prefetch contact listing for addressbook" << addressbookUrl
+                           << ":" << reply->error();
+        const PrefetchedListing listing = m_prefetchedListings.take(addressbookUrl);
+        if (listing.awaited) {
+            const bool requested = listing.type == MetadataListing
+                    ? fetchContactMetadata(addressbookUrl)
+                    : fetchImmediateDelta(addressbookUrl, listing.syncToken, listing.type == FullDeltaListing);
+            if (!requested) {
+                emit error();
+            }
+        }
+        return;
+    }
+
+    if (it->awaited) {
+        const PrefetchedListing listing = m_prefetchedListings.take(addressbookUrl);
+        processListing(addressbookUrl, listing, data);
+    } else if (prefetchedBytes() + data.size() > MaxPrefetchedListingBytes) {
+        // the listing will be requested again once the adaptor gets to this addressbook.
+        qCDebug(lcCardDav) << Q_FUNC_INFO << "discarding prefetched contact listing for addressbook" << addressbookUrl
+                           << "as too much listing data is held";
+        m_prefetchedListings.erase(it);
+    } else {
+        it->finished = true;
+        it->data = data;
+    }
+}
+
+bool CardDav::adoptPrefetchedListing(const QString &addressbookUrl, ListingType type, const QString &syncToken)
+{
+    QHash<QString, PrefetchedListing>::iterator it = m_prefetchedListings.find(addressbookUrl);
+    if (it == m_prefetchedListings.end()) {
+        return false;
+    }
+
+    if (!it->requested || it->type != type || it->syncToken != syncToken) {
+        // not requested yet, or not the listing which is required now.
+        m_queuedPrefetches.removeAll(addressbookUrl);
+        m_prefetchedListings.erase(it);
+        return false;
+    }
+
+    qCDebug(lcCardDav) << Q_FUNC_INFO << "using prefetched contact listing for addressbook" << addressbookUrl;
+    if (!it->finished) {
+        // will be processed once the response arrives.
+        it->awaited = true;
+        return true;
+    }
+
+    // the caller expects the listing to be processed asynchronously.
+    const PrefetchedListing listing = m_prefetchedListings.take(addressbookUrl);
+    startPrefetches();
+    QTimer::singleShot(0, this, [this, addressbookUrl, listing] () {
+        if (!q->m_syncAborted) {
+            processListing(addressbookUrl, listing, listing.data);
+        }
+    });
+    return true;
+}
+
+void CardDav::processListing(const QString &addressbookUrl, const PrefetchedListing &listing, const QByteArray &data)
+{
+    if (listing.type == MetadataListing) {
+        processContactMetadata(addressbookUrl, data);
+    } else {
+        processImmediateDelta(addressbookUrl, listing.syncToken, listing.type == FullDeltaListing, data);
+    }
+}
+
+bool CardDav::fetchImmediateDelta(const QString &addressbookUrl, const QString &syncToken, bool fullListing)
+{
+    if (adoptPrefetchedListing(addressbookUrl, fullListing ? FullDeltaListing : DeltaListing, syncToken)) {
+        return true;
+    }
+
     qCDebug(lcCardDav) << Q_FUNC_INFO
              << "requesting immediate delta for addressbook" << addressbookUrl
              << "with sync token" << syncToken;
 
-    QNetworkReply *reply = m_request->syncTokenDelta(m_serverUrl, addressbookUrl, syncToken);
+    // only page the listing if the server is known to honour the limit.
+    const int limit = q->m_serverCapabilities.contains(CAPABILITY_SYNCCOLLECTIONLIMIT) ? SyncCollectionPageSize : 0;
+    QNetworkReply *reply = m_request->syncTokenDelta(m_serverUrl, addressbookUrl, syncToken, limit);
     if (!reply) {
         return false;
     }
 
     reply->setProperty("addressbookUrl", addressbookUrl);
+    reply->setProperty("syncToken", syncToken);
+    reply->setProperty("fullListing", fullListing);
     connect(reply, SIGNAL(sslErrors(QList<QSslError>)), this, SLOT(sslErrorsOccurred(QList<QSslError>)));
     connect(reply, SIGNAL(finished()), this, SLOT(immediateDeltaResponse()));
     return true;
@@ -816,29 +1519,104 @@ void CardDav::immediateDeltaResponse()
 {
     QNetworkReply *reply = qobject_cast<QNetworkReply*>(sender());
     const QString addressbookUrl = reply->property("addressbookUrl").toString();
+    const QString syncToken = reply->property("syncToken").toString();
+    const bool fullListing = reply->property("fullListing").toBool();
     const QByteArray data = reply->readAll();
     if (reply->error() != QNetworkReply::NoError) {
+        if (retryRequest(reply, SLOT(immediateDeltaResponse()))) {
+            return;
+        }
         qCWarning(lcCardDav) << Q_FUNC_INFO << "error:" << reply->error()
                    << "(" << reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt() << ")";
-        debugDumpData(QString::fromUtf8(data));
+        debugDumpData(data);
         // The server is allowed to forget the syncToken by the
         // carddav protocol.  Try a full report sync just in case.
-        fetchContactMetadata(addressbookUrl);
+        clearContactInformation(addressbookUrl);
+        if (!fetchContactMetadata(addressbookUrl)) {
+            emit error();
+        }
         return;
     }
 
+    processImmediateDelta(addressbookUrl, syncToken, fullListing, data);
+}
+
+void CardDav::processImmediateDelta(const QString &addressbookUrl, const QString &syncToken, bool fullListing, const QByteArray &data)
+{
     QString newSyncToken;
-    QList<ReplyParser::ContactInformation> infos = m_parser->parseSyncTokenDelta(data, addressbookUrl, &newSyncToken);
+    bool truncated = false;
+    const QList<ReplyParser::ContactInformation> infos = m_parser->parseSyncTokenDelta(data, addressbookUrl, &newSyncToken, &truncated);
+    storeContactInformation(addressbookUrl, infos);
+
+    if (truncated) {
+        if (newSyncToken.isEmpty() || newSyncToken == syncToken) {
+            // we cannot continue from where the server left off.
+            qCWarning(lcCardDav) << Q_FUNC_INFO << "truncated delta without new sync token for addressbook" << addressbookUrl
+                                 << ", falling back to full contact metadata listing";
+            clearContactInformation(addressbookUrl);
+            if (!fetchContactMetadata(addressbookUrl)) {
+                emit error();
+            }
+        } else if (!fetchImmediateDelta(addressbookUrl, newSyncToken, fullListing)) {
+            // fetch the next page of the delta.
+            emit error();
+        }
+        return;
+    }
+
+    if (fullListing) {
+        // any contact we knew about which wasn't reported
+        // in the full listing must have been deleted remotely.
+        const ReplyParser::LocalContactIndex &localContacts(q->m_localContactIndex[addressbookUrl]);
+        const RemoteContactChanges &remoteChanges(remoteContactChanges(addressbookUrl));
+        QList<ReplyParser::ContactInformation> removals;
+        for (ReplyParser::LocalContactIndex::const_iterator it = localContacts.constBegin(); it != localContacts.constEnd(); ++it) {
+            const ReplyParser::ContactInformation::ModificationType remoteModType = remoteChanges.modificationType(it.key());
+            if (it->knownRemotely()
+                    && (remoteModType == ReplyParser::ContactInformation::Uninitialized
+                        || remoteModType == ReplyParser::ContactInformation::Deletion)) {
+                ReplyParser::ContactInformation removal;
+                removal.modType = ReplyParser::ContactInformation::Deletion;
+                removal.uri = it.key();
+                removal.etag = it->etag;
+                removals.append(removal);
+            }
+        }
+        storeContactInformation(addressbookUrl, removals);
+    }
 
     QContactCollection addressbook = q->m_currentCollections[addressbookUrl];
     addressbook.setExtendedMetaData(KEY_SYNCTOKEN, newSyncToken);
     q->m_currentCollections.insert(addressbookUrl, addressbook);
 
-    fetchContacts(addressbookUrl, infos);
+    fetchContacts(addressbookUrl);
 }
 
 bool CardDav::fetchContactMetadata(const QString &addressbookUrl)
 {
+    if (m_unchangedListings.remove(addressbookUrl)) {
+        // the listing matched the sync state snapshot before the sync cycle,
+        // so there are no remote changes.  The caller expects the changes to
+        // be determined asynchronously, once the local contacts are known.
+        QTimer::singleShot(0, this, [this, addressbookUrl] () {
+            if (q->m_syncAborted) {
+                return;
+            }
+            if (q->m_collectionAMRU.contains(addressbookUrl)) {
+                qCDebug(lcCardDav) << Q_FUNC_INFO << "contact listing unchanged since last sync for addressbook" << addressbookUrl;
+                calculateContactChanges(addressbookUrl, QList<QContact>(), QList<QContact>());
+            } else if (!fetchContactMetadata(addressbookUrl)) {
+                // the addressbook is new locally, so its contacts must be listed.
+                emit error();
+            }
+        });
+        return true;
+    }
+
+    if (adoptPrefetchedListing(addressbookUrl, MetadataListing, QString())) {
+        return true;
+    }
+
     qCDebug(lcCardDav) << Q_FUNC_INFO << "requesting contact metadata for addressbook" << addressbookUrl;
     QNetworkReply *reply = m_request->contactEtags(m_serverUrl, addressbookUrl);
     if (!reply) {
@@ -857,89 +1635,270 @@ void CardDav::contactMetadataResponse()
     const QString addressbookUrl = reply->property("addressbookUrl").toString();
     const QByteArray data = reply->readAll();
     if (reply->error() != QNetworkReply::NoError) {
+        if (retryRequest(reply, SLOT(contactMetadataResponse()))) {
+            return;
+        }
         int httpError = reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
         qCWarning(lcCardDav) << Q_FUNC_INFO << "error:" << reply->error()
                    << "(" << httpError << ")";
-        debugDumpData(QString::fromUtf8(data));
+        debugDumpData(data);
         errorOccurred(httpError);
         return;
     }
 
+    processContactMetadata(addressbookUrl, data);
+}
+
+void CardDav::processContactMetadata(const QString &addressbookUrl, const QByteArray &data)
+{
     // if we are determining contact changes (i.e. delta) then we will
-    // have local contact AMRU information cached for this addressbook.
-    // build a cache list of the old etags of the still-existent contacts.
-    QHash<QString, QString> uriToEtag;
-    if (q->m_collectionAMRU.contains(addressbookUrl)) {
-        auto createHash = [&uriToEtag] (const QList<QContact> &contacts) {
-            for (const QContact &c : contacts) {
-                const QString uri = c.detail<QContactSyncTarget>().syncTarget();
-                if (uri.isEmpty()) {
-                    qCWarning(lcCardDav) << Q_FUNC_INFO << ": carddav contact has empty sync target (uri): " << QString::fromLatin1(c.id().localId());
-                } else {
-                    const QList<QContactExtendedDetail> dets = c.details<QContactExtendedDetail>();
-                    for (const QContactExtendedDetail &d : dets) {
-                        if (d.name() == KEY_ETAG) {
-                            uriToEtag.insert(uri, d.data().toString());
-                            break;
-                        }
-                    }
-                }
-            }
-        };
-        createHash(q->m_collectionAMRU[addressbookUrl].modified);
-        createHash(q->m_collectionAMRU[addressbookUrl].unmodified);
+    // have indexed the local contacts of this addressbook.
+    bool truncated = false;
+    const QList<ReplyParser::ContactInformation> infos = m_parser->parseContactMetadata(
+            data, addressbookUrl, q->m_localContactIndex.value(addressbookUrl), &truncated);
+    if (truncated) {
+        qCWarning(lcCardDav) << Q_FUNC_INFO << "contact metadata listing was truncated by the server for addressbook" << addressbookUrl;
+    } else {
+        // the listing is complete, so it can be stored as the sync state snapshot.
+        q->m_completeListings.insert(addressbookUrl);
     }
+    storeContactInformation(addressbookUrl, infos);
+    fetchContacts(addressbookUrl);
+}
 
-    QList<ReplyParser::ContactInformation> infos = m_parser->parseContactMetadata(data, addressbookUrl, uriToEtag);
-    fetchContacts(addressbookUrl, infos);
+void CardDav::storeContactInformation(const QString &addressbookUrl, const QList<ReplyParser::ContactInformation> &amrInfo)
+{
+    // split into A/M/R/U sets.
+    // a later page of a paged listing may report a newer state for a
+    // contact which was reported in an earlier page, so the latest wins.
+    QHash<QString, RemoteContactChanges>::iterator it = q->m_remoteChanges.find(addressbookUrl);
+    if (it == q->m_remoteChanges.end()) {
+        it = q->m_remoteChanges.insert(addressbookUrl, RemoteContactChanges(addressbookUrl));
+        it->reserve(amrInfo.size());
+    }
+    RemoteContactChanges &remoteChanges(it.value());
+    for (const ReplyParser::ContactInformation &info : amrInfo) {
+        if (info.modType == ReplyParser::ContactInformation::Uninitialized) {
+            qCWarning(lcCardDav) << Q_FUNC_INFO << "no modification type in info for:" << info.uri;
+            continue;
+        }
+        remoteChanges.insert(info);
+    }
+}
+
+void CardDav::clearContactInformation(const QString &addressbookUrl)
+{
+    q->m_remoteChanges.remove(addressbookUrl);
 }
 
-void CardDav::fetchContacts(const QString &addressbookUrl, const QList<ReplyParser::ContactInformation> &amrInfo)
+const RemoteContactChanges &CardDav::remoteContactChanges(const QString &addressbookUrl) const
 {
-    qCDebug(lcCardDav) << Q_FUNC_INFO << "requesting full contact information from addressbook" << addressbookUrl;
+    // reading the changes of an addressbook which reported none does not record them.
+    static const RemoteContactChanges NoChanges;
+    const QHash<QString, RemoteContactChanges>::const_iterator it = q->m_remoteChanges.constFind(addressbookUrl);
+    return it == q->m_remoteChanges.constEnd() ? NoChanges : it.value();
+}
 
-    // split into A/M/R/U request sets
-    QStringList contactUris;
-    Q_FOREACH (const ReplyParser::ContactInformation &info, amrInfo) {
-        if (info.modType == ReplyParser::ContactInformation::Addition) {
-            q->m_remoteAdditions[addressbookUrl].insert(info.uri, info);
-            contactUris.append(info.uri);
-        } else if (info.modType == ReplyParser::ContactInformation::Modification) {
-            q->m_remoteModifications[addressbookUrl].insert(info.uri, info);
-            contactUris.append(info.uri);
-        } else if (info.modType == ReplyParser::ContactInformation::Deletion) {
-            q->m_remoteRemovals[addressbookUrl].insert(info.uri, info);
-        } else if (info.modType == ReplyParser::ContactInformation::Unmodified) {
-            q->m_remoteUnmodified[addressbookUrl].insert(info.uri, info);
+void CardDav::fetchContacts(const QString &addressbookUrl)
+{
+    // contacts which a memory-bounded sync skipped are fetched once the
+    // sync is no longer bounded, unless the listing reports them anyway.
+    const ReplyParser::LocalContactIndex &localContacts(q->m_localContactIndex[addressbookUrl]);
+    const qint64 maxBufferedVCardSize = q->maxBufferedVCardSize();
+    QStringList skippedUris;
+    QList<ReplyParser::ContactInformation> unskipped;
+    for (const QString &uri : q->m_currentCollections[addressbookUrl].extendedMetaData(KEY_SKIPPEDCONTACTS).toStringList()) {
+        if (remoteContactChanges(addressbookUrl).contains(uri)) {
+            continue;
+        } else if (maxBufferedVCardSize > 0) {
+            skippedUris.append(uri);
         } else {
-            qCWarning(lcCardDav) << Q_FUNC_INFO << "no modification type in info for:" << info.uri;
+            ReplyParser::ContactInformation info;
+            info.uri = uri;
+            info.modType = localContacts.contains(uri) ? ReplyParser::ContactInformation::Modification
+                                                       : ReplyParser::ContactInformation::Addition;
+            unskipped.append(info);
         }
     }
+    if (!unskipped.isEmpty()) {
+        qCDebug(lcCardDav) << Q_FUNC_INFO << "fetching" << unskipped.size() << "previously skipped contacts";
+        storeContactInformation(addressbookUrl, unskipped);
+    }
 
+    const RemoteContactChanges &remoteChanges(remoteContactChanges(addressbookUrl));
     qCDebug(lcCardDav) << Q_FUNC_INFO << "Have calculated A/M/R/U:"
-             << q->m_remoteAdditions[addressbookUrl].size() << "/"
-             << q->m_remoteModifications[addressbookUrl].size() << "/"
-             << q->m_remoteRemovals[addressbookUrl].size() << "/"
-             << q->m_remoteUnmodified[addressbookUrl].size()
+             << remoteChanges.count(ReplyParser::ContactInformation::Addition) << "/"
+             << remoteChanges.count(ReplyParser::ContactInformation::Modification) << "/"
+             << remoteChanges.count(ReplyParser::ContactInformation::Deletion) << "/"
+             << remoteChanges.count(ReplyParser::ContactInformation::Unmodified)
              << "for addressbook:" << addressbookUrl;
 
-    if (contactUris.isEmpty()) {
-        // no additions or modifications to fetch.
-        qCDebug(lcCardDav) << Q_FUNC_INFO << "no further data to fetch";
-        calculateContactChanges(addressbookUrl, QList<QContact>(), QList<QContact>());
+    // fetch the full contact data for additions/modifications,
+    // a page at a time to keep each response bounded in size.
+    DownsyncedContacts downsynced;
+    QStringList changedUris = remoteChanges.uris(ReplyParser::ContactInformation::Addition);
+    for (const QString &uri : remoteChanges.uris(ReplyParser::ContactInformation::Modification)) {
+        // contacts which were also modified locally are never postponed,
+        // as their local modifications are upsynced with the etag of this sync.
+        const ReplyParser::LocalContactIndex::const_iterator local = localContacts.constFind(uri);
+        if (local != localContacts.constEnd()
+                && local->changeType == ReplyParser::LocalContactInformation::Modified) {
+            downsynced.pendingUris.append(uri);
+        } else {
+            changedUris.append(uri);
+        }
+    }
+    downsynced.requiredUris = downsynced.pendingUris.size();
+    const qint64 maxVCardSize = q->maxVCardSize();
+    if (maxVCardSize > 0 || maxBufferedVCardSize > 0) {
+        // very large vCards (usually due to embedded photos) are postponed
+        // until the device is on an unmetered connection.  A memory-bounded
+        // sync skips those which do not fit in its budget instead, as they
+        // would never be fetched, and the ctag and sync token of the
+        // addressbook could then never advance.
+        for (const QString &uri : changedUris) {
+            const qint64 size = contactSize(addressbookUrl, uri);
+            if (maxBufferedVCardSize > 0 && size > maxBufferedVCardSize) {
+                skippedUris.append(uri);
+            } else if (maxVCardSize > 0 && size > maxVCardSize) {
+                downsynced.postponed += 1;
+            } else {
+                downsynced.pendingUris.append(uri);
+            }
+        }
     } else {
-        // fetch the full contact data for additions/modifications.
-        qCDebug(lcCardDav) << Q_FUNC_INFO << "fetching vcard data for" << contactUris.size() << "contacts";
-        QNetworkReply *reply = m_request->contactMultiget(m_serverUrl, addressbookUrl, contactUris);
-        if (!reply) {
-            emit error();
+        downsynced.pendingUris.append(changedUris);
+    }
+    if (!skippedUris.isEmpty()) {
+        qCWarning(lcCardDav) << Q_FUNC_INFO << "skipping" << skippedUris.size()
+                             << "contacts which exceed the memory budget in addressbook" << addressbookUrl;
+    }
+    q->m_currentCollections[addressbookUrl].setExtendedMetaData(KEY_SKIPPEDCONTACTS, skippedUris);
+    qCDebug(lcCardDav) << Q_FUNC_INFO << "fetching vcard data for" << downsynced.pendingUris.size() << "contacts,"
+                       << "postponing" << downsynced.postponed << "large contacts";
+    m_downsyncedChanges.insert(addressbookUrl, downsynced);
+    fetchContactsPage(addressbookUrl);
+}
+
+void CardDav::fetchContactsPage(const QString &addressbookUrl)
+{
+    if (q->m_syncAborted) {
+        return;
+    }
+
+    DownsyncedContacts &downsynced(m_downsyncedChanges[addressbookUrl]);
+    if (downsynced.pendingUris.isEmpty()) {
+        if (downsynced.activePages > 0) {
+            // wait for the outstanding pages to be received and converted.
             return;
         }
+        // no further additions or modifications to fetch.
+        qCDebug(lcCardDav) << Q_FUNC_INFO << "no further data to fetch";
+        DownsyncedContacts complete = m_downsyncedChanges.take(addressbookUrl);
+        if (complete.postponed > 0) {
+            postponeRemainingChanges(addressbookUrl);
+        }
+        // the downsynced contacts are not referenced elsewhere, so hand
+        // over the modifications to have their ids set without copying.
+        calculateContactChanges(addressbookUrl, complete.additions, std::move(complete.modifications));
+        // the requests of this addressbook no longer hold back the prefetches.
+        startPrefetches();
+        return;
+    }
 
-        reply->setProperty("addressbookUrl", addressbookUrl);
-        connect(reply, SIGNAL(sslErrors(QList<QSslError>)), this, SLOT(sslErrorsOccurred(QList<QSslError>)));
-        connect(reply, SIGNAL(finished()), this, SLOT(contactsResponse()));
+    // keep several pages in flight, within the limit on concurrent requests
+    // which is shared with the listings being prefetched.  A memory-bounded
+    // sync holds only one page at a time.
+    const int maxActivePages = q->m_memoryBudget > 0
+            ? 1 : qMax(1, q->m_maxConcurrentListings - m_activePrefetches);
+    while (!downsynced.pendingUris.isEmpty() && downsynced.activePages < maxActivePages) {
+        if (!requestContactsPage(addressbookUrl)) {
+            return;
+        }
+    }
+
+    if (downsynced.pendingUris.isEmpty() && downsynced.activePages == 0) {
+        // the remaining contacts were postponed.
+        fetchContactsPage(addressbookUrl);
+    }
+}
+
+bool CardDav::requestContactsPage(const QString &addressbookUrl)
+{
+    DownsyncedContacts &downsynced(m_downsyncedChanges[addressbookUrl]);
+
+    // only request as many contacts as remain in the budget of this run.
+    int pageSize = qMin(qMin(MultigetPageSize, downsynced.pendingUris.size()), q->remainingRunBudget());
+    if (q->syncTier() == Syncer::MeteredSyncTier) {
+        // only request as many contacts as fit in the remaining byte budget.
+        // The pages in flight have already reserved their estimated size.
+        qint64 remaining = q->m_meteredByteBudget - q->m_downloadedBytes;
+        for (int i = 0; i < pageSize; ++i) {
+            remaining -= contactSize(addressbookUrl, downsynced.pendingUris.at(i));
+            if (remaining < 0) {
+                pageSize = i;
+                break;
+            }
+        }
+    }
+    if (q->maxBufferedBytes() > 0) {
+        // bound the size of the response, but request at least one contact.
+        qint64 remaining = q->maxBufferedBytes();
+        for (int i = 0; i < pageSize; ++i) {
+            remaining -= contactSize(addressbookUrl, downsynced.pendingUris.at(i));
+            if (remaining < 0) {
+                pageSize = qMax(1, i);
+                break;
+            }
+        }
+    }
+    // contacts which were also modified locally are fetched regardless of the budgets.
+    pageSize = qMax(pageSize, qMin(downsynced.requiredUris, MultigetPageSize));
+    if (pageSize == 0) {
+        qCDebug(lcCardDav) << Q_FUNC_INFO << "budget of this run exhausted, postponing"
+                           << downsynced.pendingUris.size() << "contacts in addressbook" << addressbookUrl;
+        downsynced.postponed += downsynced.pendingUris.size();
+        downsynced.pendingUris.clear();
+        return true;
+    }
+
+    const QStringList contactUris = downsynced.pendingUris.mid(0, pageSize);
+    downsynced.pendingUris.erase(downsynced.pendingUris.begin(),
+                                 downsynced.pendingUris.begin() + contactUris.size());
+    const int requiredUris = qMin(downsynced.requiredUris, contactUris.size());
+    downsynced.requiredUris -= requiredUris;
+
+    // we never upsync changes to read-only addressbooks, so we only need
+    // to retrieve the properties which we can store locally.
+    const bool partialAddressData = q->m_currentCollections.value(addressbookUrl).extendedMetaData(
+            COLLECTION_EXTENDEDMETADATA_KEY_READONLY).toBool()
+            && q->m_serverCapabilities.contains(CAPABILITY_PARTIALADDRESSDATA);
+    QNetworkReply *reply = m_request->contactMultiget(m_serverUrl, addressbookUrl, contactUris,
+            partialAddressData ? CardDavVCardConverter::supportedPropertyNames() : QStringList());
+    if (!reply) {
+        emit error();
+        return false;
+    }
+
+    // reserve the estimated size of the page, until its actual size is known.
+    qint64 reservedBytes = 0;
+    for (const QString &contactUri : contactUris) {
+        reservedBytes += contactSize(addressbookUrl, contactUri);
     }
+    q->m_downloadedBytes += reservedBytes;
+
+    downsynced.activePages += 1;
+    q->m_fetchedContacts += contactUris.size();
+    reply->setProperty("addressbookUrl", addressbookUrl);
+    reply->setProperty("reservedBytes", reservedBytes);
+    reply->setProperty("partialAddressData", partialAddressData);
+    reply->setProperty("contactUris", contactUris);
+    reply->setProperty("requiredUris", requiredUris);
+    reply->setProperty("contactCount", contactUris.size());
+    reply->setProperty("requestSent", QDateTime::currentMSecsSinceEpoch());
+    connect(reply, SIGNAL(sslErrors(QList<QSslError>)), this, SLOT(sslErrorsOccurred(QList<QSslError>)));
+    connect(reply, SIGNAL(finished()), this, SLOT(contactsResponse()));
+    return true;
 }
 
 void CardDav::contactsResponse()
@@ -948,73 +1907,214 @@ void CardDav::contactsResponse()
     const QString addressbookUrl = reply->property("addressbookUrl").toString();
     const QByteArray data = reply->readAll();
     if (reply->error() != QNetworkReply::NoError) {
+        if (retryRequest(reply, SLOT(contactsResponse()))) {
+            return;
+        }
+        q->m_downloadedBytes -= reply->property("reservedBytes").toLongLong();
         int httpError = reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
         qCWarning(lcCardDav) << Q_FUNC_INFO << "error:" << reply->error()
                    << "(" << httpError << ")";
-        debugDumpData(QString::fromUtf8(data));
-        errorOccurred(httpError);
+        debugDumpData(data);
+        if (reply->property("partialAddressData").toBool()
+                && (httpError == 400 || httpError == 403 || httpError == 415 || httpError == 501)
+                && m_downsyncedChanges.contains(addressbookUrl)) {
+            // the server rejects partial address-data, so request the full vCards instead.
+            q->removeServerCapability(CAPABILITY_PARTIALADDRESSDATA);
+            DownsyncedContacts &downsynced(m_downsyncedChanges[addressbookUrl]);
+            downsynced.pendingUris = reply->property("contactUris").toStringList() + downsynced.pendingUris;
+            downsynced.requiredUris += reply->property("requiredUris").toInt();
+            q->m_fetchedContacts -= reply->property("contactCount").toInt();
+            downsynced.activePages -= 1;
+            fetchContactsPage(addressbookUrl);
+            return;
+        }
+        if (m_downsyncedChanges.remove(addressbookUrl)) {
+            errorOccurred(httpError);
+        }
         return;
     }
 
-    QList<QContact> added;
-    QList<QContact> modified;
+    if (!m_downsyncedChanges.contains(addressbookUrl)) {
+        // another page of this addressbook failed, and the downsync was abandoned.
+        return;
+    }
+
+    q->m_downloadedBytes += data.size() - reply->property("reservedBytes").toLongLong();
+    q->recordSyncStage(Syncer::ReceiveStage, reply->property("contactCount").toInt(), data.size(),
+                       (QDateTime::currentMSecsSinceEpoch() - reply->property("requestSent").toLongLong()) * 1000000);
+
+    // request further pages before converting this one, so that they are
+    // received while this one is being converted.  This page only frees its
+    // slot once it has been converted, so a slow conversion throttles the
+    // requests.
+    DownsyncedContacts &downsynced(m_downsyncedChanges[addressbookUrl]);
+    if (!downsynced.pendingUris.isEmpty()) {
+        fetchContactsPage(addressbookUrl);
+    }
 
+    downsynced.bufferedBytes += data.size();
+    const RemoteContactChanges &remoteChanges(remoteContactChanges(addressbookUrl));
     const QHash<QString, QContact> addMods = m_parser->parseContactData(data, addressbookUrl);
     QHash<QString, QContact>::const_iterator it = addMods.constBegin(), end = addMods.constEnd();
     for ( ; it != end; ++it) {
         const QString contactUri = it.key();
-        if (q->m_remoteAdditions[addressbookUrl].contains(contactUri)) {
-            added.append(it.value());
-        } else if (q->m_remoteModifications[addressbookUrl].contains(contactUri)) {
-            modified.append(it.value());
+        const ReplyParser::ContactInformation::ModificationType modType = remoteChanges.modificationType(contactUri);
+        if (modType == ReplyParser::ContactInformation::Addition) {
+            downsynced.additions.append(it.value());
+        } else if (modType == ReplyParser::ContactInformation::Modification) {
+            downsynced.modifications.append(it.value());
         } else {
             qCWarning(lcCardDav) << Q_FUNC_INFO << "ignoring unknown addition/modification:" << contactUri;
         }
     }
 
-    calculateContactChanges(addressbookUrl, added, modified);
+    if ((q->m_storeBatchSize > 0 && downsynced.additions.size() >= q->m_storeBatchSize)
+            || (q->maxBufferedBytes() > 0 && downsynced.bufferedBytes >= q->maxBufferedBytes())) {
+        storeAdditionsBatch(addressbookUrl);
+    }
+
+    // request a further page in place of this one, or complete the downsync
+    // once the last page has been converted.
+    downsynced.activePages -= 1;
+    fetchContactsPage(addressbookUrl);
+}
+
+qint64 CardDav::contactSize(const QString &addressbookUrl, const QString &contactUri) const
+{
+    // servers need not report the size of each vCard in their listings,
+    // in which case a typical size is assumed for the budgets of the sync.
+    const qint64 size = remoteContactChanges(addressbookUrl).information(contactUri).size;
+    return size >= 0 ? size : EstimatedVCardSize;
 }
 
-void CardDav::calculateContactChanges(const QString &addressbookUrl, const QList<QContact> &added, const QList<QContact> &modified)
+void CardDav::storeAdditionsBatch(const QString &addressbookUrl)
 {
+    // store the remote additions converted so far, rather than holding all of
+    // them until the addressbook has been downsynced.  The additions appear
+    // locally as the sync progresses, and the remaining changes are handed
+    // to the adaptor once the downsync is complete.
+    DownsyncedContacts &downsynced(m_downsyncedChanges[addressbookUrl]);
+    if (!downsynced.storeInBatches) {
+        return;
+    }
+
+    QElapsedTimer storeTimer;
+    storeTimer.start();
+    if (!q->storeRemoteAdditions(addressbookUrl, &downsynced.additions)) {
+        qCDebug(lcCardDav) << Q_FUNC_INFO << "storing all changes to addressbook" << addressbookUrl << "at once";
+        downsynced.storeInBatches = false;
+        return;
+    }
+
+    qCDebug(lcCardDav) << Q_FUNC_INFO << "stored" << downsynced.additions.size()
+                       << "remote additions to addressbook" << addressbookUrl;
+    q->recordSyncStage(Syncer::StoreStage, downsynced.additions.size(), 0, storeTimer.nsecsElapsed());
+    downsynced.additions.clear();
+    downsynced.bufferedBytes = 0;
+}
+
+void CardDav::postponeRemainingChanges(const QString &addressbookUrl)
+{
+    // some changes were not fetched, so don't advance the ctag or sync token.
+    // the next sync will then detect (and fetch) the postponed changes again.
+    qCDebug(lcCardDav) << Q_FUNC_INFO << "not all remote changes were fetched for addressbook" << addressbookUrl
+                       << ", retaining the previous ctag and sync token";
+    q->m_completeListings.remove(addressbookUrl);
+    QFile::remove(SyncStateSnapshot::filePath(q->m_accountId, addressbookUrl));
+    const QPair<QString, QString> previous = q->m_previousCtagSyncToken.value(addressbookUrl);
+    QContactCollection &addressbook(q->m_currentCollections[addressbookUrl]);
+    addressbook.setExtendedMetaData(KEY_CTAG, previous.first);
+    addressbook.setExtendedMetaData(KEY_SYNCTOKEN, previous.second);
+}
+
+void CardDav::calculateContactChanges(const QString &addressbookUrl, const QList<QContact> &added, QList<QContact> modified)
+{
+    if (q->m_syncAborted) {
+        return;
+    }
+
     // at this point, we have already retrieved the added+modified contacts from the server.
     // we need to populate the removed contacts list, by inspecting the local data.
+    QElapsedTimer storeTimer;
+    storeTimer.start();
+    const QContactCollection &addressbook(q->m_currentCollections[addressbookUrl]);
+    const QPair<QString, QString> previous = q->m_previousCtagSyncToken.value(addressbookUrl);
+    const bool listed = listingType(addressbook.extendedMetaData(KEY_SYNCTOKEN).toString(),
+                                    addressbook.extendedMetaData(KEY_CTAG).toString(),
+                                    previous.second, previous.first) != NoListing;
+    const int remoteAdditions = remoteContactChanges(addressbookUrl).count(ReplyParser::ContactInformation::Addition);
     if (!q->m_collectionAMRU.contains(addressbookUrl)) {
         Q_ASSERT(modified.isEmpty());
+        if (listed) {
+            q->recordAddressbookDownsync(addressbookUrl, remoteAdditions);
+        }
         q->remoteContactsDetermined(q->m_currentCollections[addressbookUrl], added);
+        q->recordSyncStage(Syncer::StoreStage, added.size(), 0, storeTimer.nsecsElapsed());
     } else {
         QList<QContact> removed;
         const Syncer::AMRU amru = q->m_collectionAMRU.take(addressbookUrl);
-        auto appendMatches = [] (const QList<QContact> &contacts,
-                                 const QHash<QString, QHash<QString, ReplyParser::ContactInformation> > &hash,
-                                 QList<QContact> *list) {
-            for (const QContact &c : contacts) {
-                const QString uri = c.detail<QContactSyncTarget>().syncTarget();
-                if (!uri.isEmpty() && hash.contains(uri)) {
-                    list->append(c);
-                }
+        const ReplyParser::LocalContactIndex &localContacts(q->m_localContactIndex[addressbookUrl]);
+        const QStringList remoteRemovals = remoteContactChanges(addressbookUrl).uris(ReplyParser::ContactInformation::Deletion);
+        for (const QString &uri : remoteRemovals) {
+            const ReplyParser::LocalContactIndex::const_iterator local = localContacts.constFind(uri);
+            if (local != localContacts.constEnd()) {
+                removed.append(amru.contacts(local->changeType).at(local->position));
             }
-        };
-        appendMatches(amru.added, q->m_remoteRemovals, &removed);
-        appendMatches(amru.modified, q->m_remoteRemovals, &removed);
-        appendMatches(amru.removed, q->m_remoteRemovals, &removed);
-        appendMatches(amru.unmodified, q->m_remoteRemovals, &removed);
+        }
 
         // we also need to find the local ids associated with the modified contacts.
-        QList<QContact> modifiedWithIds = modified;
-        for (int i = 0; i < modifiedWithIds.size(); ++i) {
-            QContact &c(modifiedWithIds[i]);
-            QContactId matchingId = matchingContactFromList(c, amru.added);
-            if (matchingId.isNull()) matchingId = matchingContactFromList(c, amru.modified);
-            if (matchingId.isNull()) matchingId = matchingContactFromList(c, amru.removed);
-            if (matchingId.isNull()) matchingId = matchingContactFromList(c, amru.unmodified);
-            if (!matchingId.isNull()) {
-                c.setId(matchingId);
-            }
+        setLocalContactIds(&modified, localContacts);
+
+        if (listed) {
+            q->recordAddressbookDownsync(addressbookUrl, amru.added.size() + amru.modified.size()
+                                         + amru.unmodified.size() + remoteAdditions - removed.size());
         }
 
         // TODO: also match remotely added to locally added, to find partial upsync artifacts.
-        q->remoteContactChangesDetermined(q->m_currentCollections[addressbookUrl], added, modifiedWithIds, removed);
+        q->remoteContactChangesDetermined(q->m_currentCollections[addressbookUrl], added, modified, removed);
+        q->recordSyncStage(Syncer::StoreStage, added.size() + modified.size() + removed.size(), 0, storeTimer.nsecsElapsed());
+    }
+}
+
+void CardDav::setLocalContactIds(QList<QContact> *contacts, const ReplyParser::LocalContactIndex &localContacts)
+{
+    // the ids are set in place: contacts which are not shared
+    // with another list are modified without being copied.
+    for (QList<QContact>::iterator it = contacts->begin(); it != contacts->end(); ++it) {
+        const ReplyParser::LocalContactIndex::const_iterator local
+                = localContacts.constFind(it->detail<QContactSyncTarget>().syncTarget());
+        if (local != localContacts.constEnd() && !local->id.isNull()) {
+            it->setId(local->id);
+        }
+    }
+}
+
+void CardDav::localContactSyncState(const QString &addressbookUrl, const QContact &contact,
+                                    QString *etag, QStringList *unsupportedProperties) const
+{
+    // the index holds the state of the contact when the local changes were
+    // determined.  If the contact was changed remotely since, the adaptor
+    // has resolved the changes into the contact, whose details are then used.
+    const QString uri = contact.detail<QContactSyncTarget>().syncTarget();
+    const ReplyParser::LocalContactIndex localContacts = q->m_localContactIndex.value(addressbookUrl);
+    const ReplyParser::LocalContactIndex::const_iterator local = localContacts.constFind(uri);
+    const ReplyParser::ContactInformation::ModificationType modType = remoteContactChanges(addressbookUrl).modificationType(uri);
+    if (local != localContacts.constEnd()
+            && modType != ReplyParser::ContactInformation::Addition
+            && modType != ReplyParser::ContactInformation::Modification) {
+        *etag = local->etag;
+        if (unsupportedProperties) {
+            *unsupportedProperties = local->unsupportedProperties;
+        }
+        return;
+    }
+
+    for (const QContactExtendedDetail &ed : contact.details<QContactExtendedDetail>()) {
+        if (ed.name() == KEY_ETAG) {
+            *etag = ed.data().toString();
+        } else if (ed.name() == KEY_UNSUPPORTEDPROPERTIES && unsupportedProperties) {
+            *unsupportedProperties = ed.data().toStringList();
+        }
     }
 }
 
@@ -1039,10 +2139,33 @@ bool CardDav::upsyncUpdates(const QString &addressbookUrl, const QList<QContact>
         m_upsyncedChanges.insert(addressbookUrl, UpsyncedContacts());
     }
 
+    // the complete listing of the addressbook becomes its sync state snapshot,
+    // with the etags of the upsynced contacts updated as the server reports them.
+    // A contact whose new etag is not reported is recorded without an etag, so
+    // that the next sync does not consider the addressbook to be unchanged.
+    const bool completeListing = q->m_completeListings.contains(addressbookUrl);
+    QHash<QString, QString> snapshot;
+    if (completeListing) {
+        const RemoteContactChanges &remoteChanges(remoteContactChanges(addressbookUrl));
+        const QStringList uris = remoteChanges.uris(ReplyParser::ContactInformation::Addition)
+                               + remoteChanges.uris(ReplyParser::ContactInformation::Modification)
+                               + remoteChanges.uris(ReplyParser::ContactInformation::Unmodified);
+        snapshot.reserve(uris.size() + added.size());
+        for (const QString &uri : uris) {
+            snapshot.insert(uri, remoteChanges.information(uri).etag);
+        }
+    }
+
     // put local additions
     for (int i = 0; i < added.size(); ++i) {
         QContact c = added.at(i);
 
+        // a remote addition which an interrupted sync stored locally is still
+        // flagged as a local addition, but it already exists on the server.
+        if (!c.detail<QContactSyncTarget>().syncTarget().isEmpty()) {
+            continue;
+        }
+
         // generate a server-side uid.  this does NOT contain addressbook prefix etc.
         const QString uid = QUuid::createUuid().toString().replace(QRegularExpression(QStringLiteral("[\\-{}]")), QString());
         // set the uid so that the VCF UID is generated.
@@ -1055,10 +2178,7 @@ bool CardDav::upsyncUpdates(const QString &addressbookUrl, const QList<QContact>
         c.saveDetail(&st, QContact::IgnoreAccessConstraints);
 
         // ensure that we haven't already upsynced this one previously, i.e. partial upsync artifact
-        if (q->m_remoteAdditions[addressbookUrl].contains(uri)
-                || q->m_remoteModifications[addressbookUrl].contains(uri)
-                || q->m_remoteRemovals[addressbookUrl].contains(uri)
-                || q->m_remoteUnmodified[addressbookUrl].contains(uri)) {
+        if (remoteContactChanges(addressbookUrl).contains(uri)) {
             // this contact was previously upsynced already.
             continue;
         }
@@ -1079,8 +2199,12 @@ bool CardDav::upsyncUpdates(const QString &addressbookUrl, const QList<QContact>
         m_upsyncedChanges[addressbookUrl].additions.append(c);
         m_upsyncRequests[addressbookUrl] += 1;
         hadNonSpuriousChanges = true;
+        if (completeListing) {
+            snapshot.insert(uri, QString());
+        }
         reply->setProperty("addressbookUrl", addressbookUrl);
         reply->setProperty("contactGuid", guid);
+        reply->setProperty("contactUri", uri);
         connect(reply, SIGNAL(sslErrors(QList<QSslError>)), this, SLOT(sslErrorsOccurred(QList<QSslError>)));
         connect(reply, SIGNAL(finished()), this, SLOT(upsyncResponse()));
     }
@@ -1105,20 +2229,8 @@ bool CardDav::upsyncUpdates(const QString &addressbookUrl, const QList<QContact>
         }
 
         QString etag;
-        for (const QContactExtendedDetail &ed : c.details<QContactExtendedDetail>()) {
-            if (ed.name() == KEY_ETAG) {
-                etag = ed.data().toString();
-                break;
-            }
-        }
-
         QStringList unsupportedProperties;
-        for (const QContactExtendedDetail &ed : c.details<QContactExtendedDetail>()) {
-            if (ed.name() == KEY_UNSUPPORTEDPROPERTIES) {
-                unsupportedProperties = ed.data().toStringList();
-                break;
-            }
-        }
+        localContactSyncState(addressbookUrl, c, &etag, &unsupportedProperties);
 
         // convert to vcard and upsync to remote server.
         const QString uri = c.detail<QContactSyncTarget>().syncTarget();
@@ -1130,20 +2242,24 @@ bool CardDav::upsyncUpdates(const QString &addressbookUrl, const QList<QContact>
             return false;
         }
 
-        // cached the updated contact, as it will eventually be written back to the local database with updated guid + etag.
-        setContactGuid(&c, guidstr);
-        m_upsyncedChanges[addressbookUrl].modifications.append(c);
+        // cache the contact, as it will eventually be written back to the local database with updated etag.
+        // the guid of the copy was changed only for the export, so store the (shared) original instead.
+        m_upsyncedChanges[addressbookUrl].modifications.append(modified.at(i));
         m_upsyncRequests[addressbookUrl] += 1;
         hadNonSpuriousChanges = true;
+        if (completeListing) {
+            snapshot.insert(uri, QString());
+        }
         reply->setProperty("addressbookUrl", addressbookUrl);
         reply->setProperty("contactGuid", guidstr);
+        reply->setProperty("contactUri", uri);
         connect(reply, SIGNAL(sslErrors(QList<QSslError>)), this, SLOT(sslErrorsOccurred(QList<QSslError>)));
         connect(reply, SIGNAL(finished()), this, SLOT(upsyncResponse()));
     }
 
     // delete local removals
     for (int i = 0; i < removed.size(); ++i) {
-        QContact c = removed[i];
+        const QContact &c(removed.at(i));
         const QString guidstr = c.detail<QContactGuid>().guid();
         const QString uri = c.detail<QContactSyncTarget>().syncTarget();
         if (uri.isEmpty()) {
@@ -1151,12 +2267,7 @@ bool CardDav::upsyncUpdates(const QString &addressbookUrl, const QList<QContact>
             continue; // TODO: this is actually an error.
         }
         QString etag;
-        for (const QContactExtendedDetail &ed : c.details<QContactExtendedDetail>()) {
-            if (ed.name() == KEY_ETAG) {
-                etag = ed.data().toString();
-                break;
-            }
-        }
+        localContactSyncState(addressbookUrl, c, &etag, Q_NULLPTR);
         QNetworkReply *reply = m_request->upsyncDeletion(m_serverUrl, uri, etag);
         if (!reply) {
             return false;
@@ -1164,11 +2275,17 @@ bool CardDav::upsyncUpdates(const QString &addressbookUrl, const QList<QContact>
 
         m_upsyncRequests[addressbookUrl] += 1;
         hadNonSpuriousChanges = true;
+        snapshot.remove(uri);
         reply->setProperty("addressbookUrl", addressbookUrl);
+        reply->setProperty("contactUri", uri);
         connect(reply, SIGNAL(sslErrors(QList<QSslError>)), this, SLOT(sslErrorsOccurred(QList<QSslError>)));
         connect(reply, SIGNAL(finished()), this, SLOT(upsyncResponse()));
     }
 
+    if (completeListing) {
+        q->m_syncStateSnapshots.insert(addressbookUrl, snapshot);
+    }
+
     if (!hadNonSpuriousChanges || (added.size() == 0 && modified.size() == 0 && removed.size() == 0)) {
         // nothing to upsync.  Use a singleshot to avoid synchronously
         // decrementing the m_upsyncRequests count to zero if there
@@ -1178,10 +2295,7 @@ bool CardDav::upsyncUpdates(const QString &addressbookUrl, const QList<QContact>
     }
 
     // clear our caches of info for this addressbook, no longer required.
-    q->m_remoteAdditions.remove(addressbookUrl);
-    q->m_remoteModifications.remove(addressbookUrl);
-    q->m_remoteRemovals.remove(addressbookUrl);
-    q->m_remoteUnmodified.remove(addressbookUrl);
+    clearContactInformation(addressbookUrl);
 
     qCDebug(lcCardDav) << Q_FUNC_INFO << "ignored" << spuriousModifications << "spurious updates to addressbook:" << addressbookUrl;
     return true;
@@ -1191,14 +2305,23 @@ void CardDav::upsyncResponse()
 {
     QNetworkReply *reply = qobject_cast<QNetworkReply*>(sender());
     const QString addressbookUrl = reply->property("addressbookUrl").toString();
-    const QString guid = reply->property("contactGuid").toString();
     const QByteArray data = reply->readAll();
     if (reply->error() != QNetworkReply::NoError) {
+        if (retryRequest(reply, SLOT(upsyncResponse()))) {
+            return;
+        }
         int httpError = reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
         qCWarning(lcCardDav) << Q_FUNC_INFO << "error:" << reply->error()
                    << "(" << httpError << ")";
-        debugDumpData(QString::fromUtf8(data));
-        if (httpError == 405) {
+        debugDumpData(data);
+        if (RequestGenerator::isReplayedWriteConflict(reply)) {
+            // an earlier attempt may have been applied, with its response lost.
+            // Only report the change as upsynced once the server confirms it.
+            QNetworkReply *confirmation = m_request->confirmReplayedWrite(reply);
+            connect(confirmation, SIGNAL(sslErrors(QList<QSslError>)), this, SLOT(sslErrorsOccurred(QList<QSslError>)));
+            connect(confirmation, SIGNAL(finished()), this, SLOT(replayedUpsyncResponse()));
+            return;
+        } else if (httpError == 405) {
             // MethodNotAllowed error.  Most likely the server has restricted
             // new writes to the collection (e.g., read-only or update-only).
             // We should not abort the sync if we receive this error.
@@ -1210,6 +2333,38 @@ void CardDav::upsyncResponse()
         }
     }
 
+    storeUpsyncedEtag(reply);
+    upsyncComplete(addressbookUrl);
+}
+
+void CardDav::replayedUpsyncResponse()
+{
+    QNetworkReply *reply = qobject_cast<QNetworkReply*>(sender());
+    const QString addressbookUrl = reply->property("addressbookUrl").toString();
+    const QByteArray data = reply->readAll();
+    if (reply->error() != QNetworkReply::NoError && retryRequest(reply, SLOT(replayedUpsyncResponse()))) {
+        return;
+    }
+
+    if (!RequestGenerator::isConfirmedWrite(reply, data)) {
+        // the precondition failed due to a concurrent remote change.  Fail
+        // the sync, so that the local change remains pending.
+        qCWarning(lcCardDav) << Q_FUNC_INFO << "replayed upsync to" << reply->url().toString(QUrl::RemoveUserInfo)
+                             << "conflicts with a remote change";
+        errorOccurred(412);
+        return;
+    }
+
+    qCDebug(lcCardDav) << Q_FUNC_INFO << "replayed upsync to" << reply->url().toString(QUrl::RemoveUserInfo)
+                       << "was already applied by an earlier attempt";
+    storeUpsyncedEtag(reply);
+    upsyncComplete(addressbookUrl);
+}
+
+void CardDav::storeUpsyncedEtag(QNetworkReply *reply)
+{
+    const QString addressbookUrl = reply->property("addressbookUrl").toString();
+    const QString guid = reply->property("contactGuid").toString();
     if (!guid.isEmpty()) {
         // this is an addition or modification.
         // get the new etag value reported by the server.
@@ -1243,6 +2398,12 @@ void CardDav::upsyncResponse()
             };
             updateEtag(m_upsyncedChanges[addressbookUrl].additions);
             updateEtag(m_upsyncedChanges[addressbookUrl].modifications);
+
+            QHash<QString, QHash<QString, QString> >::iterator snapshot = q->m_syncStateSnapshots.find(addressbookUrl);
+            const QString uri = reply->property("contactUri").toString();
+            if (snapshot != q->m_syncStateSnapshots.end() && snapshot->contains(uri)) {
+                snapshot->insert(uri, etag);
+            }
         } else {
             // If we don't perform an additional request, the etag server-side will be different to the etag
             // we have locally, and thus on next sync we would spuriously detect a server-side modification.
@@ -1250,24 +2411,32 @@ void CardDav::upsyncResponse()
             qCWarning(lcCardDav) << "No updated etag provided for" << guid << ": will be reported as spurious remote modification next sync";
         }
     }
-
-    upsyncComplete(addressbookUrl);
 }
 
 void CardDav::upsyncComplete(const QString &addressbookUrl)
 {
+    if (q->m_syncAborted) {
+        return;
+    }
+
     m_upsyncRequests[addressbookUrl] -= 1;
     if (m_upsyncRequests[addressbookUrl] == 0) {
         // finished upsyncing all data for the addressbook.
         qCDebug(lcCardDav) << Q_FUNC_INFO << "upsync complete for addressbook: " << addressbookUrl;
         // TODO: perform another request to get the ctag/synctoken after updates have been upsynced?
+        // The adaptor stores the remote changes of the addressbook along with
+        // the upsynced changes, so this is where the local database is written.
+        // The stored items were counted when the changes were handed over.
+        QElapsedTimer storeTimer;
+        storeTimer.start();
         q->localChangesStoredRemotely(
                 q->m_currentCollections[addressbookUrl],
                 m_upsyncedChanges[addressbookUrl].additions,
                 m_upsyncedChanges[addressbookUrl].modifications);
+        q->recordSyncStage(Syncer::StoreStage, 0, 0, storeTimer.nsecsElapsed());
         m_upsyncedChanges.remove(addressbookUrl);
         q->m_previousCtagSyncToken.remove(addressbookUrl);
         q->m_currentCollections.remove(addressbookUrl);
-        q->m_localContactUrisEtags.remove(addressbookUrl);
+        q->m_localContactIndex.remove(addressbookUrl);
     }
 }
@@ -25,8 +25,10 @@
 
 #include "requestgenerator_p.h"
 #include "replyparser_p.h"
+#include "remotecontactchanges_p.h"
 
 #include <QObject>
+#include <QPointer>
 #include <QMultiMap>
 #include <QList>
 #include <QMap>
@@ -34,6 +36,8 @@
 #include <QSet>
 #include <QSslError>
 
+#include <functional>
+
 #include <QContact>
 #include <QContactCollection>
 #include <QVersitContactImporterPropertyHandlerV2>
@@ -61,6 +65,7 @@ public:
     ~CardDav();
 
     void determineAddressbooksList();
+    void abortRequests();
     bool downsyncAddressbookContent(
             const QString &addressbookUrl,
             const QString &newSyncToken,
@@ -71,6 +76,19 @@ public:
                        const QList<QContact> &added,
                        const QList<QContact> &modified,
                        const QList<QContact> &removed);
+    void prefetchContactListings(const QList<QContactCollection> &addressbooks);
+    void compareContactListings(const QStringList &addressbookUrls, const std::function<void (bool changed)> &handler);
+    void releasePrefetchedListings();
+
+    enum ListingType {
+        NoListing = 0,
+        MetadataListing,    // PROPFIND of the contact etags
+        FullDeltaListing,   // sync-collection report without a sync token
+        DeltaListing        // sync-collection report since the previous sync token
+    };
+    static ListingType listingType(const QString &newSyncToken, const QString &newCtag,
+                                   const QString &oldSyncToken, const QString &oldCtag);
+    static void setLocalContactIds(QList<QContact> *contacts, const ReplyParser::LocalContactIndex &localContacts);
 
 Q_SIGNALS:
     void error(int errorCode = 0);
@@ -81,44 +99,93 @@ Q_SIGNALS:
     void addressbooksList(const QList<ReplyParser::AddressBookInformation> &paths);
 
 private:
+    struct PrefetchedListing {
+        ListingType type = NoListing;
+        QString syncToken;      // the sync token which the delta was requested from
+        bool requested = false;
+        bool finished = false;
+        bool awaited = false;   // the adaptor is waiting for this listing
+        QByteArray data;
+    };
+
     void determineRemoteAMR();
     void fetchUserInformation();
+    void probeContextPath(const QString &contextUrl, int rank);
+    void discoveryErrorOccurred(int httpError);
+    void contextPathFailed(int rank, int httpError);
+    void contextPathFinished(int rank);
+    void useContextPath(const QString &contextUrl, const QByteArray &data);
+    void contextPathSucceeded(const QString &contextUrl);
     void fetchAddressbookUrls(const QString &userPath);
     void fetchAddressbooksInformation(const QString &addressbooksHomePath);
-    bool fetchImmediateDelta(const QString &addressbookUrl, const QString &syncToken);
+    void restartDiscovery();
+    void probeCapabilities(const QString &addressbookUrl);
+    void probeSupportedReports(const QString &addressbookUrl);
+    void probeSyncCollectionLimit(const QString &addressbookUrl);
+    void capabilitiesDetermined(const QStringList &capabilities, bool probed);
+    void startPrefetches();
+    qint64 prefetchedBytes() const;
+    int activeContactsPages() const;
+    void startListingComparisons();
+    bool adoptPrefetchedListing(const QString &addressbookUrl, ListingType type, const QString &syncToken);
+    void processListing(const QString &addressbookUrl, const PrefetchedListing &listing, const QByteArray &data);
+    bool fetchImmediateDelta(const QString &addressbookUrl, const QString &syncToken, bool fullListing);
+    void processImmediateDelta(const QString &addressbookUrl, const QString &syncToken, bool fullListing, const QByteArray &data);
     bool fetchContactMetadata(const QString &addressbookUrl);
-    void fetchContacts(const QString &addressbookUrl, const QList<ReplyParser::ContactInformation> &amrInfo);
+    void processContactMetadata(const QString &addressbookUrl, const QByteArray &data);
+    void storeContactInformation(const QString &addressbookUrl, const QList<ReplyParser::ContactInformation> &amrInfo);
+    void clearContactInformation(const QString &addressbookUrl);
+    const RemoteContactChanges &remoteContactChanges(const QString &addressbookUrl) const;
+    void fetchContacts(const QString &addressbookUrl);
+    void fetchContactsPage(const QString &addressbookUrl);
+    bool requestContactsPage(const QString &addressbookUrl);
+    qint64 contactSize(const QString &addressbookUrl, const QString &contactUri) const;
+    void postponeRemainingChanges(const QString &addressbookUrl);
+    void storeAdditionsBatch(const QString &addressbookUrl);
+    bool retryRequest(QNetworkReply *reply, const char *responseSlot);
+    void storeUpsyncedEtag(QNetworkReply *reply);
 
 private Q_SLOTS:
     void sslErrorsOccurred(const QList<QSslError> &errors);
     void userInformationResponse();
     void addressbookUrlsResponse();
     void addressbooksInformationResponse();
+    void optionsResponse();
+    void supportedReportSetResponse();
+    void syncCollectionLimitProgress(qint64 bytesReceived, qint64 bytesTotal);
+    void syncCollectionLimitResponse();
+    void prefetchResponse();
+    void listingComparisonResponse();
     void immediateDeltaResponse();
     void contactMetadataResponse();
     void contactsResponse();
     void upsyncResponse();
+    void replayedUpsyncResponse();
     void upsyncComplete(const QString &addressbookUrl);
     void errorOccurred(int httpError);
 
 private:
-    void calculateContactChanges(const QString &addressbookUrl, const QList<QContact> &added, const QList<QContact> &modified);
-
-    enum DiscoveryStage {
-        DiscoveryStarted = 0,
-        DiscoveryRedirected,
-        DiscoveryTryRoot
-    };
+    void calculateContactChanges(const QString &addressbookUrl, const QList<QContact> &added, QList<QContact> modified);
+    void localContactSyncState(const QString &addressbookUrl, const QContact &contact,
+                               QString *etag, QStringList *unsupportedProperties) const;
 
+    friend class tst_networkemulator;
     Syncer *q;
     CardDavVCardConverter *m_converter;
     RequestGenerator *m_request;
     ReplyParser *m_parser;
     QString m_serverUrl;
     QString m_addressbookPath;
-    DiscoveryStage m_discoveryStage;
     bool m_addressbooksListOnly;
     bool m_triedAddressbookPathAsHomeSetUrl;
+    bool m_usingDiscoveryCache;
+    bool m_discoveryComplete;
+    QMap<int, int> m_pendingDiscoveryProbes; // outstanding probes, by the rank of their context path
+    QMap<int, QPair<QString, QByteArray> > m_contextResponses; // valid answers awaiting better ranked probes
+    QList<QPointer<QNetworkReply> > m_discoveryProbes;
+    QObject *m_discoveryProbeContext;
+    int m_discoveryError;
+    QString m_principalPath;
 
     struct UpsyncedContacts {
         QList<QContact> additions;
@@ -126,6 +193,34 @@ private:
     };
     QHash<QString, UpsyncedContacts> m_upsyncedChanges;
     QHash<QString, int> m_upsyncRequests;
+
+    struct DownsyncedContacts {
+        QStringList pendingUris; // not yet requested from the server
+        QList<QContact> additions;
+        QList<QContact> modifications;
+        int requiredUris = 0; // leading pendingUris which are fetched regardless of the budgets
+        int postponed = 0; // not fetched during this sync, due to the metered sync tier or the run budget
+        int activePages = 0; // requested, but not yet received and converted
+        bool storeInBatches = true; // additions may be stored before the downsync completes
+        qint64 bufferedBytes = 0; // response bytes received since additions were last stored
+    };
+    QHash<QString, DownsyncedContacts> m_downsyncedChanges;
+
+    // contact listings requested ahead of the adaptor, see prefetchContactListings()
+    QHash<QString, PrefetchedListing> m_prefetchedListings;
+    QStringList m_queuedPrefetches;
+    int m_activePrefetches;
+
+    // listings compared against the sync state snapshots, see compareContactListings()
+    std::function<void (bool)> m_listingComparisonHandler;
+    QStringList m_queuedListingComparisons;
+    QSet<QString> m_unchangedListings; // addressbooks whose listing matched their sync state snapshot
+    int m_pendingListingComparisons;
+    bool m_listingsChanged;
+
+    // downsyncs which are waiting for the server capabilities to be probed
+    QList<std::function<bool ()> > m_pendingDownsyncs;
+    QStringList m_probedCapabilities;
 };
 
 class CardDavVCardConverter : public QVersitContactImporterPropertyHandlerV2,
@@ -148,14 +243,15 @@ public:
                          QList<QVersitProperty> *toBeRemoved, QList<QVersitProperty> *toBeAdded);
 
     // API exposed to clients
-    QPair<QContact, QStringList> convertVCardToContact(const QString &vcard, bool *ok);
+    QPair<QContact, QStringList> convertVCardToContact(const QString &vcard, bool *ok, bool captureUnsupportedProperties = true);
     QString convertContactToVCard(const QContact &c, const QStringList &unsupportedProperties);
+    static QStringList supportedPropertyNames();
 
 private:
-    static QStringList supportedPropertyNames();
     QString convertPropertyToString(const QVersitProperty &p) const;
     QMap<QString, QStringList> m_unsupportedProperties; // uid -> unsupported properties
     QStringList m_tempUnsupportedProperties;
+    bool m_captureUnsupportedProperties;
 };
 
 #endif // CARDDAV_P_H
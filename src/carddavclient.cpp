@@ -59,6 +59,10 @@ void CardDavClient::connectivityStateChanged(Sync::ConnectivityType aType, bool
     if (aType == Sync::CONNECTIVITY_INTERNET && !aState) {
         // we lost connectivity during sync.
         abortSync(Buteo::SyncResults::CONNECTION_ERROR);
+    } else if (aType == Sync::CONNECTIVITY_INTERNET && m_syncer) {
+        // the connection type may have changed, e.g. from cellular to WLAN.
+        // this affects any contact data which has yet to be requested.
+        m_syncer->updateSyncTier();
     }
 }
 
@@ -81,6 +85,8 @@ bool CardDavClient::init()
                 this, SLOT(syncSucceeded()));
         connect(m_syncer, SIGNAL(syncFailed()),
                 this, SLOT(syncFailed()));
+        connect(m_syncer, SIGNAL(contactsAggregated(int)),
+                this, SLOT(contactsAggregated(int)));
     }
 
     return true;
@@ -104,12 +110,19 @@ bool CardDavClient::startSync()
 
 void CardDavClient::syncSucceeded()
 {
-    syncFinished(Buteo::SyncResults::NO_ERROR, QString());
+    syncFinished(Buteo::SyncResults::NO_ERROR, m_syncer->requestTimeoutSummary());
 }
 
 void CardDavClient::syncFailed()
 {
-    syncFinished(Buteo::SyncResults::INTERNAL_ERROR, QString());
+    syncFinished(Buteo::SyncResults::INTERNAL_ERROR, m_syncer->requestTimeoutSummary());
+}
+
+void CardDavClient::contactsAggregated(int count)
+{
+    qCDebug(lcCardDav) << "aggregated" << count << "imported contacts";
+    emit transferProgress(getProfileName(), Sync::LOCAL_DATABASE, Sync::ITEM_MODIFIED,
+                          QStringLiteral("text/vcard"), count);
 }
 
 void CardDavClient::abortSync(Buteo::SyncResults::MinorCode code)
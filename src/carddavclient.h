@@ -55,6 +55,7 @@ public Q_SLOTS:
 private Q_SLOTS:
     void syncSucceeded();
     void syncFailed();
+    void contactsAggregated(int count);
 
 private:
     void abortSync(Buteo::SyncResults::MinorCode code);
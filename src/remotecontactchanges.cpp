@@ -0,0 +1,220 @@
+/*
+ * This file is part of buteo-sync-plugin-carddav package
+ *
+ * Copyright (C) 2026 Jolla Ltd.
+ *
+ * This program/library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 2.1 as published by the Free Software Foundation.
+ *
+ * This program/library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this program/library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+#include "remotecontactchanges_p.h"
+
+#include <QHash>
+
+#include <string.h>
+#include <limits.h>
+
+namespace {
+    const int MinimumCapacity = 16;
+
+    uint hashUri(const char *uri, int length, quint8 flags)
+    {
+        return qHashBits(uri, length, flags);
+    }
+}
+
+RemoteContactChanges::RemoteContactChanges(const QString &addressbookUrl)
+    : m_addressbookUrl(addressbookUrl)
+    , m_addressbookUrlUtf8(addressbookUrl.toUtf8())
+{
+    memset(m_counts, 0, sizeof(m_counts));
+}
+
+void RemoteContactChanges::insert(const ReplyParser::ContactInformation &info)
+{
+    if (info.modType == ReplyParser::ContactInformation::Uninitialized) {
+        return;
+    }
+
+    const QByteArray uri = info.uri.toUtf8();
+    const bool relative = isRelative(uri);
+    const QByteArray slug = relative ? uri.mid(m_addressbookUrlUtf8.size()) : uri;
+    const quint8 flags = relative ? RelativeUri : 0;
+    const QByteArray etag = info.etag.toUtf8();
+    const qint32 size = info.size > INT_MAX ? INT_MAX : static_cast<qint32>(info.size);
+
+    if ((m_entries.size() + 1) * 2 > m_index.size()) {
+        rehash(qMax(MinimumCapacity, m_index.size() * 2));
+    }
+
+    const int slot = findSlot(slug.constData(), slug.size(), flags);
+    if (m_index.at(slot) >= 0) {
+        // a later report for the same contact replaces the earlier one.
+        Entry &entry(m_entries[m_index.at(slot)]);
+        m_counts[entry.modType] -= 1;
+        if (etag.size() != static_cast<int>(entry.etagLength)
+                || memcmp(m_strings.constData() + entry.etagOffset, etag.constData(), etag.size()) != 0) {
+            entry.etagOffset = appendString(etag);
+            entry.etagLength = etag.size();
+        }
+        entry.size = size;
+        entry.modType = info.modType;
+        m_counts[entry.modType] += 1;
+        return;
+    }
+
+    Entry entry;
+    entry.uriOffset = appendString(slug);
+    entry.uriLength = slug.size();
+    entry.etagOffset = appendString(etag);
+    entry.etagLength = etag.size();
+    entry.size = size;
+    entry.modType = info.modType;
+    entry.flags = flags;
+    m_index[slot] = m_entries.size();
+    m_entries.append(entry);
+    m_counts[entry.modType] += 1;
+}
+
+void RemoteContactChanges::reserve(int size)
+{
+    m_entries.reserve(size);
+    int capacity = MinimumCapacity;
+    while (capacity < size * 2) {
+        capacity *= 2;
+    }
+    if (capacity > m_index.size()) {
+        rehash(capacity);
+    }
+}
+
+void RemoteContactChanges::clear()
+{
+    m_strings.clear();
+    m_entries.clear();
+    m_index.clear();
+    memset(m_counts, 0, sizeof(m_counts));
+}
+
+bool RemoteContactChanges::contains(const QString &uri) const
+{
+    return modificationType(uri) != ReplyParser::ContactInformation::Uninitialized;
+}
+
+ReplyParser::ContactInformation::ModificationType RemoteContactChanges::modificationType(const QString &uri) const
+{
+    const int position = find(uri);
+    return position >= 0
+         ? static_cast<ReplyParser::ContactInformation::ModificationType>(m_entries.at(position).modType)
+         : ReplyParser::ContactInformation::Uninitialized;
+}
+
+ReplyParser::ContactInformation RemoteContactChanges::information(const QString &uri) const
+{
+    ReplyParser::ContactInformation info;
+    const int position = find(uri);
+    if (position >= 0) {
+        const Entry &entry(m_entries.at(position));
+        info.modType = static_cast<ReplyParser::ContactInformation::ModificationType>(entry.modType);
+        info.uri = uri;
+        info.etag = QString::fromUtf8(m_strings.constData() + entry.etagOffset, entry.etagLength);
+        info.size = entry.size;
+    }
+    return info;
+}
+
+QStringList RemoteContactChanges::uris(ReplyParser::ContactInformation::ModificationType modType) const
+{
+    // returned in the order in which the contacts were first reported.
+    QStringList retn;
+    retn.reserve(count(modType));
+    for (const Entry &entry : m_entries) {
+        if (entry.modType == modType) {
+            retn.append(entryUri(entry));
+        }
+    }
+    return retn;
+}
+
+int RemoteContactChanges::count(ReplyParser::ContactInformation::ModificationType modType) const
+{
+    return m_counts[modType];
+}
+
+int RemoteContactChanges::find(const QString &uri) const
+{
+    if (m_entries.isEmpty()) {
+        return -1;
+    }
+
+    const QByteArray utf8 = uri.toUtf8();
+    const bool relative = isRelative(utf8);
+    const int offset = relative ? m_addressbookUrlUtf8.size() : 0;
+    return m_index.at(findSlot(utf8.constData() + offset, utf8.size() - offset, relative ? RelativeUri : 0));
+}
+
+bool RemoteContactChanges::isRelative(const QByteArray &uri) const
+{
+    return !m_addressbookUrlUtf8.isEmpty()
+        && uri.size() > m_addressbookUrlUtf8.size()
+        && uri.startsWith(m_addressbookUrlUtf8);
+}
+
+int RemoteContactChanges::findSlot(const char *uri, int length, quint8 flags) const
+{
+    // linear probing.  The index is never more than half full,
+    // so there is always an empty slot to terminate the search.
+    const int mask = m_index.size() - 1;
+    int slot = hashUri(uri, length, flags) & mask;
+    forever {
+        const int position = m_index.at(slot);
+        if (position < 0) {
+            return slot;
+        }
+        const Entry &entry(m_entries.at(position));
+        if (entry.flags == flags
+                && static_cast<int>(entry.uriLength) == length
+                && memcmp(m_strings.constData() + entry.uriOffset, uri, length) == 0) {
+            return slot;
+        }
+        slot = (slot + 1) & mask;
+    }
+}
+
+void RemoteContactChanges::rehash(int capacity)
+{
+    m_index.fill(-1, capacity);
+    const int mask = capacity - 1;
+    for (int i = 0; i < m_entries.size(); ++i) {
+        const Entry &entry(m_entries.at(i));
+        int slot = hashUri(m_strings.constData() + entry.uriOffset, entry.uriLength, entry.flags) & mask;
+        while (m_index.at(slot) >= 0) {
+            slot = (slot + 1) & mask;
+        }
+        m_index[slot] = i;
+    }
+}
+
+quint32 RemoteContactChanges::appendString(const QByteArray &value)
+{
+    const quint32 offset = m_strings.size();
+    m_strings.append(value);
+    return offset;
+}
+
+QString RemoteContactChanges::entryUri(const Entry &entry) const
+{
+    const QString uri = QString::fromUtf8(m_strings.constData() + entry.uriOffset, entry.uriLength);
+    return (entry.flags & RelativeUri) ? m_addressbookUrl + uri : uri;
+}
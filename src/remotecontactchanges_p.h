@@ -0,0 +1,90 @@
+/*
+ * This file is part of buteo-sync-plugin-carddav package
+ *
+ * Copyright (C) 2026 Jolla Ltd.
+ *
+ * This program/library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 2.1 as published by the Free Software Foundation.
+ *
+ * This program/library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this program/library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+#ifndef REMOTECONTACTCHANGES_P_H
+#define REMOTECONTACTCHANGES_P_H
+
+#include "replyparser_p.h"
+
+#include <QByteArray>
+#include <QString>
+#include <QStringList>
+#include <QVector>
+
+// The remote additions/modifications/removals/unmodified contacts
+// reported by the server for a single addressbook.
+//
+// Large addressbooks report tens of thousands of contacts, so rather
+// than storing a ContactInformation (i.e. a handful of heap-allocated
+// strings) per contact, the uri (relative to the addressbook url, where
+// possible) and etag of each contact are stored as UTF-8 in a single
+// string arena, and the remaining information is packed into a flat
+// vector of entries which is indexed by an open-addressing hash table.
+class RemoteContactChanges
+{
+public:
+    explicit RemoteContactChanges(const QString &addressbookUrl = QString());
+
+    // Records the information for a contact.  If the contact was already
+    // reported (e.g. by an earlier page of a paged listing) it is replaced.
+    void insert(const ReplyParser::ContactInformation &info);
+    void reserve(int size);
+    void clear();
+
+    bool contains(const QString &uri) const;
+    ReplyParser::ContactInformation::ModificationType modificationType(const QString &uri) const;
+    ReplyParser::ContactInformation information(const QString &uri) const;
+
+    QStringList uris(ReplyParser::ContactInformation::ModificationType modType) const;
+    int count(ReplyParser::ContactInformation::ModificationType modType) const;
+    int size() const { return m_entries.size(); }
+    bool isEmpty() const { return m_entries.isEmpty(); }
+
+private:
+    enum EntryFlag {
+        RelativeUri = 0x1
+    };
+
+    struct Entry {
+        quint32 uriOffset;
+        quint32 uriLength;
+        quint32 etagOffset;
+        quint32 etagLength;
+        qint32 size;        // -1 if unknown, clamped to INT_MAX
+        quint8 modType;
+        quint8 flags;
+    };
+
+    int find(const QString &uri) const;
+    bool isRelative(const QByteArray &uri) const;
+    int findSlot(const char *uri, int length, quint8 flags) const;
+    void rehash(int capacity);
+    quint32 appendString(const QByteArray &value);
+    QString entryUri(const Entry &entry) const;
+
+    QString m_addressbookUrl;
+    QByteArray m_addressbookUrlUtf8;
+    QByteArray m_strings;
+    QVector<Entry> m_entries;
+    QVector<qint32> m_index; // slot to entry position, or -1 if the slot is empty
+    int m_counts[ReplyParser::ContactInformation::Unmodified + 1];
+};
+
+#endif // REMOTECONTACTCHANGES_P_H
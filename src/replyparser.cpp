@@ -29,6 +29,7 @@
 #include <QString>
 #include <QList>
 #include <QXmlStreamReader>
+#include <QElapsedTimer>
 #include <QByteArray>
 #include <QRegularExpression>
 
@@ -36,6 +37,8 @@
 #include <QContactSyncTarget>
 #include <QContactExtendedDetail>
 
+#include <qtcontacts-extensions.h>
+
 namespace {
     void debugDumpData(const QString &data)
     {
@@ -59,6 +62,14 @@ namespace {
         }
     }
 
+    void debugDumpData(const QByteArray &data)
+    {
+        // avoid decoding the (possibly large) response unless it will be logged.
+        if (lcCardDavProtocol().isDebugEnabled()) {
+            debugDumpData(QString::fromUtf8(data));
+        }
+    }
+
     QVariantMap elementToVMap(QXmlStreamReader &reader)
     {
         QVariantMap element;
@@ -104,6 +115,24 @@ namespace {
         return element;
     }
 
+    QVariantMap successfulPropstat(const QVariantMap &response)
+    {
+        // a server which doesn't support some requested property reports it
+        // in a separate propstat (e.g. with 404 status), so prefer the 200 OK one.
+        const QVariant propstat = response.value(QStringLiteral("propstat"));
+        if (propstat.type() != QVariant::List) {
+            return propstat.toMap();
+        }
+        const QVariantList propstats = propstat.toList();
+        for (const QVariant &ps : propstats) {
+            const QVariantMap psmap = ps.toMap();
+            if (psmap.value(QStringLiteral("status")).toMap().value(QStringLiteral("@text")).toString().contains(QLatin1String("200"))) {
+                return psmap;
+            }
+        }
+        return propstats.isEmpty() ? QVariantMap() : propstats.first().toMap();
+    }
+
     QVariantMap xmlToVMap(QXmlStreamReader &reader)
     {
         QVariantMap retn;
@@ -114,6 +143,107 @@ namespace {
         }
         return retn;
     }
+
+    // The parts of a single <response> of a multistatus listing which
+    // are required to determine the remote state of a contact.
+    struct ListingResponse {
+        QString href;
+        QString status;         // the status of the response itself, if any
+        QString propstatStatus; // the status of the successful propstat, if any
+        QString etag;
+        qint64 size = -1;
+    };
+
+    // Reads a multistatus listing one <response> at a time.
+    // Listings of large addressbooks contain many thousands of responses,
+    // and converting the whole document into a tree of QVariantMaps (as
+    // xmlToVMap does) allocates a map and several strings per element,
+    // all of which are discarded immediately after parsing.
+    class ListingReader
+    {
+    public:
+        explicit ListingReader(const QByteArray &data) : m_reader(data), m_inMultistatus(false) {}
+
+        bool readNextResponse(ListingResponse *response)
+        {
+            while (!m_reader.atEnd() && !m_reader.hasError()) {
+                if (m_reader.readNext() != QXmlStreamReader::StartElement) {
+                    continue;
+                }
+                if (!m_inMultistatus) {
+                    m_inMultistatus = m_reader.name() == QLatin1String("multistatus");
+                } else if (m_reader.name() == QLatin1String("response")) {
+                    readResponse(response);
+                    return true;
+                } else if (m_reader.name() == QLatin1String("sync-token")) {
+                    m_syncToken = m_reader.readElementText(QXmlStreamReader::IncludeChildElements);
+                } else {
+                    m_reader.skipCurrentElement();
+                }
+            }
+            return false;
+        }
+
+        QString syncToken() const { return m_syncToken; }
+
+    private:
+        void readResponse(ListingResponse *response)
+        {
+            *response = ListingResponse();
+            bool haveSuccessfulPropstat = false;
+            bool havePropstat = false;
+            while (m_reader.readNextStartElement()) {
+                if (m_reader.name() == QLatin1String("href")) {
+                    response->href = m_reader.readElementText(QXmlStreamReader::IncludeChildElements);
+                } else if (m_reader.name() == QLatin1String("status")) {
+                    response->status = m_reader.readElementText(QXmlStreamReader::IncludeChildElements);
+                } else if (m_reader.name() == QLatin1String("propstat")) {
+                    // a server which doesn't support some requested property reports it
+                    // in a separate propstat (e.g. with 404 status), so prefer the 200 OK one.
+                    QString status, etag;
+                    qint64 size = -1;
+                    readPropstat(&status, &etag, &size);
+                    const bool successful = status.contains(QLatin1String("200"));
+                    if (!havePropstat || (successful && !haveSuccessfulPropstat)) {
+                        response->propstatStatus = status;
+                        response->etag = etag;
+                        response->size = size;
+                        havePropstat = true;
+                        haveSuccessfulPropstat = successful;
+                    }
+                } else {
+                    m_reader.skipCurrentElement();
+                }
+            }
+        }
+
+        void readPropstat(QString *status, QString *etag, qint64 *size)
+        {
+            while (m_reader.readNextStartElement()) {
+                if (m_reader.name() == QLatin1String("status")) {
+                    *status = m_reader.readElementText(QXmlStreamReader::IncludeChildElements);
+                } else if (m_reader.name() == QLatin1String("prop")) {
+                    while (m_reader.readNextStartElement()) {
+                        if (m_reader.name() == QLatin1String("getetag")) {
+                            *etag = m_reader.readElementText(QXmlStreamReader::IncludeChildElements);
+                        } else if (m_reader.name() == QLatin1String("getcontentlength")) {
+                            bool ok = false;
+                            const qint64 length = m_reader.readElementText(QXmlStreamReader::IncludeChildElements).trimmed().toLongLong(&ok);
+                            *size = ok && length >= 0 ? length : -1;
+                        } else {
+                            m_reader.skipCurrentElement();
+                        }
+                    }
+                } else {
+                    m_reader.skipCurrentElement();
+                }
+            }
+        }
+
+        QXmlStreamReader m_reader;
+        QString m_syncToken;
+        bool m_inMultistatus;
+    };
 }
 
 ReplyParser::ReplyParser(Syncer *parent, CardDavVCardConverter *converter)
@@ -125,7 +255,7 @@ ReplyParser::~ReplyParser()
 {
 }
 
-QString ReplyParser::parseUserPrincipal(const QByteArray &userInformationResponse, ReplyParser::ResponseType *responseType) const
+QString ReplyParser::parseUserPrincipal(const QByteArray &userInformationResponse, ReplyParser::ResponseType *responseType, QString *addressbooksHomePath) const
 {
     /* We expect a response of the form:
         HTTP/1.1 207 Multi-status
@@ -147,8 +277,12 @@ QString ReplyParser::parseUserPrincipal(const QByteArray &userInformationRespons
 
       Note however that some CardDAV servers return addressbook
       information instead of user principal information.
+
+      If the context path is the principal itself, the response may
+      also include the card:addressbook-home-set property, possibly
+      in a separate propstat from the current-user-principal property.
     */
-    debugDumpData(QString::fromUtf8(userInformationResponse));
+    debugDumpData(userInformationResponse);
     QXmlStreamReader reader(userInformationResponse);
     QVariantMap vmap = xmlToVMap(reader);
     QVariantMap multistatusMap = vmap[QLatin1String("multistatus")].toMap();
@@ -161,10 +295,17 @@ QString ReplyParser::parseUserPrincipal(const QByteArray &userInformationRespons
     // Only one response - this could be either a UserPrincipal response
     // or an AddressbookInformation response.
     QVariantMap response = multistatusMap[QLatin1String("response")].toMap();
-    QString statusText = response.value("propstat").toMap().value("status").toMap().value("@text").toString();
-    QString userPrincipal = response.value("propstat").toMap().value("prop").toMap()
+    const QVariantMap propstat = successfulPropstat(response);
+    QString statusText = propstat.value("status").toMap().value("@text").toString();
+    QString userPrincipal = propstat.value("prop").toMap()
             .value("current-user-principal").toMap().value("href").toMap().value("@text").toString();
-    QString ctag = response.value("propstat").toMap().value("prop").toMap().value("getctag").toMap().value("@text").toString();
+    QString ctag = propstat.value("prop").toMap().value("getctag").toMap().value("@text").toString();
+    if (addressbooksHomePath) {
+        const QVariant homeSetHref = propstat.value("prop").toMap().value("addressbook-home-set").toMap().value("href");
+        *addressbooksHomePath = homeSetHref.type() == QVariant::List
+                ? homeSetHref.toList().value(0).toMap().value("@text").toString()
+                : homeSetHref.toMap().value("@text").toString();
+    }
 
     if (!statusText.contains(QLatin1String("200 OK"))) {
         qCWarning(lcCardDav) << Q_FUNC_INFO << "invalid status response to current user information request:" << statusText;
@@ -199,7 +340,7 @@ QString ReplyParser::parseAddressbookHome(const QByteArray &addressbookUrlsRespo
             </d:response>
         </d:multistatus>
     */
-    debugDumpData(QString::fromUtf8(addressbookUrlsResponse));
+    debugDumpData(addressbookUrlsResponse);
     QXmlStreamReader reader(addressbookUrlsResponse);
     QString statusText;
     QString addressbookHome;
@@ -253,7 +394,7 @@ QList<ReplyParser::AddressBookInformation> ReplyParser::parseAddressbookInformat
             </d:response>
         </d:multistatus>
     */
-    debugDumpData(QString::fromUtf8(addressbookInformationResponse));
+    debugDumpData(addressbookInformationResponse);
     QXmlStreamReader reader(addressbookInformationResponse);
     QList<ReplyParser::AddressBookInformation> infos;
     QList<ReplyParser::AddressBookInformation> possibleAddressbookInfos;
@@ -461,7 +602,8 @@ QList<ReplyParser::AddressBookInformation> ReplyParser::parseAddressbookInformat
 QList<ReplyParser::ContactInformation> ReplyParser::parseSyncTokenDelta(
         const QByteArray &syncTokenDeltaResponse,
         const QString &addressbookUrl,
-        QString *newSyncToken) const
+        QString *newSyncToken,
+        bool *truncated) const
 {
     /* We expect a response of the form:
         <?xml version="1.0" encoding="utf-8" ?>
@@ -490,36 +632,34 @@ QList<ReplyParser::ContactInformation> ReplyParser::parseSyncTokenDelta(
             </d:response>
             <d:sync-token>http://sabredav.org/ns/sync/5001</d:sync-token>
          </d:multistatus>
-    */
-    debugDumpData(QString::fromUtf8(syncTokenDeltaResponse));
-    QList<ReplyParser::ContactInformation> info;
-    QXmlStreamReader reader(syncTokenDeltaResponse);
-    QVariantMap vmap = xmlToVMap(reader);
-    QVariantMap multistatusMap = vmap[QLatin1String("multistatus")].toMap();
-    if (newSyncToken) {
-        *newSyncToken = multistatusMap.value("sync-token").toMap().value("@text").toString();
-    }
 
-    QVariantList responses;
-    if (multistatusMap[QLatin1String("response")].type() == QVariant::List) {
-        // multiple updates in the delta.
-        responses = multistatusMap[QLatin1String("response")].toList();
-    } else {
-        // only one update in the delta.
-        QVariantMap response = multistatusMap[QLatin1String("response")].toMap();
-        responses << response;
+      If the request specified a limit, the server may truncate the
+      result set, in which case it includes a response for the
+      addressbook itself with a 507 Insufficient Storage status.
+      The returned sync-token then refers to the truncated result,
+      and can be used to fetch the remainder.
+    */
+    debugDumpData(syncTokenDeltaResponse);
+    if (truncated) {
+        *truncated = false;
     }
-
-    Q_FOREACH (const QVariant &rv, responses) {
-        QVariantMap rmap = rv.toMap();
+    QList<ReplyParser::ContactInformation> info;
+    const ReplyParser::LocalContactIndex &localContacts(q->m_localContactIndex[addressbookUrl]);
+    ListingReader reader(syncTokenDeltaResponse);
+    ListingResponse response;
+    while (reader.readNextResponse(&response)) {
         ReplyParser::ContactInformation currInfo;
-        currInfo.uri = QUrl::fromPercentEncoding(rmap.value("href").toMap().value("@text").toString().toUtf8());
-        currInfo.etag = rmap.value("propstat").toMap().value("prop").toMap().value("getetag").toMap().value("@text").toString();
-        QString status = rmap.value("status").toMap().value("@text").toString();
-        if (status.isEmpty()) {
-            status = rmap.value("propstat").toMap().value("status").toMap().value("@text").toString();
-        }
-        if (status.contains(QLatin1String("200 OK"))) {
+        currInfo.uri = QUrl::fromPercentEncoding(response.href.toUtf8());
+        currInfo.etag = response.etag;
+        currInfo.size = response.size;
+        const QString &status(response.status.isEmpty() ? response.propstatStatus : response.status);
+        if (status.contains(QLatin1String("507"))) {
+            qCDebug(lcCardDav) << Q_FUNC_INFO << "server truncated sync-collection response for:" << currInfo.uri;
+            if (truncated) {
+                *truncated = true;
+            }
+            continue;
+        } else if (status.contains(QLatin1String("200 OK"))) {
             if (currInfo.uri.endsWith(QChar('/'))) {
                 // this is probably a response for the addressbook resource,
                 // rather than for a contact resource within the addressbook.
@@ -534,7 +674,10 @@ QList<ReplyParser::ContactInformation> ReplyParser::parseSyncTokenDelta(
                 qCDebug(lcCardDav) << Q_FUNC_INFO << "ignoring non-contact resource:" << currInfo.uri << currInfo.etag << status;
                 continue;
             }
-            const QString oldEtag = q->m_localContactUrisEtags[addressbookUrl].value(currInfo.uri);
+            const ReplyParser::LocalContactIndex::const_iterator local = localContacts.constFind(currInfo.uri);
+            const QString oldEtag = local == localContacts.constEnd()
+                                  || (local->changeType == LocalContactInformation::Added && !local->knownRemotely())
+                                  ? QString() : local->etag;
             currInfo.modType = oldEtag.isEmpty() ? ReplyParser::ContactInformation::Addition
                              : (currInfo.etag != oldEtag) ? ReplyParser::ContactInformation::Modification
                              : ReplyParser::ContactInformation::Unmodified;
@@ -550,13 +693,18 @@ QList<ReplyParser::ContactInformation> ReplyParser::parseSyncTokenDelta(
         }
     }
 
+    if (newSyncToken) {
+        *newSyncToken = reader.syncToken();
+    }
+
     return info;
 }
 
 QList<ReplyParser::ContactInformation> ReplyParser::parseContactMetadata(
         const QByteArray &contactMetadataResponse,
         const QString &addressbookUrl,
-        const QHash<QString, QString> &contactUriToEtag) const
+        const LocalContactIndex &localContacts,
+        bool *truncated) const
 {
     /* We expect a response of the form:
         HTTP/1.1 207 Multi-status
@@ -582,34 +730,34 @@ QList<ReplyParser::ContactInformation> ReplyParser::parseContactMetadata(
                 </d:propstat>
             </d:response>
         </d:multistatus>
+
+      The server may truncate the response, in which case it includes
+      a response for the addressbook itself with a 507 Insufficient Storage
+      status.  We cannot infer deletions from a truncated listing.
     */
-    debugDumpData(QString::fromUtf8(contactMetadataResponse));
+    debugDumpData(contactMetadataResponse);
+    bool responseTruncated = false;
     QList<ReplyParser::ContactInformation> info;
-    QXmlStreamReader reader(contactMetadataResponse);
-    QVariantMap vmap = xmlToVMap(reader);
-    QVariantMap multistatusMap = vmap[QLatin1String("multistatus")].toMap();
-    QVariantList responses;
-    if (multistatusMap[QLatin1String("response")].type() == QVariant::List) {
-        // multiple updates in the delta.
-        responses = multistatusMap[QLatin1String("response")].toList();
-    } else {
-        // only one update in the delta.
-        QVariantMap response = multistatusMap[QLatin1String("response")].toMap();
-        responses << response;
-    }
+    // only contacts which still exist locally are compared.
+    auto knownLocally = [] (const LocalContactInformation &local) {
+        return local.knownRemotely();
+    };
 
     QSet<QString> seenUris;
-    Q_FOREACH (const QVariant &rv, responses) {
-        QVariantMap rmap = rv.toMap();
+    ListingReader reader(contactMetadataResponse);
+    ListingResponse response;
+    while (reader.readNextResponse(&response)) {
         ReplyParser::ContactInformation currInfo;
-        currInfo.uri = QUrl::fromPercentEncoding(rmap.value("href").toMap().value("@text").toString().toUtf8());
-        currInfo.etag = rmap.value("propstat").toMap().value("prop").toMap().value("getetag").toMap().value("@text").toString();
-        QString status = rmap.value("propstat").toMap().value("status").toMap().value("@text").toString();
-        if (status.isEmpty()) {
-            status = rmap.value("status").toMap().value("@text").toString();
-        }
-
-        if (currInfo.uri.endsWith(QChar('/'))) {
+        currInfo.uri = QUrl::fromPercentEncoding(response.href.toUtf8());
+        currInfo.etag = response.etag;
+        currInfo.size = response.size;
+        const QString &status(response.propstatStatus.isEmpty() ? response.status : response.propstatStatus);
+
+        if (status.contains(QLatin1String("507"))) {
+            qCWarning(lcCardDav) << Q_FUNC_INFO << "server truncated contact metadata response for:" << currInfo.uri;
+            responseTruncated = true;
+            continue;
+        } else if (currInfo.uri.endsWith(QChar('/'))) {
             // this is probably a response for the addressbook resource,
             // rather than for a contact resource within the addressbook.
             qCDebug(lcCardDav) << Q_FUNC_INFO << "ignoring non-contact (addressbook?) resource:" << currInfo.uri << currInfo.etag << status;
@@ -629,13 +777,14 @@ QList<ReplyParser::ContactInformation> ReplyParser::parseContactMetadata(
             // only append if it's an addition or an actual modification
             // the etag will have changed since the last time we saw it,
             // if the contact has been modified server-side since last sync.
-            if (!contactUriToEtag.contains(currInfo.uri)) {
+            const LocalContactIndex::const_iterator local = localContacts.constFind(currInfo.uri);
+            if (local == localContacts.constEnd() || !knownLocally(*local)) {
                 qCDebug(lcCardDavTrace) << "Resource" << currInfo.uri << "was added on server with etag" << currInfo.etag << "to addressbook:" << addressbookUrl;
                 currInfo.modType = ReplyParser::ContactInformation::Addition;
                 info.append(currInfo);
-            } else if (contactUriToEtag[currInfo.uri] != currInfo.etag) {
+            } else if (local->etag != currInfo.etag) {
                 qCDebug(lcCardDavTrace) << "Resource" << currInfo.uri << "was modified on server in addressbook:" << addressbookUrl;
-                qCDebug(lcCardDavTrace) << "Old etag:" << contactUriToEtag[currInfo.uri] << "New etag:" << currInfo.etag;
+                qCDebug(lcCardDavTrace) << "Old etag:" << local->etag << "New etag:" << currInfo.etag;
                 currInfo.modType = ReplyParser::ContactInformation::Modification;
                 info.append(currInfo);
             } else {
@@ -648,14 +797,25 @@ QList<ReplyParser::ContactInformation> ReplyParser::parseContactMetadata(
         }
     }
 
+    if (truncated) {
+        *truncated = responseTruncated;
+    }
+
+    if (responseTruncated) {
+        // some contacts may be missing from the listing, so
+        // we cannot tell which contacts were deleted on the server.
+        qCWarning(lcCardDav) << Q_FUNC_INFO << "not detecting remote deletions in truncated listing for addressbook:" << addressbookUrl;
+        return info;
+    }
+
     // we now need to determine deletions.
-    for (const QString &uri : contactUriToEtag.keys()) {
-        if (!seenUris.contains(uri)) {
+    for (LocalContactIndex::const_iterator it = localContacts.constBegin(); it != localContacts.constEnd(); ++it) {
+        if (knownLocally(it.value()) && !seenUris.contains(it.key())) {
             // this uri wasn't listed in the report, so this contact must have been deleted.
-            qCDebug(lcCardDavTrace) << "Resource" << uri << "was deleted on server in addressbook:" << addressbookUrl;
+            qCDebug(lcCardDavTrace) << "Resource" << it.key() << "was deleted on server in addressbook:" << addressbookUrl;
             ReplyParser::ContactInformation currInfo;
-            currInfo.etag = contactUriToEtag.value(uri);
-            currInfo.uri = uri;
+            currInfo.etag = it->etag;
+            currInfo.uri = it.key();
             currInfo.modType = ReplyParser::ContactInformation::Deletion;
             info.append(currInfo);
         }
@@ -703,16 +863,30 @@ QHash<QString, QContact> ReplyParser::parseContactData(const QByteArray &contact
             </d:response>
         </d:multistatus>
     */
-    debugDumpData(QString::fromUtf8(contactData));
+    debugDumpData(contactData);
+    QElapsedTimer stageTimer;
+    stageTimer.start();
     QXmlStreamReader reader(contactData);
     const QVariantMap vmap = xmlToVMap(reader);
     const QVariantMap multistatusMap = vmap[QLatin1String("multistatus")].toMap();
     const QVariantList responses = (multistatusMap[QLatin1String("response")].type() == QVariant::List)
                                  ? multistatusMap[QLatin1String("response")].toList()
                                  : (QVariantList() << multistatusMap[QLatin1String("response")].toMap());
+    q->recordSyncStage(Syncer::ParseStage, responses.size(), contactData.size(), stageTimer.nsecsElapsed());
+    stageTimer.restart();
+
+    // we never upsync changes to read-only addressbooks,
+    // so don't bother preserving unsupported properties.
+    const bool readOnly = q->m_currentCollections.value(addressbookUrl).extendedMetaData(
+            COLLECTION_EXTENDEDMETADATA_KEY_READONLY).toBool();
 
     QHash<QString, QContact> uriToContactData;
     for (const QVariant &rv : responses) {
+        if (q->m_syncAborted) {
+            // no point converting the rest of the vCards.
+            return QHash<QString, QContact>();
+        }
+
         const QVariantMap rmap = rv.toMap();
         const QString uri = QUrl::fromPercentEncoding(rmap.value("href").toMap().value("@text").toString().toUtf8());
         const QString etag = rmap.value("propstat").toMap().value("prop").toMap().value("getetag").toMap().value("@text").toString();
@@ -720,7 +894,7 @@ QHash<QString, QContact> ReplyParser::parseContactData(const QByteArray &contact
 
         // import the data as a vCard
         bool ok = true;
-        QPair<QContact, QStringList> result = m_converter->convertVCardToContact(vcard, &ok);
+        QPair<QContact, QStringList> result = m_converter->convertVCardToContact(vcard, &ok, !readOnly);
         if (!ok) {
             continue;
         }
@@ -759,21 +933,78 @@ QHash<QString, QContact> ReplyParser::parseContactData(const QByteArray &contact
         importedContact.saveDetail(&etagDetail, QContact::IgnoreAccessConstraints);
 
         // store unsupported properties into the contact.
-        QContactExtendedDetail unsupportedPropertiesDetail;
-        for (const QContactExtendedDetail &ed : importedContact.details<QContactExtendedDetail>()) {
-            if (ed.name() == KEY_UNSUPPORTEDPROPERTIES) {
-                unsupportedPropertiesDetail = ed;
-                break;
+        if (!readOnly) {
+            QContactExtendedDetail unsupportedPropertiesDetail;
+            for (const QContactExtendedDetail &ed : importedContact.details<QContactExtendedDetail>()) {
+                if (ed.name() == KEY_UNSUPPORTEDPROPERTIES) {
+                    unsupportedPropertiesDetail = ed;
+                    break;
+                }
             }
+            unsupportedPropertiesDetail.setName(KEY_UNSUPPORTEDPROPERTIES);
+            unsupportedPropertiesDetail.setData(result.second);
+            importedContact.saveDetail(&unsupportedPropertiesDetail, QContact::IgnoreAccessConstraints);
         }
-        unsupportedPropertiesDetail.setName(KEY_UNSUPPORTEDPROPERTIES);
-        unsupportedPropertiesDetail.setData(result.second);
-        importedContact.saveDetail(&unsupportedPropertiesDetail, QContact::IgnoreAccessConstraints);
 
         // and insert into the return map.
         uriToContactData.insert(uri, importedContact);
     }
 
+    q->recordSyncStage(Syncer::ConvertStage, uriToContactData.size(), 0, stageTimer.nsecsElapsed());
     return uriToContactData;
 }
 
+QStringList ReplyParser::parseSupportedReportSet(const QByteArray &supportedReportSetResponse) const
+{
+    /* We expect a response of the form:
+        HTTP/1.1 207 Multi-status
+        Content-Type: application/xml; charset=utf-8
+
+        <d:multistatus xmlns:d="DAV:" xmlns:card="urn:ietf:params:xml:ns:carddav">
+            <d:response>
+                <d:href>/addressbooks/johndoe/contacts/</d:href>
+                <d:propstat>
+                    <d:prop>
+                        <d:supported-report-set>
+                            <d:supported-report>
+                                <d:report><card:addressbook-multiget /></d:report>
+                            </d:supported-report>
+                            <d:supported-report>
+                                <d:report><d:sync-collection /></d:report>
+                            </d:supported-report>
+                        </d:supported-report-set>
+                    </d:prop>
+                    <d:status>HTTP/1.1 200 OK</d:status>
+                </d:propstat>
+            </d:response>
+        </d:multistatus>
+    */
+    debugDumpData(supportedReportSetResponse);
+    QXmlStreamReader reader(supportedReportSetResponse);
+    QStringList reports;
+    bool inReport = false;
+
+    while (!reader.atEnd() && !reader.hasError()) {
+        QXmlStreamReader::TokenType token = reader.readNext();
+        if (token == QXmlStreamReader::StartElement) {
+            if (reader.name() == QLatin1String("report")) {
+                inReport = true;
+            } else if (inReport) {
+                const QString report = reader.name().toString();
+                if (!reports.contains(report)) {
+                    reports.append(report);
+                }
+            }
+        } else if (token == QXmlStreamReader::EndElement) {
+            if (reader.name() == QLatin1String("report")) {
+                inReport = false;
+            }
+        }
+    }
+
+    if (reader.hasError()) {
+        qCWarning(lcCardDav) << Q_FUNC_INFO << "error parsing response to supported report set request:" << reader.errorString();
+    }
+
+    return reports;
+}
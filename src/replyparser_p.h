@@ -26,6 +26,8 @@
 #include <QObject>
 #include <QString>
 #include <QList>
+#include <QHash>
+#include <QStringList>
 #include <QByteArray>
 
 #include <QContact>
@@ -34,6 +36,16 @@ static const QString KEY_CTAG = QStringLiteral("ctag");
 static const QString KEY_SYNCTOKEN = QStringLiteral("syncToken");
 static const QString KEY_ETAG = QStringLiteral("etag");
 static const QString KEY_UNSUPPORTEDPROPERTIES = QStringLiteral("unsupportedProperties");
+static const QString KEY_DEFERREDAGGREGATION = QStringLiteral("deferredAggregation");
+static const QString KEY_CONTACTCOUNT = QStringLiteral("contactCount");
+static const QString KEY_LASTDOWNSYNC = QStringLiteral("lastDownsync");
+static const QString KEY_SKIPPEDCONTACTS = QStringLiteral("skippedContacts");
+
+// server capabilities, as determined by probing the server.
+static const QString CAPABILITY_SYNCCOLLECTION = QStringLiteral("sync-collection");
+static const QString CAPABILITY_SYNCCOLLECTIONLIMIT = QStringLiteral("sync-collection-limit");
+static const QString CAPABILITY_PARTIALADDRESSDATA = QStringLiteral("partial-address-data");
+static const QString CAPABILITY_RETURNMINIMAL = QStringLiteral("return-minimal");
 
 QTCONTACTS_USE_NAMESPACE
 
@@ -60,11 +72,37 @@ public:
             Deletion,
             Unmodified
         };
-        ContactInformation() : modType(Uninitialized) {}
+        ContactInformation() : modType(Uninitialized), size(-1) {}
         ModificationType modType;
         QString uri;
         QString etag;
+        qint64 size; // size of the vCard in bytes, or -1 if unknown
+    };
+
+    // a local contact, indexed by its sync target uri.
+    class LocalContactInformation {
+        public:
+        enum ChangeType {
+            Added = 0,
+            Modified,
+            Removed,
+            Unmodified
+        };
+        LocalContactInformation() : changeType(Unmodified), position(-1) {}
+        // whether the server held the contact as of the previous sync.  A local
+        // addition with an etag is a remote addition which was stored by a sync
+        // that was interrupted before it could clear the change flags.
+        bool knownRemotely() const {
+            return changeType == Modified || changeType == Unmodified
+                || (changeType == Added && !etag.isEmpty());
+        }
+        QContactId id;
+        QString etag;
+        QStringList unsupportedProperties; // vCard properties which are preserved on upsync
+        ChangeType changeType;
+        int position; // in the local change list of the changeType, for the full contact
     };
+    typedef QHash<QString, LocalContactInformation> LocalContactIndex;
 
     class FullContactInformation {
         public:
@@ -83,12 +121,13 @@ public:
     ReplyParser(Syncer *parent, CardDavVCardConverter *converter);
     ~ReplyParser();
 
-    QString parseUserPrincipal(const QByteArray &userInformationResponse, ResponseType *responseType) const;
+    QString parseUserPrincipal(const QByteArray &userInformationResponse, ResponseType *responseType, QString *addressbooksHomePath = 0) const;
     QString parseAddressbookHome(const QByteArray &addressbookUrlsResponse) const;
     QList<AddressBookInformation> parseAddressbookInformation(const QByteArray &addressbookInformationResponse, const QString &addressbooksHomePath) const;
-    QList<ContactInformation> parseSyncTokenDelta(const QByteArray &syncTokenDeltaResponse, const QString &addressbookUrl, QString *newSyncToken) const;
-    QList<ContactInformation> parseContactMetadata(const QByteArray &contactMetadataResponse, const QString &addressbookUrl, const QHash<QString, QString> &contactUriToEtag) const;
+    QList<ContactInformation> parseSyncTokenDelta(const QByteArray &syncTokenDeltaResponse, const QString &addressbookUrl, QString *newSyncToken, bool *truncated) const;
+    QList<ContactInformation> parseContactMetadata(const QByteArray &contactMetadataResponse, const QString &addressbookUrl, const LocalContactIndex &localContacts, bool *truncated) const;
     QHash<QString, QContact> parseContactData(const QByteArray &contactData, const QString &addressbookUrl) const;
+    QStringList parseSupportedReportSet(const QByteArray &supportedReportSetResponse) const;
 
 private:
     Syncer *q;
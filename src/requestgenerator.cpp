@@ -21,6 +21,7 @@
  */
 
 #include "requestgenerator_p.h"
+#include "replyparser_p.h"
 #include "syncer_p.h"
 
 #include "logging.h"
@@ -33,10 +34,54 @@
 #include <QStringList>
 #include <QBuffer>
 #include <QByteArray>
+#include <QDateTime>
+#include <QTimer>
+#if QT_VERSION >= QT_VERSION_CHECK(5, 10, 0)
+#include <QRandomGenerator>
+#endif
 
 #include <QtContacts/QContact>
 
+#include <SyncProfile.h>
+
 namespace {
+    // a transient failure is retried up to this many times,
+    // with exponentially increasing delay between attempts.
+    const int MaxRetryAttempts = 3;
+    const int InitialRetryDelay = 1000; // msecs
+    const int MaxRetryDelay = 30000;    // msecs
+
+    const char *RequestDataProperty = "requestData";
+    const char *RequestAttemptProperty = "requestAttempt";
+    const char *RequestTimedOutProperty = "requestTimedOut";
+    const char *RequestOutcomeUnknownProperty = "requestOutcomeUnknown";
+    const char *WrittenVerbProperty = "writtenVerb";
+    const char *WrittenDataProperty = "writtenData";
+
+    // the phase is stored in the request, so that it is preserved on retry.
+    const QNetworkRequest::Attribute RequestPhaseAttribute = QNetworkRequest::User;
+
+    // default timeouts, which may be overridden by the sync profile.
+    const int DefaultRequestDeadlines[RequestGenerator::RequestPhaseCount] = {
+        60000,  // discovery
+        180000, // metadata
+        300000, // multiget
+        60000   // upsync
+    };
+    const int DefaultInactivityTimeout = 60000; // msecs
+
+    int boundedRandom(int bound)
+    {
+        if (bound <= 0) {
+            return 0;
+        }
+#if QT_VERSION >= QT_VERSION_CHECK(5, 10, 0)
+        return QRandomGenerator::global()->bounded(bound);
+#else
+        return qrand() % bound;
+#endif
+    }
+
     QUrl setRequestUrl(const QString &url, const QString &path, const QString &username, const QString &password)
     {
         QUrl ret(url);
@@ -96,6 +141,39 @@ namespace {
         }
         return ret;
     }
+
+    bool needsXmlEscaping(const QString &str)
+    {
+        for (const QChar c : str) {
+            if (c == QLatin1Char('<') || c == QLatin1Char('>')
+                    || c == QLatin1Char('&') || c == QLatin1Char('"')) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void appendXmlEscaped(QByteArray &out, const QString &str)
+    {
+        out.append(needsXmlEscaping(str) ? str.toHtmlEscaped().toUtf8() : str.toUtf8());
+    }
+
+    // equivalent to QUrl::toPercentEncoding(), but appends directly to the output.
+    void appendPercentEncoded(QByteArray &out, const char *data, int length)
+    {
+        static const char hexDigits[] = "0123456789ABCDEF";
+        for (int i = 0; i < length; ++i) {
+            const uchar c = static_cast<uchar>(data[i]);
+            if ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9')
+                    || c == '-' || c == '.' || c == '_' || c == '~') {
+                out.append(static_cast<char>(c));
+            } else {
+                out.append('%');
+                out.append(hexDigits[c >> 4]);
+                out.append(hexDigits[c & 0xf]);
+            }
+        }
+    }
 }
 
 RequestGenerator::RequestGenerator(Syncer *parent,
@@ -104,32 +182,86 @@ RequestGenerator::RequestGenerator(Syncer *parent,
     : q(parent)
     , m_username(username)
     , m_password(password)
+    , m_inactivityTimeout(DefaultInactivityTimeout)
 {
+    loadTimeouts();
 }
 
 RequestGenerator::RequestGenerator(Syncer *parent,
                                    const QString &accessToken)
     : q(parent)
     , m_accessToken(accessToken)
+    , m_inactivityTimeout(DefaultInactivityTimeout)
 {
+    loadTimeouts();
 }
 
-QNetworkReply *RequestGenerator::generateRequest(const QString &url,
+void RequestGenerator::loadTimeouts()
+{
+    // the timeouts (in seconds) may be tuned per account via the sync profile.
+    for (int i = 0; i < RequestPhaseCount; ++i) {
+        m_requestDeadlines[i] = DefaultRequestDeadlines[i];
+    }
+    Buteo::SyncProfile *profile = q ? q->m_syncProfile : 0;
+    if (!profile) {
+        return;
+    }
+
+    for (int i = 0; i < RequestPhaseCount; ++i) {
+        const RequestPhase phase = static_cast<RequestPhase>(i);
+        const int seconds = profile->key(QStringLiteral("carddav_%1_timeout").arg(requestPhaseName(phase))).toInt();
+        if (seconds > 0) {
+            m_requestDeadlines[i] = seconds * 1000;
+        }
+    }
+    const int inactivitySeconds = profile->key(QStringLiteral("carddav_inactivity_timeout")).toInt();
+    if (inactivitySeconds > 0) {
+        m_inactivityTimeout = inactivitySeconds * 1000;
+    }
+}
+
+void RequestGenerator::setRequestDeadline(RequestPhase phase, int msecs)
+{
+    m_requestDeadlines[phase] = msecs;
+}
+
+void RequestGenerator::setInactivityTimeout(int msecs)
+{
+    m_inactivityTimeout = msecs;
+}
+
+QString RequestGenerator::requestPhaseName(RequestPhase phase)
+{
+    switch (phase) {
+    case DiscoveryPhase: return QStringLiteral("discovery");
+    case MetadataPhase:  return QStringLiteral("metadata");
+    case MultigetPhase:  return QStringLiteral("multiget");
+    case UpsyncPhase:    return QStringLiteral("upsync");
+    default:             return QString();
+    }
+}
+
+QNetworkReply *RequestGenerator::generateRequest(RequestPhase phase,
+                                                 const QString &url,
                                                  const QString &path,
                                                  const QString &depth,
                                                  const QString &requestType,
-                                                 const QString &request) const
+                                                 const QByteArray &requestData,
+                                                 bool preferMinimal) const
 {
     const QByteArray contentType("application/xml; charset=utf-8");
-    QByteArray requestData(request.toUtf8());
     QUrl reqUrl(setRequestUrl(url, path, m_username, m_password));
     QNetworkRequest req(setRequestData(reqUrl, requestData, depth, QString(), contentType, m_accessToken));
-    QBuffer *requestDataBuffer = new QBuffer(q);
-    requestDataBuffer->setData(requestData);
+    req.setAttribute(RequestPhaseAttribute, phase);
+    if (preferMinimal || (requestType == QLatin1String("PROPFIND")
+                          && q->m_serverCapabilities.contains(CAPABILITY_RETURNMINIMAL))) {
+        // ask the server to omit properties which were not found (RFC 8144 section 2.1)
+        req.setRawHeader("Prefer", "return=minimal");
+    }
     qCDebug(lcCardDav) << "generateRequest():"
             << m_accessToken << reqUrl << depth << requestType
             << QString::fromUtf8(requestData);
-    return q->m_qnam.sendCustomRequest(req, requestType.toLatin1(), requestDataBuffer);
+    return sendRequest(req, requestType, requestData);
 }
 
 QNetworkReply *RequestGenerator::generateUpsyncRequest(const QString &url,
@@ -137,24 +269,277 @@ QNetworkReply *RequestGenerator::generateUpsyncRequest(const QString &url,
                                                        const QString &ifMatch,
                                                        const QString &contentType,
                                                        const QString &requestType,
-                                                       const QString &request) const
+                                                       const QByteArray &requestData) const
 {
-    QByteArray requestData(request.toUtf8());
     QUrl reqUrl(setRequestUrl(url, path, m_username, m_password));
     QNetworkRequest req(setRequestData(reqUrl, requestData, QString(), ifMatch, contentType, m_accessToken));
+    req.setAttribute(RequestPhaseAttribute, UpsyncPhase);
 
     qCDebug(lcCardDav) << "generateUpsyncRequest():" << m_accessToken << reqUrl << requestType << ":" << requestData.length() << "bytes";
     Q_FOREACH (const QByteArray &headerName, req.rawHeaderList()) {
         qCDebug(lcCardDav) << "   " << headerName << "=" << req.rawHeader(headerName);
     }
 
-    if (!request.isEmpty()) {
-        QBuffer *requestDataBuffer = new QBuffer(q);
+    return sendRequest(req, requestType, requestData);
+}
+
+QNetworkReply *RequestGenerator::sendRequest(const QNetworkRequest &request,
+                                             const QString &requestType,
+                                             const QByteArray &requestData) const
+{
+    QNetworkReply *reply = 0;
+    if (requestData.isEmpty()) {
+        reply = q->m_qnam->sendCustomRequest(request, requestType.toLatin1());
+    } else {
+        // the request body must stay alive until the reply has finished,
+        // so let the reply own it.
+        QBuffer *requestDataBuffer = new QBuffer;
         requestDataBuffer->setData(requestData);
-        return q->m_qnam.sendCustomRequest(req, requestType.toLatin1(), requestDataBuffer);
+        reply = q->m_qnam->sendCustomRequest(request, requestType.toLatin1(), requestDataBuffer);
+        requestDataBuffer->setParent(reply);
+    }
+
+    // the response handlers process the reply synchronously in their
+    // finished() handler, so it (and its body) can be freed afterwards.
+    // Keep a (shallow) copy of the body in case the request must be resent.
+    reply->setProperty(RequestDataProperty, requestData);
+    QObject::connect(reply, SIGNAL(finished()), reply, SLOT(deleteLater()));
+
+    // abort the request if it takes too long overall, or if the server
+    // stops sending (or accepting) data for too long.  The response
+    // handler then sees a transient error, and may retry the request.
+    const RequestPhase phase = static_cast<RequestPhase>(request.attribute(RequestPhaseAttribute, DiscoveryPhase).toInt());
+    Syncer *syncer = q;
+    auto timeout = [syncer, reply, phase] (const char *reason) {
+        qCWarning(lcCardDav) << "request" << reply->url().toString(QUrl::RemoveUserInfo)
+                             << "timed out:" << reason << "in" << requestPhaseName(phase) << "phase";
+        syncer->m_requestTimeouts[phase] += 1;
+        reply->setProperty(RequestTimedOutProperty, true);
+        reply->abort();
+    };
+
+    QTimer *deadline = new QTimer(reply);
+    deadline->setSingleShot(true);
+    QObject::connect(deadline, &QTimer::timeout, reply, [timeout] () { timeout("deadline exceeded"); });
+    QObject::connect(reply, SIGNAL(finished()), deadline, SLOT(stop()));
+    deadline->start(m_requestDeadlines[phase]);
+
+    QTimer *watchdog = new QTimer(reply);
+    watchdog->setSingleShot(true);
+    QObject::connect(watchdog, &QTimer::timeout, reply, [timeout] () { timeout("no activity"); });
+    QObject::connect(reply, SIGNAL(downloadProgress(qint64,qint64)), watchdog, SLOT(start()));
+    QObject::connect(reply, SIGNAL(uploadProgress(qint64,qint64)), watchdog, SLOT(start()));
+    QObject::connect(reply, SIGNAL(finished()), watchdog, SLOT(stop()));
+    watchdog->start(m_inactivityTimeout);
+
+    return reply;
+}
+
+void RequestGenerator::abortRequests(QObject *receiver) const
+{
+    // every reply we create is a child of the network access manager.
+    // Once aborted, each reply will delete itself (and its request body).
+    const QList<QNetworkReply *> replies = q->m_qnam->findChildren<QNetworkReply *>();
+    for (QNetworkReply *reply : replies) {
+        if (!reply->isFinished()) {
+            QObject::disconnect(reply, 0, receiver, 0);
+            reply->abort();
+        }
+    }
+}
+
+bool RequestGenerator::isTransientError(QNetworkReply *reply)
+{
+    if (reply->property(RequestTimedOutProperty).toBool()) {
+        // the request was aborted by the deadline or inactivity watchdog.
+        return true;
     }
 
-    return q->m_qnam.sendCustomRequest(req, requestType.toLatin1());
+    switch (reply->error()) {
+    case QNetworkReply::RemoteHostClosedError:
+    case QNetworkReply::TimeoutError:
+    case QNetworkReply::TemporaryNetworkFailureError:
+    case QNetworkReply::NetworkSessionFailedError:
+    case QNetworkReply::ProxyTimeoutError:
+    case QNetworkReply::UnknownNetworkError:
+        return true;
+    default:
+        break;
+    }
+
+    const int httpStatus = reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+    return httpStatus == 408    // Request Timeout
+        || httpStatus == 429    // Too Many Requests
+        || httpStatus == 500    // Internal Server Error
+        || httpStatus == 502    // Bad Gateway
+        || httpStatus == 503    // Service Unavailable
+        || httpStatus == 504;   // Gateway Timeout
+}
+
+bool RequestGenerator::isIdempotentRequest(QNetworkReply *reply)
+{
+    const QNetworkRequest request = reply->request();
+    const QByteArray verb = request.attribute(QNetworkRequest::CustomVerbAttribute).toByteArray();
+    if (verb == "PROPFIND" || verb == "REPORT" || verb == "OPTIONS" || verb == "GET") {
+        return true;
+    }
+
+    // a conditional PUT or DELETE cannot be applied twice: if an earlier
+    // attempt was applied, the replayed request fails the precondition,
+    // see isReplayedWriteConflict().  An unconditional PUT (i.e. an addition)
+    // is not replayed, as we cannot tell whether the first attempt created
+    // the resource.
+    if (verb == "PUT" || verb == "DELETE") {
+        return request.hasRawHeader("If-Match");
+    }
+
+    return false;
+}
+
+bool RequestGenerator::isUnknownOutcome(QNetworkReply *reply)
+{
+    // without a response from the server (or with a gateway timeout), the
+    // request may or may not have been applied.  Any other response means
+    // that it was not.
+    if (reply->property(RequestTimedOutProperty).toBool()) {
+        return true;
+    }
+    const int httpStatus = reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+    return httpStatus == 0 || httpStatus == 504;
+}
+
+bool RequestGenerator::isReplayedWriteConflict(QNetworkReply *reply)
+{
+    // a replayed conditional write whose precondition fails may have been
+    // applied by an earlier attempt whose outcome is unknown.  It may equally
+    // conflict with a concurrent remote change, so it must be confirmed.
+    // If every earlier attempt was rejected, it is a genuine conflict.
+    const QNetworkRequest request = reply->request();
+    const QByteArray verb = request.attribute(QNetworkRequest::CustomVerbAttribute).toByteArray();
+    return reply->property(RequestAttemptProperty).toInt() > 0
+        && reply->property(RequestOutcomeUnknownProperty).toBool()
+        && (verb == "PUT" || verb == "DELETE")
+        && request.hasRawHeader("If-Match")
+        && reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt() == 412;
+}
+
+QNetworkReply *RequestGenerator::confirmReplayedWrite(QNetworkReply *reply) const
+{
+    const QNetworkRequest request = reply->request();
+    QNetworkRequest confirmation(request.url());
+    confirmation.setAttribute(RequestPhaseAttribute, UpsyncPhase);
+    if (request.hasRawHeader("Authorization")) {
+        confirmation.setRawHeader("Authorization", request.rawHeader("Authorization"));
+    }
+
+    qCDebug(lcCardDav) << Q_FUNC_INFO << "confirming replayed write to" << request.url().toString(QUrl::RemoveUserInfo);
+    QNetworkReply *retn = sendRequest(confirmation, QStringLiteral("GET"), QByteArray());
+
+    // the properties of the request itself are not inherited.
+    const QList<QByteArray> ownProperties {
+        RequestDataProperty, RequestAttemptProperty, RequestTimedOutProperty, RequestOutcomeUnknownProperty
+    };
+    for (const QByteArray &name : reply->dynamicPropertyNames()) {
+        if (!ownProperties.contains(name)) {
+            retn->setProperty(name.constData(), reply->property(name.constData()));
+        }
+    }
+    retn->setProperty(WrittenVerbProperty, request.attribute(QNetworkRequest::CustomVerbAttribute));
+    retn->setProperty(WrittenDataProperty, reply->property(RequestDataProperty));
+    return retn;
+}
+
+bool RequestGenerator::isConfirmedWrite(QNetworkReply *confirmation, const QByteArray &data)
+{
+    const QByteArray verb = confirmation->property(WrittenVerbProperty).toByteArray();
+    const int httpStatus = confirmation->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+    if (verb == "DELETE") {
+        return httpStatus == 404 || httpStatus == 410;
+    }
+    if (verb != "PUT" || confirmation->error() != QNetworkReply::NoError) {
+        return false;
+    }
+
+    // the resource must hold exactly what was written, up to line endings.
+    auto normalized = [] (QByteArray vcard) {
+        return vcard.replace("\r\n", "\n").trimmed();
+    };
+    return normalized(data) == normalized(confirmation->property(WrittenDataProperty).toByteArray());
+}
+
+int RequestGenerator::retryDelay(QNetworkReply *reply, int attempt)
+{
+    // honour any delay requested by the server (RFC 7231 section 7.1.3)
+    const int httpStatus = reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+    if ((httpStatus == 429 || httpStatus == 503) && reply->hasRawHeader("Retry-After")) {
+        const QByteArray retryAfter = reply->rawHeader("Retry-After").trimmed();
+        bool ok = false;
+        qint64 delay = retryAfter.toLongLong(&ok) * 1000;
+        if (!ok) {
+            const QDateTime retryTime = QDateTime::fromString(QString::fromLatin1(retryAfter), Qt::RFC2822Date);
+            if (retryTime.isValid()) {
+                delay = QDateTime::currentDateTimeUtc().msecsTo(retryTime);
+                ok = true;
+            }
+        }
+        if (ok) {
+            // if the server wants us to back off for longer than we are
+            // willing to wait, give up and let the sync be rescheduled.
+            return delay > MaxRetryDelay ? -1 : qMax(qint64(0), delay);
+        }
+    }
+
+    // exponential backoff, with jitter to avoid synchronised retries.
+    const int backoff = qMin(InitialRetryDelay << (attempt - 1), MaxRetryDelay);
+    return backoff / 2 + boundedRandom(backoff / 2);
+}
+
+bool RequestGenerator::retryRequest(QNetworkReply *reply,
+                                    QObject *context,
+                                    const std::function<void (QNetworkReply *)> &resent) const
+{
+    const int attempt = reply->property(RequestAttemptProperty).toInt() + 1;
+    if (attempt > MaxRetryAttempts || !isTransientError(reply) || !isIdempotentRequest(reply)) {
+        return false;
+    }
+
+    const int delay = retryDelay(reply, attempt);
+    if (delay < 0) {
+        return false;
+    }
+    const bool outcomeUnknown = reply->property(RequestOutcomeUnknownProperty).toBool() || isUnknownOutcome(reply);
+
+    // the failed reply will be deleted once its finished() handlers have run,
+    // so take copies of everything we need to resend the request.
+    const QNetworkRequest request = reply->request();
+    const QByteArray requestData = reply->property(RequestDataProperty).toByteArray();
+    QList<QPair<QByteArray, QVariant> > properties;
+    for (const QByteArray &name : reply->dynamicPropertyNames()) {
+        properties.append(qMakePair(name, reply->property(name.constData())));
+    }
+
+    qCDebug(lcCardDav) << Q_FUNC_INFO << "retrying request" << request.url().toString(QUrl::RemoveUserInfo)
+                       << "after error" << reply->error()
+                       << "(" << reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt() << ")"
+                       << "in" << delay << "ms, attempt" << attempt << "of" << MaxRetryAttempts;
+
+    QTimer::singleShot(delay, context, [this, request, requestData, properties, attempt, outcomeUnknown, resent] () {
+        if (q->m_syncAborted) {
+            // the sync was aborted while we were waiting to retry.
+            return;
+        }
+        const QString requestType = QString::fromLatin1(request.attribute(QNetworkRequest::CustomVerbAttribute).toByteArray());
+        QNetworkReply *retry = sendRequest(request, requestType, requestData);
+        for (const QPair<QByteArray, QVariant> &property : properties) {
+            retry->setProperty(property.first.constData(), property.second);
+        }
+        retry->setProperty(RequestAttemptProperty, attempt);
+        retry->setProperty(RequestTimedOutProperty, QVariant());
+        retry->setProperty(RequestOutcomeUnknownProperty, outcomeUnknown);
+        resent(retry);
+    });
+
+    return true;
 }
 
 QNetworkReply *RequestGenerator::currentUserInformation(const QString &serverUrl)
@@ -164,14 +549,16 @@ QNetworkReply *RequestGenerator::currentUserInformation(const QString &serverUrl
         return 0;
     }
 
-    QString requestStr = QStringLiteral(
-        "<d:propfind xmlns:d=\"DAV:\">"
+    // also request the home set, in case the context path is the principal.
+    const QByteArray requestData = QByteArrayLiteral(
+        "<d:propfind xmlns:d=\"DAV:\" xmlns:card=\"urn:ietf:params:xml:ns:carddav\">"
           "<d:prop>"
              "<d:current-user-principal />"
+             "<card:addressbook-home-set />"
           "</d:prop>"
         "</d:propfind>");
 
-    return generateRequest(serverUrl, QString(), QLatin1String("0"), QLatin1String("PROPFIND"), requestStr);
+    return generateRequest(DiscoveryPhase, serverUrl, QString(), QLatin1String("0"), QLatin1String("PROPFIND"), requestData);
 }
 
 QNetworkReply *RequestGenerator::addressbookUrls(const QString &serverUrl, const QString &userPath)
@@ -186,14 +573,14 @@ QNetworkReply *RequestGenerator::addressbookUrls(const QString &serverUrl, const
         return 0;
     }
 
-    QString requestStr = QStringLiteral(
+    const QByteArray requestData = QByteArrayLiteral(
         "<d:propfind xmlns:d=\"DAV:\" xmlns:card=\"urn:ietf:params:xml:ns:carddav\">"
           "<d:prop>"
              "<card:addressbook-home-set />"
           "</d:prop>"
         "</d:propfind>");
 
-    return generateRequest(serverUrl, userPath, QLatin1String("0"), QLatin1String("PROPFIND"), requestStr);
+    return generateRequest(DiscoveryPhase, serverUrl, userPath, QLatin1String("0"), QLatin1String("PROPFIND"), requestData);
 }
 
 QNetworkReply *RequestGenerator::addressbooksInformation(const QString &serverUrl, const QString &userAddressbooksPath)
@@ -208,7 +595,7 @@ QNetworkReply *RequestGenerator::addressbooksInformation(const QString &serverUr
         return 0;
     }
 
-    QString requestStr = QStringLiteral(
+    const QByteArray requestData = QByteArrayLiteral(
         "<d:propfind xmlns:d=\"DAV:\" xmlns:cs=\"http://calendarserver.org/ns/\">"
           "<d:prop>"
              "<d:resourcetype />"
@@ -219,7 +606,7 @@ QNetworkReply *RequestGenerator::addressbooksInformation(const QString &serverUr
           "</d:prop>"
         "</d:propfind>");
 
-    return generateRequest(serverUrl, userAddressbooksPath, QLatin1String("1"), QLatin1String("PROPFIND"), requestStr);
+    return generateRequest(DiscoveryPhase, serverUrl, userAddressbooksPath, QLatin1String("1"), QLatin1String("PROPFIND"), requestData);
 }
 
 QNetworkReply *RequestGenerator::addressbookInformation(const QString &serverUrl, const QString &addressbookPath)
@@ -234,7 +621,7 @@ QNetworkReply *RequestGenerator::addressbookInformation(const QString &serverUrl
         return 0;
     }
 
-    QString requestStr = QStringLiteral(
+    const QByteArray requestData = QByteArrayLiteral(
         "<d:propfind xmlns:d=\"DAV:\" xmlns:cs=\"http://calendarserver.org/ns/\">"
           "<d:prop>"
              "<d:resourcetype />"
@@ -244,15 +631,13 @@ QNetworkReply *RequestGenerator::addressbookInformation(const QString &serverUrl
           "</d:prop>"
         "</d:propfind>");
 
-    return generateRequest(serverUrl, addressbookPath, QLatin1String("0"), QLatin1String("PROPFIND"), requestStr);
+    return generateRequest(MetadataPhase, serverUrl, addressbookPath, QLatin1String("0"), QLatin1String("PROPFIND"), requestData);
 }
 
-QNetworkReply *RequestGenerator::syncTokenDelta(const QString &serverUrl, const QString &addressbookUrl, const QString &syncToken)
+QNetworkReply *RequestGenerator::syncTokenDelta(const QString &serverUrl, const QString &addressbookUrl, const QString &syncToken, int limit)
 {
-    if (Q_UNLIKELY(syncToken.isEmpty())) {
-        qCWarning(lcCardDav) << Q_FUNC_INFO << "sync token empty, aborting";
-        return 0;
-    }
+    // note: the sync token may be empty, in which case the server will
+    // report every member of the addressbook (RFC 6578 section 3.8).
 
     if (Q_UNLIKELY(addressbookUrl.isEmpty())) {
         qCWarning(lcCardDav) << Q_FUNC_INFO << "addressbook url empty, aborting";
@@ -264,17 +649,8 @@ QNetworkReply *RequestGenerator::syncTokenDelta(const QString &serverUrl, const
         return 0;
     }
 
-    QString requestStr = QStringLiteral(
-        "<?xml version=\"1.0\" encoding=\"utf-8\" ?>"
-        "<d:sync-collection xmlns:d=\"DAV:\">"
-          "<d:sync-token>%1</d:sync-token>"
-          "<d:sync-level>1</d:sync-level>"
-          "<d:prop>"
-            "<d:getetag/>"
-          "</d:prop>"
-        "</d:sync-collection>").arg(syncToken.toHtmlEscaped());
-
-    return generateRequest(serverUrl, addressbookUrl, QString(), QLatin1String("REPORT"), requestStr);
+    return generateRequest(MetadataPhase, serverUrl, addressbookUrl, QString(), QLatin1String("REPORT"),
+                           syncTokenDeltaRequestBody(syncToken, limit));
 }
 
 QNetworkReply *RequestGenerator::contactEtags(const QString &serverUrl, const QString &addressbookPath)
@@ -289,17 +665,18 @@ QNetworkReply *RequestGenerator::contactEtags(const QString &serverUrl, const QS
         return 0;
     }
 
-    QString requestStr = QStringLiteral(
+    const QByteArray requestData = QByteArrayLiteral(
         "<d:propfind xmlns:d=\"DAV:\">"
           "<d:prop>"
              "<d:getetag />"
+             "<d:getcontentlength />"
           "</d:prop>"
         "</d:propfind>");
 
-    return generateRequest(serverUrl, addressbookPath, QLatin1String("1"), QLatin1String("PROPFIND"), requestStr);
+    return generateRequest(MetadataPhase, serverUrl, addressbookPath, QLatin1String("1"), QLatin1String("PROPFIND"), requestData);
 }
 
-QNetworkReply *RequestGenerator::contactData(const QString &serverUrl, const QString &addressbookPath, const QStringList &contactEtags)
+QNetworkReply *RequestGenerator::contactData(const QString &serverUrl, const QString &addressbookPath, const QStringList &contactEtags, int limit)
 {
     if (Q_UNLIKELY(contactEtags.isEmpty())) {
         qCWarning(lcCardDav) << Q_FUNC_INFO << "etag list empty, aborting";
@@ -316,22 +693,12 @@ QNetworkReply *RequestGenerator::contactData(const QString &serverUrl, const QSt
         return 0;
     }
 
-    // Note: this may not work with all cardDav servers, since according to the RFC:
-    // "The filter component is not optional, but required."  Thus, may need to use the
-    // PROPFIND query to get etags, then perform a filter with those etags.
     Q_UNUSED(contactEtags); // TODO
-    QString requestStr = QStringLiteral(
-        "<card:addressbook-query xmlns:d=\"DAV:\" xmlns:card=\"urn:ietf:params:xml:ns:carddav\">"
-            "<d:prop>"
-                "<d:getetag />"
-                "<card:address-data />"
-            "</d:prop>"
-        "</card:addressbook-query>");
-
-    return generateRequest(serverUrl, addressbookPath, QLatin1String("1"), QLatin1String("REPORT"), requestStr);
+    return generateRequest(MultigetPhase, serverUrl, addressbookPath, QLatin1String("1"), QLatin1String("REPORT"),
+                           contactDataRequestBody(limit));
 }
 
-QNetworkReply *RequestGenerator::contactMultiget(const QString &serverUrl, const QString &addressbookPath, const QStringList &contactUris)
+QNetworkReply *RequestGenerator::contactMultiget(const QString &serverUrl, const QString &addressbookPath, const QStringList &contactUris, const QStringList &properties)
 {
     if (Q_UNLIKELY(contactUris.isEmpty())) {
         qCWarning(lcCardDav) << Q_FUNC_INFO << "etag list empty, aborting";
@@ -348,36 +715,8 @@ QNetworkReply *RequestGenerator::contactMultiget(const QString &serverUrl, const
         return 0;
     }
 
-    QString uriHrefs;
-    Q_FOREACH (const QString &uri, contactUris) {
-        // note: uriHref is of form: <d:href>/addressbooks/johndoe/contacts/acme-12345.vcf</d:href> etc.
-        QString href = uri.toHtmlEscaped();
-        int lastPathMarker = href.lastIndexOf('/');
-        if (lastPathMarker > 0) {
-            // percent-encode the filename
-            QString vcfName = QUrl::toPercentEncoding(href.mid(lastPathMarker + 1));
-            href = href.mid(0, lastPathMarker+1) + vcfName;
-        }
-        if (uri.endsWith(QStringLiteral(".vcf")) && uri.startsWith(addressbookPath)) {
-            uriHrefs.append(QStringLiteral("<d:href>%1</d:href>").arg(href));
-        } else if (uri.startsWith(addressbookPath)) {
-            // contact resource which doesn't end in .vcf but is otherwise well-formed / fully specified.
-            uriHrefs.append(QStringLiteral("<d:href>%1</d:href>").arg(href));
-        } else {
-            uriHrefs.append(QStringLiteral("<d:href>%1/%2.vcf</d:href>").arg(addressbookPath).arg(href));
-        }
-    }
-
-    QString requestStr = QStringLiteral(
-        "<card:addressbook-multiget xmlns:d=\"DAV:\" xmlns:card=\"urn:ietf:params:xml:ns:carddav\">"
-            "<d:prop>"
-                "<d:getetag />"
-                "<card:address-data />"
-            "</d:prop>"
-            "%1"
-        "</card:addressbook-multiget>").arg(uriHrefs);
-
-    return generateRequest(serverUrl, addressbookPath, QLatin1String("1"), QLatin1String("REPORT"), requestStr);
+    return generateRequest(MultigetPhase, serverUrl, addressbookPath, QLatin1String("1"), QLatin1String("REPORT"),
+                           contactMultigetRequestBody(addressbookPath, contactUris, properties));
 }
 
 QNetworkReply *RequestGenerator::upsyncAddMod(const QString &serverUrl, const QString &contactPath, const QString &etag, const QString &vcard)
@@ -401,7 +740,7 @@ QNetworkReply *RequestGenerator::upsyncAddMod(const QString &serverUrl, const QS
 
     return generateUpsyncRequest(serverUrl, contactPath, etag,
                                  QStringLiteral("text/vcard; charset=utf-8"),
-                                 QStringLiteral("PUT"), vcard);
+                                 QStringLiteral("PUT"), vcard.toUtf8());
 }
 
 QNetworkReply *RequestGenerator::upsyncDeletion(const QString &serverUrl, const QString &contactPath, const QString &etag)
@@ -422,5 +761,166 @@ QNetworkReply *RequestGenerator::upsyncDeletion(const QString &serverUrl, const
     }
 
     return generateUpsyncRequest(serverUrl, contactPath, etag, QString(),
-                                 QStringLiteral("DELETE"), QString());
+                                 QStringLiteral("DELETE"), QByteArray());
+}
+
+QNetworkReply *RequestGenerator::serverOptions(const QString &serverUrl, const QString &path)
+{
+    if (Q_UNLIKELY(serverUrl.isEmpty())) {
+        qCWarning(lcCardDav) << Q_FUNC_INFO << "server url empty, aborting";
+        return 0;
+    }
+
+    return generateRequest(DiscoveryPhase, serverUrl, path, QString(), QLatin1String("OPTIONS"), QByteArray());
+}
+
+QNetworkReply *RequestGenerator::supportedReportSet(const QString &serverUrl, const QString &addressbookPath)
+{
+    if (Q_UNLIKELY(addressbookPath.isEmpty())) {
+        qCWarning(lcCardDav) << Q_FUNC_INFO << "addressbook path empty, aborting";
+        return 0;
+    }
+
+    if (Q_UNLIKELY(serverUrl.isEmpty())) {
+        qCWarning(lcCardDav) << Q_FUNC_INFO << "server url empty, aborting";
+        return 0;
+    }
+
+    const QByteArray requestData = QByteArrayLiteral(
+        "<d:propfind xmlns:d=\"DAV:\">"
+          "<d:prop>"
+             "<d:supported-report-set />"
+          "</d:prop>"
+        "</d:propfind>");
+
+    // the response tells us whether the server honours the Prefer header.
+    return generateRequest(DiscoveryPhase, serverUrl, addressbookPath, QLatin1String("0"), QLatin1String("PROPFIND"), requestData, true);
+}
+
+QByteArray RequestGenerator::syncTokenDeltaRequestBody(const QString &syncToken, int limit)
+{
+    static const char header[] =
+        "<?xml version=\"1.0\" encoding=\"utf-8\" ?>"
+        "<d:sync-collection xmlns:d=\"DAV:\">"
+          "<d:sync-token>";
+    static const char syncLevel[] =
+          "</d:sync-token>"
+          "<d:sync-level>1</d:sync-level>";
+    static const char footer[] =
+          "<d:prop>"
+            "<d:getetag/>"
+            "<d:getcontentlength/>"
+          "</d:prop>"
+        "</d:sync-collection>";
+
+    QByteArray body;
+    body.reserve(int(sizeof(header) + sizeof(syncLevel) + sizeof(footer)) + syncToken.size() + 64);
+    body.append(header, sizeof(header) - 1);
+    appendXmlEscaped(body, syncToken);
+    body.append(syncLevel, sizeof(syncLevel) - 1);
+    if (limit > 0) {
+        // the server may truncate the result set.  It then reports a 507
+        // status for the addressbook itself, and the returned sync token
+        // can be used to fetch the next page.
+        body.append(QByteArrayLiteral("<d:limit><d:nresults>"));
+        body.append(QByteArray::number(limit));
+        body.append(QByteArrayLiteral("</d:nresults></d:limit>"));
+    }
+    body.append(footer, sizeof(footer) - 1);
+    return body;
+}
+
+QByteArray RequestGenerator::contactDataRequestBody(int limit)
+{
+    // Note: this may not work with all cardDav servers, since according to the RFC:
+    // "The filter component is not optional, but required."  Thus, may need to use the
+    // PROPFIND query to get etags, then perform a filter with those etags.
+    // An empty filter matches every contact in the addressbook.
+    // If a limit is given, the server may truncate the result set,
+    // and will then report a 507 status for the addressbook itself.
+    static const char header[] =
+        "<card:addressbook-query xmlns:d=\"DAV:\" xmlns:card=\"urn:ietf:params:xml:ns:carddav\">"
+            "<d:prop>"
+                "<d:getetag />"
+                "<card:address-data />"
+            "</d:prop>"
+            "<card:filter />";
+    static const char footer[] =
+        "</card:addressbook-query>";
+
+    QByteArray body;
+    body.reserve(int(sizeof(header) + sizeof(footer)) + 64);
+    body.append(header, sizeof(header) - 1);
+    if (limit > 0) {
+        body.append(QByteArrayLiteral("<card:limit><card:nresults>"));
+        body.append(QByteArray::number(limit));
+        body.append(QByteArrayLiteral("</card:nresults></card:limit>"));
+    }
+    body.append(footer, sizeof(footer) - 1);
+    return body;
+}
+
+QByteArray RequestGenerator::contactMultigetRequestBody(const QString &addressbookPath,
+                                                       const QStringList &contactUris,
+                                                       const QStringList &properties)
+{
+    static const char header[] =
+        "<card:addressbook-multiget xmlns:d=\"DAV:\" xmlns:card=\"urn:ietf:params:xml:ns:carddav\">"
+            "<d:prop>"
+                "<d:getetag />";
+    static const char propFooter[] =
+            "</d:prop>";
+    static const char footer[] =
+        "</card:addressbook-multiget>";
+    static const char hrefStart[] = "<d:href>";
+    static const char hrefEnd[] = "</d:href>";
+
+    const QByteArray addressbookPathUtf8 = addressbookPath.toUtf8();
+
+    // most hrefs are the addressbook path plus a short resource name,
+    // so reserve enough up-front to avoid reallocating while appending.
+    QByteArray body;
+    body.reserve(int(sizeof(header) + sizeof(propFooter) + sizeof(footer))
+                 + properties.size() * 32
+                 + contactUris.size() * (int(sizeof(hrefStart) + sizeof(hrefEnd)) + addressbookPathUtf8.size() + 48));
+
+    body.append(header, sizeof(header) - 1);
+    if (properties.isEmpty()) {
+        body.append(QByteArrayLiteral("<card:address-data />"));
+    } else {
+        // request only specific properties in the address data (RFC 6352 section 10.4.2).
+        body.append(QByteArrayLiteral("<card:address-data>"));
+        for (const QString &property : properties) {
+            body.append(QByteArrayLiteral("<card:prop name=\""));
+            appendXmlEscaped(body, property);
+            body.append(QByteArrayLiteral("\" />"));
+        }
+        body.append(QByteArrayLiteral("</card:address-data>"));
+    }
+    body.append(propFooter, sizeof(propFooter) - 1);
+
+    for (const QString &uri : contactUris) {
+        // note: href is of form: <d:href>/addressbooks/johndoe/contacts/acme-12345.vcf</d:href> etc.
+        // with the filename (after the last path marker) percent-encoded.
+        const QByteArray href = needsXmlEscaping(uri) ? uri.toHtmlEscaped().toUtf8() : uri.toUtf8();
+        const int lastPathMarker = href.lastIndexOf('/');
+        body.append(hrefStart, sizeof(hrefStart) - 1);
+        if (!uri.startsWith(addressbookPath)) {
+            body.append(addressbookPathUtf8);
+            body.append('/');
+        }
+        if (lastPathMarker > 0) {
+            body.append(href.constData(), lastPathMarker + 1);
+            appendPercentEncoded(body, href.constData() + lastPathMarker + 1, href.size() - lastPathMarker - 1);
+        } else {
+            body.append(href);
+        }
+        if (!uri.startsWith(addressbookPath)) {
+            body.append(QByteArrayLiteral(".vcf"));
+        }
+        body.append(hrefEnd, sizeof(hrefEnd) - 1);
+    }
+
+    body.append(footer, sizeof(footer) - 1);
+    return body;
 }
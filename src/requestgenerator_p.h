@@ -25,9 +25,13 @@
 
 #include <QList>
 #include <QString>
+#include <QStringList>
+#include <QByteArray>
 #include <QNetworkReply>
 #include <QNetworkAccessManager>
 
+#include <functional>
+
 #include <QContact>
 
 QTCONTACTS_USE_NAMESPACE
@@ -36,36 +40,91 @@ class Syncer;
 class RequestGenerator
 {
 public:
+    // each request is subject to the deadline of its phase
+    // of the sync, and to an inactivity (stall) timeout.
+    enum RequestPhase {
+        DiscoveryPhase = 0,
+        MetadataPhase,
+        MultigetPhase,
+        UpsyncPhase,
+        RequestPhaseCount
+    };
+
     RequestGenerator(Syncer *parent, const QString &username, const QString &password);
     RequestGenerator(Syncer *parent, const QString &accessToken);
 
+    void setRequestDeadline(RequestPhase phase, int msecs);
+    void setInactivityTimeout(int msecs);
+    static QString requestPhaseName(RequestPhase phase);
+
     QNetworkReply *currentUserInformation(const QString &serverUrl);
     QNetworkReply *addressbookUrls(const QString &serverUrl, const QString &userPath);
     QNetworkReply *addressbooksInformation(const QString &serverUrl, const QString &userAddressbooksPath);
     QNetworkReply *addressbookInformation(const QString &serverUrl, const QString &addressbookPath);
-    QNetworkReply *syncTokenDelta(const QString &serverUrl, const QString &addressbookUrl, const QString &syncToken);
+    QNetworkReply *syncTokenDelta(const QString &serverUrl, const QString &addressbookUrl, const QString &syncToken, int limit = 0);
     QNetworkReply *contactEtags(const QString &serverUrl, const QString &addressbookPath);
-    QNetworkReply *contactData(const QString &serverUrl, const QString &addressbookPath, const QStringList &contactEtags);
-    QNetworkReply *contactMultiget(const QString &serverUrl, const QString &addressbookPath, const QStringList &contactUris);
+    QNetworkReply *contactData(const QString &serverUrl, const QString &addressbookPath, const QStringList &contactEtags, int limit = 0);
+    QNetworkReply *contactMultiget(const QString &serverUrl, const QString &addressbookPath, const QStringList &contactUris, const QStringList &properties = QStringList());
     QNetworkReply *upsyncAddMod(const QString &serverUrl, const QString &contactPath, const QString &etag, const QString &vcard);
     QNetworkReply *upsyncDeletion(const QString &serverUrl, const QString &contactPath, const QString &etag);
+    QNetworkReply *serverOptions(const QString &serverUrl, const QString &path);
+    QNetworkReply *supportedReportSet(const QString &serverUrl, const QString &addressbookPath);
+
+    // If the given failed reply was for an idempotent request and failed with a
+    // transient error, schedules a resend of the request after a backoff delay,
+    // and returns true.  The resent reply (which inherits the dynamic properties
+    // of the failed reply) is passed to the callback, so that the caller can
+    // connect to its signals.
+    bool retryRequest(QNetworkReply *reply,
+                      QObject *context,
+                      const std::function<void (QNetworkReply *)> &resent) const;
+    static bool isTransientError(QNetworkReply *reply);
+    static bool isIdempotentRequest(QNetworkReply *reply);
+    static bool isUnknownOutcome(QNetworkReply *reply);
+    static bool isReplayedWriteConflict(QNetworkReply *reply);
+
+    // Requests the current state of the resource written by the given replayed
+    // write (see isReplayedWriteConflict()), so that the caller can confirm
+    // whether an earlier attempt was applied, see isConfirmedWrite().  The
+    // confirmation inherits the dynamic properties of the write.
+    QNetworkReply *confirmReplayedWrite(QNetworkReply *reply) const;
+    static bool isConfirmedWrite(QNetworkReply *confirmation, const QByteArray &data);
+    static int retryDelay(QNetworkReply *reply, int attempt);
+
+    // Aborts every outstanding request, without notifying the receiver.
+    void abortRequests(QObject *receiver) const;
+
+    // request body builders
+    static QByteArray syncTokenDeltaRequestBody(const QString &syncToken, int limit = 0);
+    static QByteArray contactDataRequestBody(int limit = 0);
+    static QByteArray contactMultigetRequestBody(const QString &addressbookPath,
+                                                 const QStringList &contactUris,
+                                                 const QStringList &properties = QStringList());
 
 private:
-    QNetworkReply *generateRequest(const QString &url,
+    void loadTimeouts();
+    QNetworkReply *generateRequest(RequestPhase phase,
+                                   const QString &url,
                                    const QString &path,
                                    const QString &depth,
                                    const QString &requestType,
-                                   const QString &request) const;
+                                   const QByteArray &requestData,
+                                   bool preferMinimal = false) const;
     QNetworkReply *generateUpsyncRequest(const QString &url,
                                          const QString &path,
                                          const QString &ifMatch,
                                          const QString &contentType,
                                          const QString &requestType,
-                                         const QString &request) const;
+                                         const QByteArray &requestData) const;
+    QNetworkReply *sendRequest(const QNetworkRequest &request,
+                               const QString &requestType,
+                               const QByteArray &requestData) const;
     Syncer *q;
     QString m_username;
     QString m_password;
     QString m_accessToken;
+    int m_requestDeadlines[RequestPhaseCount]; // msecs
+    int m_inactivityTimeout; // msecs
 };
 
 #endif // REQUESTGENERATOR_P_H
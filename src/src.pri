@@ -29,6 +29,8 @@ SOURCES += \
     $$PWD/carddav.cpp \
     $$PWD/requestgenerator.cpp \
     $$PWD/replyparser.cpp \
+    $$PWD/remotecontactchanges.cpp \
+    $$PWD/syncstatesnapshot.cpp \
     $$PWD/logging.cpp
 
 HEADERS += \
@@ -39,6 +41,8 @@ HEADERS += \
     $$PWD/carddav_p.h \
     $$PWD/requestgenerator_p.h \
     $$PWD/replyparser_p.h \
+    $$PWD/remotecontactchanges_p.h \
+    $$PWD/syncstatesnapshot_p.h \
     $$PWD/logging.h \
 
 OTHER_FILES += \
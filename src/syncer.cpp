@@ -23,6 +23,8 @@
 #include "syncer_p.h"
 #include "carddav_p.h"
 #include "auth_p.h"
+#include "requestgenerator_p.h"
+#include "syncstatesnapshot_p.h"
 
 #include <twowaycontactsyncadaptor_impl.h>
 #include <qtcontacts-extensions_manager_impl.h>
@@ -36,6 +38,8 @@
 #include <QtCore/QUrlQuery>
 #include <QtCore/QFile>
 #include <QtCore/QByteArray>
+#include <QtCore/QCryptographicHash>
+#include <QtCore/QTimer>
 #include <QtCore/QJsonDocument>
 #include <QtCore/QJsonObject>
 #include <QtCore/QJsonArray>
@@ -51,6 +55,7 @@
 #include <QtContacts/QContactExtendedDetail>
 #include <QtContacts/QContactDetailFilter>
 #include <QtContacts/QContactIntersectionFilter>
+#include <QtContacts/QContactCollectionFilter>
 
 #include <Accounts/Manager>
 #include <Accounts/Account>
@@ -58,8 +63,28 @@
 #include <SyncProfile.h>
 #include "logging.h"
 
+#include <limits.h>
+#include <algorithm>
+
+#if QT_VERSION >= QT_VERSION_CHECK(6, 3, 0)
+#include <QtNetwork/QNetworkInformation>
+#elif QT_VERSION < QT_VERSION_CHECK(6, 0, 0)
+#include <QtNetwork/QNetworkConfigurationManager>
+#endif
+
 #define CARDDAV_CONTACTS_APPLICATION QLatin1String("carddav")
 static const int HTTP_UNAUTHORIZED_ACCESS = 401;
+static const qint64 DefaultMeteredByteBudget = 5 * 1024 * 1024;
+static const qint64 DefaultMeteredMaxVCardSize = 64 * 1024;
+static const int DefaultMaxConcurrentListings = 4;
+static const int DefaultStoreBatchSize = 0;      // store all changes at once
+static const int DefaultMaxContactsPerRun = 0;    // unlimited
+static const int DefaultMaxSecondsPerRun = 0;     // unlimited
+static const qint64 DefaultMemoryBudget = 0;      // unbounded
+static const int AggregationBatchSize = 200;
+static const int CapabilitiesMaxAgeDays = 7;
+static const int DefaultLargeAddressbookSize = 5000;
+static const int DefaultLargeAddressbookInterval = 0; // downsync on every run
 
 Syncer::Syncer(QObject *parent, Buteo::SyncProfile *syncProfile, int accountId)
     : QObject(parent), QtContactsSqliteExtensions::TwoWayContactSyncAdaptor(
@@ -68,8 +93,24 @@ Syncer::Syncer(QObject *parent, Buteo::SyncProfile *syncProfile, int accountId)
     , m_cardDav(0)
     , m_auth(0)
     , m_contactManager(QStringLiteral("org.nemomobile.contacts.sqlite"))
+    , m_qnam(&m_defaultQnam)
     , m_syncAborted(false)
     , m_syncError(false)
+    , m_syncTier(FullSyncTier)
+    , m_meteredByteBudget(DefaultMeteredByteBudget)
+    , m_meteredMaxVCardSize(DefaultMeteredMaxVCardSize)
+    , m_downloadedBytes(0)
+    , m_maxConcurrentListings(DefaultMaxConcurrentListings)
+    , m_storeBatchSize(DefaultStoreBatchSize)
+    , m_bulkImport(true)
+    , m_maxContactsPerRun(DefaultMaxContactsPerRun)
+    , m_maxSecondsPerRun(DefaultMaxSecondsPerRun)
+    , m_fetchedContacts(0)
+    , m_memoryBudget(DefaultMemoryBudget)
+    , m_largeAddressbookSize(DefaultLargeAddressbookSize)
+    , m_largeAddressbookInterval(DefaultLargeAddressbookInterval)
+    , m_serverCapabilitiesProbed(false)
+    , m_havePreflightAddressbooks(false)
     , m_accountId(accountId)
     , m_ignoreSslErrors(false)
 {
@@ -85,12 +126,594 @@ Syncer::~Syncer()
 void Syncer::abortSync()
 {
     m_syncAborted = true;
+    if (m_cardDav) {
+        m_cardDav->abortRequests();
+    }
+}
+
+void Syncer::recordSyncStage(SyncStage stage, qint64 items, qint64 bytes, qint64 nsecs)
+{
+    SyncStageStatistics &statistics(m_syncStageStatistics[stage]);
+    statistics.items += items;
+    statistics.bytes += bytes;
+    statistics.nsecs += nsecs;
+}
+
+QString Syncer::syncStageName(SyncStage stage)
+{
+    switch (stage) {
+    case ReceiveStage: return QStringLiteral("receive");
+    case ParseStage:   return QStringLiteral("parse");
+    case ConvertStage: return QStringLiteral("convert");
+    case StoreStage:   return QStringLiteral("store");
+    default:           return QString();
+    }
+}
+
+QString Syncer::syncStageSummary() const
+{
+    // the receive time is the wall time of each request, so it overlaps
+    // with the conversion of the previous page.
+    QStringList stages;
+    for (int i = 0; i < SyncStageCount; ++i) {
+        const SyncStageStatistics &statistics(m_syncStageStatistics[i]);
+        if (statistics.items == 0 && statistics.nsecs == 0) {
+            continue;
+        }
+        const qint64 msecs = statistics.nsecs / 1000000;
+        const qint64 itemsPerSecond = statistics.nsecs > 0 ? statistics.items * 1000000000 / statistics.nsecs : 0;
+        QString summary = QStringLiteral("%1: %2 items in %3 ms (%4/s)").arg(
+                syncStageName(static_cast<SyncStage>(i)),
+                QString::number(statistics.items),
+                QString::number(msecs),
+                QString::number(itemsPerSecond));
+        if (statistics.bytes > 0) {
+            summary += QStringLiteral(", %1 KiB").arg(statistics.bytes / 1024);
+        }
+        stages.append(summary);
+    }
+    return stages.join(QStringLiteral("; "));
+}
+
+void Syncer::setNetworkAccessManager(QNetworkAccessManager *qnam)
+{
+    m_qnam = qnam ? qnam : &m_defaultQnam;
+}
+
+QString Syncer::requestTimeoutSummary() const
+{
+    // reported in the sync results, to allow tuning the timeouts per server.
+    QStringList timeouts;
+    for (int i = 0; i < RequestGenerator::RequestPhaseCount; ++i) {
+        const int count = m_requestTimeouts.value(i);
+        if (count > 0) {
+            timeouts.append(QStringLiteral("%1: %2").arg(
+                    RequestGenerator::requestPhaseName(static_cast<RequestGenerator::RequestPhase>(i)),
+                    QString::number(count)));
+        }
+    }
+    return timeouts.isEmpty()
+            ? QString()
+            : QStringLiteral("Request timeouts (%1)").arg(timeouts.join(QStringLiteral(", ")));
+}
+
+void Syncer::loadSettings()
+{
+    // the sync of an account may be tuned via the keys of its sync profile.
+    // Sizes are given in KiB, the run budget in seconds, and the interval
+    // between downsyncs of a large addressbook (in contacts) in hours.
+    m_syncTierSetting = QStringLiteral("auto");
+    m_meteredByteBudget = DefaultMeteredByteBudget;
+    m_meteredMaxVCardSize = DefaultMeteredMaxVCardSize;
+    m_maxConcurrentListings = DefaultMaxConcurrentListings;
+    m_storeBatchSize = DefaultStoreBatchSize;
+    m_bulkImport = true;
+    m_maxContactsPerRun = DefaultMaxContactsPerRun;
+    m_maxSecondsPerRun = DefaultMaxSecondsPerRun;
+    m_memoryBudget = DefaultMemoryBudget;
+    m_largeAddressbookSize = DefaultLargeAddressbookSize;
+    m_largeAddressbookInterval = DefaultLargeAddressbookInterval;
+    if (!m_syncProfile) {
+        return;
+    }
+
+    auto value = [this] (const char *key, qint64 defaultValue, qint64 scale) {
+        const qint64 configured = m_syncProfile->key(QLatin1String(key)).toLongLong();
+        return configured > 0 ? configured * scale : defaultValue;
+    };
+
+    // the sync tier may be forced, rather than following the connection.
+    const QString tier = m_syncProfile->key(QStringLiteral("carddav_sync_tier")).toLower();
+    if (tier == QLatin1String("full") || tier == QLatin1String("metered")) {
+        m_syncTierSetting = tier;
+    }
+    m_meteredByteBudget = value("carddav_metered_byte_budget", DefaultMeteredByteBudget, 1024);
+    m_meteredMaxVCardSize = value("carddav_metered_max_vcard_size", DefaultMeteredMaxVCardSize, 1024);
+    m_maxConcurrentListings = value("carddav_max_concurrent_listings", DefaultMaxConcurrentListings, 1);
+    m_storeBatchSize = value("carddav_store_batch_size", DefaultStoreBatchSize, 1);
+    m_bulkImport = m_syncProfile->key(QStringLiteral("carddav_bulk_import")).toLower() != QLatin1String("false");
+    m_maxContactsPerRun = value("carddav_max_contacts_per_run", DefaultMaxContactsPerRun, 1);
+    m_maxSecondsPerRun = value("carddav_max_seconds_per_run", DefaultMaxSecondsPerRun, 1);
+    m_memoryBudget = value("carddav_memory_budget", DefaultMemoryBudget, 1024);
+    m_largeAddressbookSize = value("carddav_large_addressbook_size", DefaultLargeAddressbookSize, 1);
+    m_largeAddressbookInterval = value("carddav_large_addressbook_interval", DefaultLargeAddressbookInterval, 1);
+}
+
+qint64 Syncer::maxVCardSize() const
+{
+    // the size of the largest vCard which is fetched during this sync, or zero
+    // if unbounded.  Larger vCards are postponed until a later sync.
+    return m_syncTier == MeteredSyncTier ? m_meteredMaxVCardSize : 0;
+}
+
+qint64 Syncer::maxBufferedVCardSize() const
+{
+    // the size of the largest vCard which fits in the memory budget, or zero if
+    // unbounded.  A vCard is parsed and converted in memory more than once over,
+    // so vCards beyond half of the memory budget are skipped.
+    return m_memoryBudget / 2;
+}
+
+bool Syncer::hasSkippedContacts(const QContactCollection &addressbook) const
+{
+    // contacts which a memory-bounded sync skipped are fetched by the first
+    // sync which is not memory-bounded, even if the addressbook is unchanged.
+    return maxBufferedVCardSize() == 0
+        && !addressbook.extendedMetaData(KEY_SKIPPEDCONTACTS).toStringList().isEmpty();
+}
+
+qint64 Syncer::maxBufferedBytes() const
+{
+    // the vCard bytes which may be requested per page, and converted but not yet
+    // stored, at any time.  Each is bounded to a quarter of the memory budget, to
+    // leave room for the parsed response and the listings of the addressbook.
+    //
+    // The budget only bounds this contact data: the listing of the addressbook,
+    // its local changes, and the remote modifications of existing contacts are
+    // held until the addressbook has been synced.
+    return m_memoryBudget / 4;
+}
+
+int Syncer::remainingRunBudget() const
+{
+    // the number of contacts which may still be fetched during this run.
+    // Contacts beyond the budget are postponed, and as the ctag and sync token
+    // of their addressbook are not advanced, the next run fetches the remainder:
+    // contacts which were already stored are then unmodified, and skipped.
+    if (m_maxSecondsPerRun > 0 && m_syncTimer.isValid()
+            && m_syncTimer.elapsed() >= m_maxSecondsPerRun * qint64(1000)) {
+        return 0;
+    }
+    if (m_maxContactsPerRun > 0) {
+        return qMax(0, m_maxContactsPerRun - m_fetchedContacts);
+    }
+    return INT_MAX;
+}
+
+void Syncer::loadAddressbookSettings()
+{
+    // accounts with many (e.g. shared) addressbooks may disable some of them,
+    // and list others in the order in which they should be synced.  Unlike
+    // the tuning in the sync profile, the selection belongs to the account,
+    // and is read once the account has been signed in.
+    m_disabledAddressbooks.clear();
+    m_addressbookPriorities.clear();
+    if (m_auth) {
+        const QStringList disabled = m_auth->serviceValue(QStringLiteral("carddav_disabled_addressbooks")).toStringList();
+        for (const QString &path : disabled) {
+            m_disabledAddressbooks.insert(path);
+        }
+        const QStringList prioritized = m_auth->serviceValue(QStringLiteral("carddav_prioritized_addressbooks")).toStringList();
+        for (int i = 0; i < prioritized.size(); ++i) {
+            if (!m_addressbookPriorities.contains(prioritized.at(i))) {
+                m_addressbookPriorities.insert(prioritized.at(i), i);
+            }
+        }
+    }
+}
+
+QList<ReplyParser::AddressBookInformation> Syncer::enabledAddressbooks(const QList<ReplyParser::AddressBookInformation> &infos) const
+{
+    // disabled addressbooks are skipped: they are not added locally, and the
+    // local data of those which were synced before is kept as it is.
+    if (m_disabledAddressbooks.isEmpty()) {
+        return infos;
+    }
+
+    QList<ReplyParser::AddressBookInformation> enabled;
+    enabled.reserve(infos.size());
+    for (const ReplyParser::AddressBookInformation &info : infos) {
+        if (m_disabledAddressbooks.contains(info.url)) {
+            qCDebug(lcCardDav) << Q_FUNC_INFO << "ignoring disabled addressbook" << info.url;
+        } else {
+            enabled.append(info);
+        }
+    }
+    return enabled;
+}
+
+void Syncer::prioritizeAddressbooks(QList<QContactCollection> *addressbooks) const
+{
+    // the adaptor syncs the addressbooks (and the contact listings are prefetched)
+    // in the order given, so sync the prioritized addressbooks first, and then
+    // the others from the smallest to the largest.  Addressbooks which have not
+    // been downsynced before are of unknown size, and are synced last.
+    const int unprioritized = m_addressbookPriorities.size();
+    auto rank = [this, unprioritized] (const QContactCollection &addressbook) {
+        const QString path = addressbook.extendedMetaData(COLLECTION_EXTENDEDMETADATA_KEY_REMOTEPATH).toString();
+        bool known = false;
+        const int size = addressbook.extendedMetaData(KEY_CONTACTCOUNT).toInt(&known);
+        return qMakePair(m_addressbookPriorities.value(path, unprioritized), known ? size : INT_MAX);
+    };
+    std::stable_sort(addressbooks->begin(), addressbooks->end(),
+                     [&rank] (const QContactCollection &lhs, const QContactCollection &rhs) {
+        return rank(lhs) < rank(rhs);
+    });
+}
+
+bool Syncer::deferLargeAddressbook(const QContactCollection &addressbook) const
+{
+    // a large addressbook which has changed remotely is only downsynced
+    // if its previous downsync was at least the configured interval ago.
+    if (m_largeAddressbookInterval <= 0) {
+        return false;
+    }
+
+    const QString path = addressbook.extendedMetaData(COLLECTION_EXTENDEDMETADATA_KEY_REMOTEPATH).toString();
+    bool known = false;
+    const int size = addressbook.extendedMetaData(KEY_CONTACTCOUNT).toInt(&known);
+    if (!known || size < m_largeAddressbookSize || m_addressbookPriorities.contains(path)) {
+        return false;
+    }
+    const QDateTime lastDownsync = QDateTime::fromString(
+            addressbook.extendedMetaData(KEY_LASTDOWNSYNC).toString(), Qt::ISODate);
+    if (!lastDownsync.isValid()
+            || lastDownsync.addSecs(m_largeAddressbookInterval * 3600) <= QDateTime::currentDateTimeUtc()) {
+        return false;
+    }
+
+    // local changes are upsynced against the remote state, so they cannot wait.
+    if (hasLocalContactChanges(QSet<QContactCollectionId>() << addressbook.id())) {
+        return false;
+    }
+
+    qCDebug(lcCardDav) << Q_FUNC_INFO << "deferring downsync of large addressbook" << path
+                       << "with" << size << "contacts, last downsynced" << lastDownsync;
+    return true;
+}
+
+void Syncer::recordAddressbookDownsync(const QString &addressbookUrl, int contactCount)
+{
+    // stored along with the collection, to schedule the following syncs.
+    QContactCollection &addressbook(m_currentCollections[addressbookUrl]);
+    addressbook.setExtendedMetaData(KEY_CONTACTCOUNT, qMax(0, contactCount));
+    addressbook.setExtendedMetaData(KEY_LASTDOWNSYNC, QDateTime::currentDateTimeUtc().toString(Qt::ISODate));
+}
+
+void Syncer::deferAggregation(QContactCollection *collection) const
+{
+    // The contacts of a newly added addressbook are imported without being
+    // aggregated one at a time, and are aggregated in batches once the
+    // remote changes have been stored.  See aggregateDeferredCollections().
+    // Until then the addressbook is not aggregable, so its contacts do not
+    // appear in the aggregated contacts; if the aggregation is interrupted,
+    // e.g. by the sync being aborted, they remain hidden until the next
+    // successful sync resumes the aggregation.
+    if (m_bulkImport) {
+        collection->setExtendedMetaData(COLLECTION_EXTENDEDMETADATA_KEY_AGGREGABLE, false);
+        collection->setExtendedMetaData(KEY_DEFERREDAGGREGATION, true);
+    }
+}
+
+void Syncer::aggregateDeferredCollections()
+{
+    QContactManager::Error err = QContactManager::NoError;
+    QtContactsSqliteExtensions::ContactManagerEngine *cme = QtContactsSqliteExtensions::contactManagerEngine(m_contactManager);
+    QList<QContactCollection> added, modified, deleted, unmodified;
+    if (!cme->fetchCollectionChanges(m_accountId, CARDDAV_CONTACTS_APPLICATION, &added, &modified, &deleted, &unmodified, &err)) {
+        qCWarning(lcCardDav) << Q_FUNC_INFO << "unable to fetch collections for deferred aggregation:" << err;
+        emit syncSucceeded(); // resumed by the next sync.
+        return;
+    }
+
+    m_deferredAggregations.clear();
+    m_aggregationContactIds.clear();
+    for (const QContactCollection &collection : added + modified + unmodified) {
+        if (collection.extendedMetaData(KEY_DEFERREDAGGREGATION).toBool()) {
+            m_deferredAggregations.append(collection);
+        }
+    }
+
+    // the contacts are aggregated one batch per event loop iteration, so that
+    // the sync can still be aborted, and success is only reported once the
+    // last batch is stored, so that the imported contacts are visible by then.
+    if (m_deferredAggregations.isEmpty()) {
+        emit syncSucceeded();
+    } else {
+        QTimer::singleShot(0, this, SLOT(aggregateNextBatch()));
+    }
+}
+
+void Syncer::aggregateNextBatch()
+{
+    if (m_deferredAggregations.isEmpty()) {
+        return; // cancelled by a new sync.
+    }
+
+    if (m_syncAborted) {
+        // the remaining addressbooks keep their marker, and are aggregated by the next sync.
+        qCDebug(lcCardDav) << Q_FUNC_INFO << "sync aborted, postponing the aggregation of"
+                           << m_deferredAggregations.size() << "addressbooks";
+        m_deferredAggregations.clear();
+        m_aggregationContactIds.clear();
+        return;
+    }
+
+    // the contacts are aggregated as they are stored into an aggregable collection.
+    // The marker is only removed along with the last batch, so that a pass which
+    // is interrupted, e.g. by the plugin being unloaded, is resumed by the next sync.
+    QContactCollection &collection(m_deferredAggregations.first());
+    if (m_aggregationContactIds.isEmpty()) {
+        QContactCollectionFilter collectionFilter;
+        collectionFilter.setCollectionIds(QSet<QContactCollectionId>() << collection.id());
+        m_aggregationContactIds = m_contactManager.contactIds(collectionFilter);
+        qCDebug(lcCardDav) << Q_FUNC_INFO << "aggregating" << m_aggregationContactIds.size() << "contacts of addressbook"
+                           << collection.extendedMetaData(COLLECTION_EXTENDEDMETADATA_KEY_REMOTEPATH).toString();
+        collection.setExtendedMetaData(COLLECTION_EXTENDEDMETADATA_KEY_AGGREGABLE, true);
+    }
+
+    QList<QContact> contacts = m_contactManager.contacts(m_aggregationContactIds.mid(0, AggregationBatchSize));
+    const bool lastBatch = m_aggregationContactIds.size() <= AggregationBatchSize;
+    if (lastBatch) {
+        collection.setExtendedMetaData(KEY_DEFERREDAGGREGATION, false);
+    }
+
+    // the change flags are left untouched, so that any local changes made to
+    // the imported contacts in the meantime are still upsynced.
+    QContactManager::Error err = QContactManager::NoError;
+    QtContactsSqliteExtensions::ContactManagerEngine *cme = QtContactsSqliteExtensions::contactManagerEngine(m_contactManager);
+    QHash<QContactCollection*, QList<QContact>*> modifiedCollections;
+    modifiedCollections.insert(&collection, &contacts);
+    if (!cme->storeChanges(nullptr, &modifiedCollections, QList<QContactCollectionId>(),
+            QtContactsSqliteExtensions::ContactManagerEngine::PreserveLocalChanges,
+            false, &err)) {
+        qCWarning(lcCardDav) << Q_FUNC_INFO << "unable to aggregate contacts of collection"
+                             << collection.id() << ":" << err;
+        m_aggregationContactIds.clear();
+        m_deferredAggregations.removeFirst();
+    } else {
+        emit contactsAggregated(contacts.size());
+        if (lastBatch) {
+            m_aggregationContactIds.clear();
+            m_deferredAggregations.removeFirst();
+        } else {
+            m_aggregationContactIds = m_aggregationContactIds.mid(AggregationBatchSize);
+        }
+    }
+
+    if (m_deferredAggregations.isEmpty()) {
+        emit syncSucceeded();
+    } else {
+        QTimer::singleShot(0, this, SLOT(aggregateNextBatch()));
+    }
+}
+
+bool Syncer::storeRemoteAdditions(const QString &addressbookUrl, QList<QContact> *contacts)
+{
+    // the ctag and sync token are only advanced once all changes have been stored,
+    // so that the remaining changes are fetched again if the sync is interrupted.
+    // An addressbook which is new locally is added along with the first batch,
+    // with an empty ctag and sync token, so that an interrupted sync is resumed
+    // with a full listing which is matched against the stored contacts.
+    QContactCollection collection = m_currentCollections.value(addressbookUrl);
+    const bool addedCollection = collection.id().isNull();
+    const QPair<QString, QString> previous = m_previousCtagSyncToken.value(addressbookUrl);
+    collection.setExtendedMetaData(KEY_CTAG, previous.first);
+    collection.setExtendedMetaData(KEY_SYNCTOKEN, previous.second);
+    for (QContact &contact : *contacts) {
+        contact.setCollectionId(collection.id());
+    }
+
+    // the change flags are left for the adaptor to clear once the local changes
+    // of the addressbook have been upsynced.  Until then, the stored contacts
+    // appear as local additions which are known remotely, see upsyncUpdates().
+    QHash<QContactCollection*, QList<QContact>*> collections;
+    collections.insert(&collection, contacts);
+    QContactManager::Error err = QContactManager::NoError;
+    QtContactsSqliteExtensions::ContactManagerEngine *cme = QtContactsSqliteExtensions::contactManagerEngine(m_contactManager);
+    if (!cme->storeChanges(addedCollection ? &collections : nullptr,
+            addedCollection ? nullptr : &collections,
+            QList<QContactCollectionId>(),
+            QtContactsSqliteExtensions::ContactManagerEngine::PreserveLocalChanges,
+            false, &err)) {
+        qCWarning(lcCardDav) << Q_FUNC_INFO << "unable to store" << contacts->size()
+                             << "remote additions to addressbook" << addressbookUrl << ":" << err;
+        return false;
+    }
+
+    if (addedCollection) {
+        // later batches, and the remaining changes, are stored into the added collection.
+        m_currentCollections[addressbookUrl].setId(collection.id());
+    }
+    return true;
+}
+
+bool Syncer::isMeteredConnection()
+{
+#if QT_VERSION >= QT_VERSION_CHECK(6, 3, 0)
+    if (!QNetworkInformation::instance()) {
+        QNetworkInformation::loadBackendByFeatures(QNetworkInformation::Feature::Metered);
+    }
+    const QNetworkInformation *info = QNetworkInformation::instance();
+    return info && (info->isMetered()
+                    || info->transportMedium() == QNetworkInformation::TransportMedium::Cellular);
+#elif QT_VERSION < QT_VERSION_CHECK(6, 0, 0)
+    // the connection is considered metered if the only active connections are cellular.
+    QNetworkConfigurationManager manager;
+    bool cellular = false;
+    const QList<QNetworkConfiguration> configs = manager.allConfigurations(QNetworkConfiguration::Active);
+    for (const QNetworkConfiguration &config : configs) {
+        switch (config.bearerType()) {
+        case QNetworkConfiguration::Bearer2G:
+        case QNetworkConfiguration::BearerCDMA2000:
+        case QNetworkConfiguration::BearerWCDMA:
+        case QNetworkConfiguration::BearerHSPA:
+        case QNetworkConfiguration::BearerEVDO:
+        case QNetworkConfiguration::BearerLTE:
+        case QNetworkConfiguration::Bearer3G:
+        case QNetworkConfiguration::Bearer4G:
+            cellular = true;
+            break;
+        case QNetworkConfiguration::BearerEthernet:
+        case QNetworkConfiguration::BearerWLAN:
+            return false;
+        default:
+            break;
+        }
+    }
+    return cellular;
+#else
+    return false;
+#endif
+}
+
+void Syncer::updateSyncTier()
+{
+    const SyncTier tier = m_syncTierSetting == QLatin1String("full") ? FullSyncTier
+                        : m_syncTierSetting == QLatin1String("metered") ? MeteredSyncTier
+                        : isMeteredConnection() ? MeteredSyncTier : FullSyncTier;
+    if (tier != m_syncTier) {
+        qCDebug(lcCardDav) << Q_FUNC_INFO << "using" << (tier == MeteredSyncTier ? "metered" : "full")
+                           << "sync tier for account" << m_accountId;
+        m_syncTier = tier;
+    }
+}
+
+void Syncer::loadServerCapabilities()
+{
+    // the cached capabilities are only valid for the server and credentials
+    // they were probed with, and servers are upgraded, so probe them again
+    // once they are older than a week.
+    m_serverCapabilities.clear();
+    m_serverCapabilitiesProbed = false;
+    if (!m_auth || m_auth->serviceValue(QStringLiteral("carddav_capabilities_fingerprint")).toString() != discoveryCacheFingerprint()) {
+        return;
+    }
+    const QDateTime probed = QDateTime::fromString(
+            m_auth->serviceValue(QStringLiteral("carddav_capabilities_probed")).toString(), Qt::ISODate);
+    if (!probed.isValid() || probed.addDays(CapabilitiesMaxAgeDays) < QDateTime::currentDateTimeUtc()) {
+        qCDebug(lcCardDav) << Q_FUNC_INFO << "cached server capabilities have expired";
+        return;
+    }
+
+    m_serverCapabilities = m_auth->serviceValue(QStringLiteral("carddav_capabilities")).toStringList();
+    m_serverCapabilitiesProbed = true;
+    qCDebug(lcCardDav) << Q_FUNC_INFO << "cached server capabilities:" << m_serverCapabilities;
+}
+
+void Syncer::storeServerCapabilities(const QStringList &capabilities)
+{
+    m_serverCapabilities = capabilities;
+    m_serverCapabilitiesProbed = true;
+    if (m_auth) {
+        QVariantMap values;
+        values.insert(QStringLiteral("carddav_capabilities"), capabilities);
+        values.insert(QStringLiteral("carddav_capabilities_fingerprint"), discoveryCacheFingerprint());
+        values.insert(QStringLiteral("carddav_capabilities_probed"), QDateTime::currentDateTimeUtc().toString(Qt::ISODate));
+        m_auth->setServiceValues(values);
+    }
+}
+
+void Syncer::removeServerCapability(const QString &capability)
+{
+    // the server rejected a request which relies on the capability, so stop
+    // relying on it, without probing the other capabilities again.
+    if (m_serverCapabilities.contains(capability)) {
+        qCDebug(lcCardDav) << Q_FUNC_INFO << "server does not support" << capability;
+        m_serverCapabilities.removeAll(capability);
+        if (m_auth) {
+            m_auth->setServiceValue(QStringLiteral("carddav_capabilities"), m_serverCapabilities);
+        }
+    }
+}
+
+QString Syncer::discoveryCacheFingerprint() const
+{
+    // the cached discovery results and capabilities are only valid for
+    // the server and credentials which were used to determine them.
+    return QString::fromLatin1(QCryptographicHash::hash(
+            QStringLiteral("%1\n%2").arg(m_serverUrl, m_username).toUtf8(),
+            QCryptographicHash::Sha256).toHex());
+}
+
+bool Syncer::loadDiscoveryCache(QString *serverUrl, QString *principalPath, QString *homeSetPath) const
+{
+    if (!m_auth || m_auth->serviceValue(QStringLiteral("carddav_discovery_fingerprint")).toString() != discoveryCacheFingerprint()) {
+        return false;
+    }
+
+    *serverUrl = m_auth->serviceValue(QStringLiteral("carddav_discovery_server_url")).toString();
+    *principalPath = m_auth->serviceValue(QStringLiteral("carddav_discovery_principal")).toString();
+    *homeSetPath = m_auth->serviceValue(QStringLiteral("carddav_discovery_home_set")).toString();
+    return !serverUrl->isEmpty() && !homeSetPath->isEmpty();
+}
+
+void Syncer::storeDiscoveryCache(const QString &serverUrl, const QString &principalPath, const QString &homeSetPath)
+{
+    if (!m_auth) {
+        return;
+    }
+
+    qCDebug(lcCardDav) << Q_FUNC_INFO << "caching discovered home set" << homeSetPath << "from" << serverUrl;
+    QVariantMap values;
+    values.insert(QStringLiteral("carddav_discovery_fingerprint"), discoveryCacheFingerprint());
+    values.insert(QStringLiteral("carddav_discovery_server_url"), serverUrl);
+    values.insert(QStringLiteral("carddav_discovery_principal"), principalPath);
+    values.insert(QStringLiteral("carddav_discovery_home_set"), homeSetPath);
+    m_auth->setServiceValues(values);
+}
+
+void Syncer::clearDiscoveryCache()
+{
+    if (!m_auth) {
+        return;
+    }
+
+    qCDebug(lcCardDav) << Q_FUNC_INFO << "invalidating cached discovery results for account" << m_accountId;
+    QVariantMap values;
+    values.insert(QStringLiteral("carddav_discovery_fingerprint"), QVariant());
+    values.insert(QStringLiteral("carddav_discovery_server_url"), QVariant());
+    values.insert(QStringLiteral("carddav_discovery_principal"), QVariant());
+    values.insert(QStringLiteral("carddav_discovery_home_set"), QVariant());
+
+    // the capabilities may have been probed from the previous home set.
+    values.insert(QStringLiteral("carddav_capabilities"), QVariant());
+    values.insert(QStringLiteral("carddav_capabilities_fingerprint"), QVariant());
+    values.insert(QStringLiteral("carddav_capabilities_probed"), QVariant());
+    m_auth->setServiceValues(values);
+    m_serverCapabilities.clear();
+    m_serverCapabilitiesProbed = false;
 }
 
 void Syncer::startSync(int accountId)
 {
     Q_ASSERT(accountId != 0);
     m_accountId = accountId;
+    m_syncAborted = false;
+    m_requestTimeouts.clear();
+    for (SyncStageStatistics &statistics : m_syncStageStatistics) {
+        statistics = SyncStageStatistics();
+    }
+    m_downloadedBytes = 0;
+    m_fetchedContacts = 0;
+    m_syncTimer.start();
+    m_addressbooksListHandler = nullptr;
+    m_preflightAddressbooks.clear();
+    m_havePreflightAddressbooks = false;
+    m_deferredAggregations.clear();
+    m_aggregationContactIds.clear();
+    loadSettings();
+    updateSyncTier();
     m_auth = new Auth(this);
     connect(m_auth, SIGNAL(signInCompleted(QString,QString,QString,QString,QString,bool)),
             this, SLOT(sync(QString,QString,QString,QString,QString,bool)));
@@ -113,29 +736,172 @@ void Syncer::sync(const QString &serverUrl, const QString &addressbookPath, cons
     m_password = password;
     m_accessToken = accessToken;
     m_ignoreSslErrors = ignoreSslErrors;
+    loadServerCapabilities();
+    loadAddressbookSettings();
 
     m_cardDav = m_username.isEmpty()
               ? new CardDav(this, m_serverUrl, m_addressbookPath, m_accessToken)
               : new CardDav(this, m_serverUrl, m_addressbookPath, m_username, m_password);
     connect(m_cardDav, &CardDav::error,
             this, &Syncer::cardDavError);
+    connect(m_cardDav, &CardDav::addressbooksList,
+            this, &Syncer::addressbooksListed);
 
     qCDebug(lcCardDav) << "CardDAV Sync adapter initialised for account" << m_accountId << ", starting sync...";
 
-    if (!TwoWayContactSyncAdaptor::startSync(TwoWayContactSyncAdaptor::ContinueAfterError)) {
-        qCDebug(lcCardDav) << "Unable to start CardDAV sync!";
+    // most periodic syncs are no-ops.  The addressbook listing is required
+    // anyway, so use it to check for remote changes before the adaptor
+    // loads the local contacts of every addressbook.
+    requestAddressbooksList([this] (const QList<ReplyParser::AddressBookInformation> &infos) {
+        if (m_syncAborted) {
+            return;
+        }
+
+        const std::function<void (bool)> handler = [this, infos] (bool changed) {
+            if (m_syncAborted) {
+                return;
+            }
+            if (!changed) {
+                qCDebug(lcCardDav) << "No remote or local changes for account" << m_accountId << ", skipping sync cycle";
+                syncFinishedSuccessfully();
+                return;
+            }
+
+            // the adaptor will reuse this listing.
+            m_preflightAddressbooks = infos;
+            m_havePreflightAddressbooks = true;
+            if (!TwoWayContactSyncAdaptor::startSync(TwoWayContactSyncAdaptor::ContinueAfterError)) {
+                qCDebug(lcCardDav) << "Unable to start CardDAV sync!";
+            }
+        };
+
+        // addressbooks without a ctag or sync token must be listed to detect changes.
+        QStringList unversionedAddressbooks;
+        const bool changed = preflightDetectsChanges(infos, &unversionedAddressbooks);
+        if (!changed && !unversionedAddressbooks.isEmpty()) {
+            m_cardDav->compareContactListings(unversionedAddressbooks, handler);
+        } else {
+            handler(changed);
+        }
+    });
+}
+
+void Syncer::requestAddressbooksList(const std::function<void (const QList<ReplyParser::AddressBookInformation> &)> &handler)
+{
+    m_addressbooksListHandler = handler;
+    if (m_havePreflightAddressbooks) {
+        // reuse the listing fetched by the pre-flight check.
+        const QList<ReplyParser::AddressBookInformation> infos = m_preflightAddressbooks;
+        m_preflightAddressbooks.clear();
+        m_havePreflightAddressbooks = false;
+        QTimer::singleShot(0, this, [this, infos] () {
+            addressbooksListed(infos);
+        });
+    } else {
+        m_cardDav->determineAddressbooksList();
+    }
+}
+
+void Syncer::addressbooksListed(const QList<ReplyParser::AddressBookInformation> &infos)
+{
+    if (!m_addressbooksListHandler) {
+        qCWarning(lcCardDav) << Q_FUNC_INFO << "ignoring unexpected addressbooks list";
+        return;
+    }
+
+    const std::function<void (const QList<ReplyParser::AddressBookInformation> &)> handler = m_addressbooksListHandler;
+    m_addressbooksListHandler = nullptr;
+    handler(infos);
+}
+
+bool Syncer::preflightDetectsChanges(const QList<ReplyParser::AddressBookInformation> &infos,
+                                     QStringList *unversionedAddressbooks)
+{
+    QContactManager::Error err = QContactManager::NoError;
+    QtContactsSqliteExtensions::ContactManagerEngine *cme = QtContactsSqliteExtensions::contactManagerEngine(m_contactManager);
+    QList<QContactCollection> added, modified, deleted, unmodified;
+    if (!cme->fetchCollectionChanges(m_accountId, CARDDAV_CONTACTS_APPLICATION, &added, &modified, &deleted, &unmodified, &err)) {
+        qCWarning(lcCardDav) << Q_FUNC_INFO << "unable to fetch local collection changes:" << err;
+        return true;
+    }
+    if (!added.isEmpty() || !modified.isEmpty() || !deleted.isEmpty()) {
+        return true;
+    }
+
+    // every addressbook must be known locally, with unchanged ctag or sync token.
+    // Disabled addressbooks are skipped, unless they were deleted remotely.
+    QHash<QString, QPair<QString, QString> > remoteCtagSyncToken;
+    QSet<QString> disabledPaths;
+    for (const ReplyParser::AddressBookInformation &info : infos) {
+        if (m_disabledAddressbooks.contains(info.url)) {
+            disabledPaths.insert(info.url);
+            continue;
+        }
+        if (info.ctag.isEmpty() && info.syncToken.isEmpty()) {
+            // changes can only be detected by listing the contacts, and
+            // comparing the listing to the snapshot of the previous sync.
+            if (!QFile::exists(SyncStateSnapshot::filePath(m_accountId, info.url))) {
+                return true;
+            }
+            unversionedAddressbooks->append(info.url);
+        }
+        remoteCtagSyncToken.insert(info.url, qMakePair(info.ctag, info.syncToken));
+    }
+
+    QSet<QContactCollectionId> collectionIds;
+    int skipped = 0;
+    for (const QContactCollection &collection : unmodified) {
+        const QString path = collection.extendedMetaData(COLLECTION_EXTENDEDMETADATA_KEY_REMOTEPATH).toString();
+        if (disabledPaths.contains(path)) {
+            ++skipped;
+            continue;
+        }
+        const QPair<QString, QString> ctagSyncToken(collection.extendedMetaData(KEY_CTAG).toString(),
+                                                    collection.extendedMetaData(KEY_SYNCTOKEN).toString());
+        if (!remoteCtagSyncToken.contains(path)) {
+            return true;
+        }
+        if ((remoteCtagSyncToken.value(path) != ctagSyncToken && !deferLargeAddressbook(collection))
+                || hasSkippedContacts(collection)) {
+            return true;
+        }
+        collectionIds.insert(collection.id());
+    }
+    if (remoteCtagSyncToken.size() != unmodified.size() - skipped) {
+        return true;
+    }
+    return hasLocalContactChanges(collectionIds);
+}
+
+bool Syncer::hasLocalContactChanges(const QSet<QContactCollectionId> &collectionIds) const
+{
+    if (collectionIds.isEmpty()) {
+        return false;
+    }
+
+    // only the ids of locally changed contacts are queried, which is cheap.
+    QContactCollectionFilter collectionFilter;
+    collectionFilter.setCollectionIds(collectionIds);
+    const QList<QContactStatusFlags::Flag> changeFlags {
+        QContactStatusFlags::IsAdded, QContactStatusFlags::IsModified, QContactStatusFlags::IsDeleted
+    };
+    for (QContactStatusFlags::Flag flag : changeFlags) {
+        if (!m_contactManager.contactIds(collectionFilter & QContactStatusFlags::matchFlag(flag)).isEmpty()) {
+            return true;
+        }
     }
+    return false;
 }
 
 bool Syncer::determineRemoteCollections()
 {
-    m_cardDav->determineAddressbooksList();
-    connect(m_cardDav, &CardDav::addressbooksList, this, [this] (const QList<ReplyParser::AddressBookInformation> &infos) {
-        QStringList paths;
+    requestAddressbooksList([this] (const QList<ReplyParser::AddressBookInformation> &listed) {
+        const QList<ReplyParser::AddressBookInformation> infos = enabledAddressbooks(listed);
+        QSet<QString> paths;
         QList<QContactCollection> addressbooks;
         for (QList<ReplyParser::AddressBookInformation>::const_iterator it = infos.constBegin(); it != infos.constEnd(); ++it) {
             if (!paths.contains(it->url)) {
-                paths.append(it->url);
+                paths.insert(it->url);
                 QContactCollection addressbook;
                 addressbook.setMetaData(QContactCollection::KeyName, it->displayName);
                 addressbook.setExtendedMetaData(COLLECTION_EXTENDEDMETADATA_KEY_AGGREGABLE, true);
@@ -145,11 +911,14 @@ bool Syncer::determineRemoteCollections()
                 addressbook.setExtendedMetaData(COLLECTION_EXTENDEDMETADATA_KEY_READONLY, it->readOnly);
                 addressbook.setExtendedMetaData(KEY_CTAG, it->ctag);
                 addressbook.setExtendedMetaData(KEY_SYNCTOKEN, it->syncToken);
+                deferAggregation(&addressbook);
                 addressbooks.append(addressbook);
             }
         }
+        prioritizeAddressbooks(&addressbooks);
+        m_cardDav->prefetchContactListings(addressbooks);
         remoteCollectionsDetermined(addressbooks);
-    }, Qt::UniqueConnection);
+    });
     return true;
 }
 
@@ -160,16 +929,21 @@ bool Syncer::determineRemoteCollectionChanges(
         const QList<QContactCollection> &locallyUnmodifiedCollections,
         QContactManager::Error *)
 {
-    m_cardDav->determineAddressbooksList();
-    connect(m_cardDav, &CardDav::addressbooksList, this,
+    requestAddressbooksList(
             [this, locallyAddedCollections, locallyModifiedCollections,
              locallyRemovedCollections, locallyUnmodifiedCollections]
             (const QList<ReplyParser::AddressBookInformation> &infos) {
-        // create a list of collections from the addressbooks information
+        // create a list of collections from the addressbooks information.
+        // Disabled addressbooks are skipped, but as they still exist on the
+        // server, their local data is not removed.
         QHash<QString, QContactCollection> remoteCollections;
+        QSet<QString> disabledPaths;
         for (QList<ReplyParser::AddressBookInformation>::const_iterator it = infos.constBegin(); it != infos.constEnd(); ++it) {
             const QString path = it->url;
-            if (!remoteCollections.contains(path)) {
+            if (m_disabledAddressbooks.contains(path)) {
+                qCDebug(lcCardDav) << Q_FUNC_INFO << "skipping disabled addressbook" << path;
+                disabledPaths.insert(path);
+            } else if (!remoteCollections.contains(path)) {
                 QContactCollection addressbook;
                 addressbook.setMetaData(QContactCollection::KeyName, it->displayName);
                 addressbook.setExtendedMetaData(COLLECTION_EXTENDEDMETADATA_KEY_AGGREGABLE, true);
@@ -193,6 +967,7 @@ bool Syncer::determineRemoteCollectionChanges(
         QList<QContactCollection> remotelyUnmodifiedCollections;
         auto comparisonMethod = [this,
                                  &remoteCollections,
+                                 &disabledPaths,
                                  &remotelyAddedCollections,
                                  &remotelyModifiedCollections,
                                  &remotelyRemovedCollections,
@@ -200,7 +975,7 @@ bool Syncer::determineRemoteCollectionChanges(
                                  (const QList<QContactCollection> &localCollections) {
             for (const QContactCollection &local : localCollections) {
                 const QString path = local.extendedMetaData(COLLECTION_EXTENDEDMETADATA_KEY_REMOTEPATH).toString();
-                if (!path.isEmpty()) {
+                if (!path.isEmpty() && !disabledPaths.contains(path)) {
                     if (!remoteCollections.contains(path)) {
                         // remote deletion
                         remotelyRemovedCollections.append(local);
@@ -212,7 +987,9 @@ bool Syncer::determineRemoteCollectionChanges(
                         m_previousCtagSyncToken.insert(path, qMakePair(prevCtag, prevSyncToken));
                         const QString remoteCtag = remoteCollections.value(path).extendedMetaData(KEY_CTAG).toString();
                         const QString remoteSyncToken = remoteCollections.value(path).extendedMetaData(KEY_SYNCTOKEN).toString();
-                        if (prevCtag != remoteCtag || prevSyncToken != remoteSyncToken) {
+                        if (((prevCtag != remoteCtag || prevSyncToken != remoteSyncToken)
+                                    && !deferLargeAddressbook(local))
+                                || hasSkippedContacts(local)) {
                             // we assume that the only remote modification is the ctag/synctoken values.
                             // in future: sync more information (color etc) and detect changes.
                             remoteCollections.remove(path);
@@ -221,7 +998,8 @@ bool Syncer::determineRemoteCollectionChanges(
                             remoteMod.setExtendedMetaData(KEY_SYNCTOKEN, remoteSyncToken);
                             remotelyModifiedCollections.append(remoteMod);
                         } else {
-                            // we assume that the remote collection is unmodified.
+                            // we assume that the remote collection is unmodified,
+                            // or its changes are deferred to a later sync (if it is large).
                             remoteCollections.remove(path);
                             QContactCollection remoteUnmod = local; // need id etc.
                             remotelyUnmodifiedCollections.append(remoteUnmod);
@@ -240,22 +1018,37 @@ bool Syncer::determineRemoteCollectionChanges(
 
         // any collections left in the remoteCollections hash must be new/added remotely.
         remotelyAddedCollections.append(remoteCollections.values());
+        for (QContactCollection &addressbook : remotelyAddedCollections) {
+            deferAggregation(&addressbook);
+        }
+        prioritizeAddressbooks(&remotelyAddedCollections);
+        prioritizeAddressbooks(&remotelyModifiedCollections);
+
+        // the contacts of the added and modified collections will be listed,
+        // ranked together so that e.g. a prioritized modified addressbook is
+        // listed before a new one of unknown size.
+        QList<QContactCollection> listedCollections = remotelyAddedCollections + remotelyModifiedCollections;
+        prioritizeAddressbooks(&listedCollections);
+        m_cardDav->prefetchContactListings(listedCollections);
 
         // finished determining remote collection changes.
         remoteCollectionChangesDetermined(remotelyAddedCollections, remotelyModifiedCollections,
                                           remotelyRemovedCollections, remotelyUnmodifiedCollections);
-    }, Qt::UniqueConnection);
+    });
 
     return true;
 }
 
 bool Syncer::determineRemoteContacts(const QContactCollection &collection)
 {
-    // don't attempt any delta detection, so pass in null ctag/syncToken values.
+    // don't attempt any delta detection, so pass in null previous ctag/syncToken values.
+    // the current sync token allows the server to report the contents a page at a time.
     const QString remotePath = collection.extendedMetaData(COLLECTION_EXTENDEDMETADATA_KEY_REMOTEPATH).toString();
+    const QString syncToken = collection.extendedMetaData(KEY_SYNCTOKEN).toString();
+    const QString ctag = collection.extendedMetaData(KEY_CTAG).toString();
     m_currentCollections.insert(remotePath, collection);
     // will call remoteContactsDetermined() when complete.
-    return m_cardDav->downsyncAddressbookContent(remotePath, QString(), QString(), QString(), QString());
+    return m_cardDav->downsyncAddressbookContent(remotePath, syncToken, ctag, QString(), QString());
 }
 
 bool Syncer::determineRemoteContactChanges(
@@ -272,27 +1065,39 @@ bool Syncer::determineRemoteContactChanges(
     const QString oldSyncToken = m_previousCtagSyncToken.value(remotePath).second;
     const QString oldCtag = m_previousCtagSyncToken.value(remotePath).first;
 
-    // build a set of known contact uris/etags for use by the parser to determine delta.
-    QHash<QString, QString> contactUrisEtags;
-    auto builder = [&contactUrisEtags] (const QList<QContact> &contacts) {
-        for (const QContact &c : contacts) {
+    // index the local contacts by uri.  the index is shared by the delta
+    // detection, the change calculation and the upsync of this addressbook.
+    ReplyParser::LocalContactIndex index;
+    index.reserve(localAddedContacts.size() + localModifiedContacts.size()
+                  + localDeletedContacts.size() + localUnmodifiedContacts.size());
+    auto indexer = [&index] (const QList<QContact> &contacts, ReplyParser::LocalContactInformation::ChangeType changeType) {
+        for (int i = 0; i < contacts.size(); ++i) {
+            const QContact &c(contacts.at(i));
             const QString uri = c.detail<QContactSyncTarget>().syncTarget();
-            if (!uri.isEmpty()) {
-                const QList<QContactExtendedDetail> dets = c.details<QContactExtendedDetail>();
-                for (const QContactExtendedDetail &d : dets) {
-                    if (d.name() == KEY_ETAG) {
-                        contactUrisEtags.insert(uri, d.data().toString());
-                        break;
-                    }
+            if (uri.isEmpty() || index.contains(uri)) {
+                continue;
+            }
+            ReplyParser::LocalContactInformation info;
+            info.id = c.id();
+            info.changeType = changeType;
+            info.position = i;
+            const QList<QContactExtendedDetail> dets = c.details<QContactExtendedDetail>();
+            for (const QContactExtendedDetail &d : dets) {
+                if (d.name() == KEY_ETAG) {
+                    info.etag = d.data().toString();
+                } else if (d.name() == KEY_UNSUPPORTEDPROPERTIES) {
+                    info.unsupportedProperties = d.data().toStringList();
                 }
             }
+            index.insert(uri, info);
         }
     };
-    builder(localModifiedContacts);
-    builder(localDeletedContacts);
-    builder(localUnmodifiedContacts);
+    indexer(localAddedContacts, ReplyParser::LocalContactInformation::Added);
+    indexer(localModifiedContacts, ReplyParser::LocalContactInformation::Modified);
+    indexer(localDeletedContacts, ReplyParser::LocalContactInformation::Removed);
+    indexer(localUnmodifiedContacts, ReplyParser::LocalContactInformation::Unmodified);
 
-    m_localContactUrisEtags.insert(remotePath, contactUrisEtags);
+    m_localContactIndex.insert(remotePath, index);
     m_currentCollections.insert(remotePath, collection);
 
     // will call remoteContactChangesDetermined() when complete.
@@ -344,20 +1149,63 @@ bool Syncer::storeLocalChangesRemotely(
 void Syncer::syncFinishedSuccessfully()
 {
     qCDebug(lcCardDav) << Q_FUNC_INFO << "CardDAV sync with account" << m_accountId << "finished successfully!";
-    emit syncSucceeded();
+    qCDebug(lcCardDav) << Q_FUNC_INFO << "sync stages:" << syncStageSummary();
+    writeSyncStateSnapshots();
+    releaseSyncState();
+    // emits syncSucceeded() once the contacts of new addressbooks are aggregated.
+    aggregateDeferredCollections();
 }
 
 void Syncer::syncFinishedWithError()
 {
+    qCDebug(lcCardDav) << Q_FUNC_INFO << "sync stages:" << syncStageSummary();
+    releaseSyncState();
     emit syncFailed();
 }
 
+void Syncer::releaseSyncState()
+{
+    // the per-collection state of this sync cycle is no longer required,
+    // so release it all at once rather than when the syncer is destroyed.
+    m_remoteChanges.clear();
+    m_completeListings.clear();
+    m_syncStateSnapshots.clear();
+    m_localContactIndex.clear();
+    m_collectionAMRU.clear();
+    m_preflightAddressbooks.clear();
+    m_havePreflightAddressbooks = false;
+    if (m_cardDav) {
+        m_cardDav->releasePrefetchedListings();
+    }
+}
+
+void Syncer::writeSyncStateSnapshots()
+{
+    // the complete contact listings of this sync, updated with the upsynced
+    // changes, become the snapshots against which the listings of the next
+    // sync are compared.
+    for (QHash<QString, QHash<QString, QString> >::const_iterator it = m_syncStateSnapshots.constBegin();
+            it != m_syncStateSnapshots.constEnd(); ++it) {
+        QVector<SyncStateSnapshot::Entry> entries;
+        entries.reserve(it->size());
+        for (QHash<QString, QString>::const_iterator contact = it->constBegin(); contact != it->constEnd(); ++contact) {
+            SyncStateSnapshot::Entry entry;
+            entry.uri = contact.key();
+            entry.etag = contact.value();
+            entries.append(entry);
+        }
+        SyncStateSnapshot::write(SyncStateSnapshot::filePath(m_accountId, it.key()), entries);
+    }
+}
+
 void Syncer::cardDavError(int errorCode)
 {
     qCWarning(lcCardDav) << "CardDAV sync for account: " << m_accountId << " finished with error:" << errorCode;
     m_syncError = true;
     if (errorCode == HTTP_UNAUTHORIZED_ACCESS) {
         m_auth->setCredentialsNeedUpdate(m_accountId);
+        // the credentials will change, and may resolve to a different principal.
+        clearDiscoveryCache();
     }
     QMetaObject::invokeMethod(this, "syncFailed", Qt::QueuedConnection);
 }
@@ -385,5 +1233,6 @@ void Syncer::purgeAccount(int accountId)
         return;
     }
 
+    SyncStateSnapshot::removeAll(accountId);
     qCDebug(lcCardDav) << Q_FUNC_INFO << "Purged contacts for account: " << accountId;
 }
@@ -24,16 +24,22 @@
 #define SYNCER_P_H
 
 #include "replyparser_p.h"
+#include "remotecontactchanges_p.h"
 
 #include <twowaycontactsyncadaptor.h>
 
 #include <QObject>
 #include <QDateTime>
+#include <QElapsedTimer>
 #include <QString>
+#include <QStringList>
 #include <QList>
 #include <QPair>
+#include <QSet>
 #include <QNetworkAccessManager>
 
+#include <functional>
+
 #include <QContactManager>
 #include <QContact>
 #include <QContactCollection>
@@ -55,13 +61,37 @@ public:
     Syncer(QObject *parent, Buteo::SyncProfile *profile, int accountId);
    ~Syncer();
 
+    enum SyncTier {
+        FullSyncTier = 0,   // all contact data is synced
+        MeteredSyncTier     // large vCards are postponed, and bytes per run are bounded
+    };
+
+    // the stages through which downsynced contact data passes.
+    enum SyncStage {
+        ReceiveStage = 0,   // multiget responses received from the server
+        ParseStage,         // XML parsed into responses
+        ConvertStage,       // vCards converted into contacts
+        StoreStage,         // changes stored locally, in batches or by the adaptor
+        SyncStageCount
+    };
+
     void startSync(int accountId);
     void purgeAccount(int accountId);
     void abortSync();
+    QString requestTimeoutSummary() const;
+    void recordSyncStage(SyncStage stage, qint64 items, qint64 bytes, qint64 nsecs);
+    QString syncStageSummary() const;
+    static QString syncStageName(SyncStage stage);
+    void updateSyncTier();
+    SyncTier syncTier() const { return m_syncTier; }
+
+    // allows the network to be emulated in tests.
+    void setNetworkAccessManager(QNetworkAccessManager *qnam);
 
 Q_SIGNALS:
     void syncSucceeded();
     void syncFailed();
+    void contactsAggregated(int count);
 
 protected:
     // implementing the TWCSA interface
@@ -93,19 +123,106 @@ private Q_SLOTS:
     void sync(const QString &serverUrl, const QString &addressbookPath, const QString &username, const QString &password, const QString &accessToken, bool ignoreSslErrors);
     void signInError();
     void cardDavError(int errorCode = 0);
+    void addressbooksListed(const QList<ReplyParser::AddressBookInformation> &infos);
+    void aggregateNextBatch();
 
 private:
+    void requestAddressbooksList(const std::function<void (const QList<ReplyParser::AddressBookInformation> &)> &handler);
+    bool preflightDetectsChanges(const QList<ReplyParser::AddressBookInformation> &infos,
+                                 QStringList *unversionedAddressbooks);
+    bool hasLocalContactChanges(const QSet<QContactCollectionId> &collectionIds) const;
+    void writeSyncStateSnapshots();
+    void releaseSyncState();
+    void loadSettings();
+    void deferAggregation(QContactCollection *collection) const;
+    void aggregateDeferredCollections();
+    bool storeRemoteAdditions(const QString &addressbookUrl, QList<QContact> *contacts);
+    int remainingRunBudget() const;
+    qint64 maxVCardSize() const;
+    qint64 maxBufferedVCardSize() const;
+    bool hasSkippedContacts(const QContactCollection &addressbook) const;
+    qint64 maxBufferedBytes() const;
+    void loadAddressbookSettings();
+    QList<ReplyParser::AddressBookInformation> enabledAddressbooks(const QList<ReplyParser::AddressBookInformation> &infos) const;
+    void prioritizeAddressbooks(QList<QContactCollection> *addressbooks) const;
+    bool deferLargeAddressbook(const QContactCollection &addressbook) const;
+    void recordAddressbookDownsync(const QString &addressbookUrl, int contactCount);
+    static bool isMeteredConnection();
+    void loadServerCapabilities();
+    void storeServerCapabilities(const QStringList &capabilities);
+    void removeServerCapability(const QString &capability);
+    QString discoveryCacheFingerprint() const;
+    bool loadDiscoveryCache(QString *serverUrl, QString *principalPath, QString *homeSetPath) const;
+    void storeDiscoveryCache(const QString &serverUrl, const QString &principalPath, const QString &homeSetPath);
+    void clearDiscoveryCache();
+
     friend class CardDav;
     friend class RequestGenerator;
     friend class ReplyParser;
     friend class tst_replyparser;
+    friend class tst_syncer;
+    friend class tst_networkemulator;
     Buteo::SyncProfile *m_syncProfile;
     CardDav *m_cardDav;
     Auth *m_auth;
     QContactManager m_contactManager;
-    QNetworkAccessManager m_qnam;
+    QNetworkAccessManager m_defaultQnam;
+    QNetworkAccessManager *m_qnam;
     bool m_syncAborted;
     bool m_syncError;
+    QHash<int, int> m_requestTimeouts; // request phase to number of timed out requests
+
+    // throughput of each stage, to determine which stage limits the sync with a given server.
+    struct SyncStageStatistics {
+        qint64 items = 0;
+        qint64 bytes = 0;
+        qint64 nsecs = 0;
+    };
+    SyncStageStatistics m_syncStageStatistics[SyncStageCount];
+
+    // on metered connections, only a bounded amount of contact data is downloaded per run.
+    SyncTier m_syncTier;
+    QString m_syncTierSetting; // "auto", "full" or "metered"
+    qint64 m_meteredByteBudget;
+    qint64 m_meteredMaxVCardSize;
+    qint64 m_downloadedBytes;
+
+    // the contact listings of several addressbooks, and several pages of
+    // contacts, may be requested concurrently, up to this many at a time.
+    int m_maxConcurrentListings;
+
+    // remote additions are stored in batches as they are downsynced, to bound memory usage.
+    int m_storeBatchSize;
+
+    // the contacts of new addressbooks are aggregated in batches before the sync is reported as succeeded.
+    bool m_bulkImport;
+    QList<QContactCollection> m_deferredAggregations;
+    QList<QContactId> m_aggregationContactIds; // of the first deferred collection, yet to be aggregated
+
+    // optional bounds on the work done per run, after which the remaining contacts are postponed.
+    int m_maxContactsPerRun;
+    int m_maxSecondsPerRun;
+    int m_fetchedContacts;
+    QElapsedTimer m_syncTimer;
+
+    // a memory-bounded sync limits the contact data held at any time, for low-memory devices.
+    qint64 m_memoryBudget;
+
+    // addressbooks may be disabled or prioritized via the sync profile,
+    // and large addressbooks may be downsynced less often than the others.
+    QSet<QString> m_disabledAddressbooks;
+    QHash<QString, int> m_addressbookPriorities; // uri to rank, lower ranks are synced first
+    int m_largeAddressbookSize;
+    int m_largeAddressbookInterval; // in hours, or zero to downsync large addressbooks on every run
+
+    // capabilities of the server, probed once and cached in the account settings.
+    QStringList m_serverCapabilities;
+    bool m_serverCapabilitiesProbed;
+
+    // the addressbook listing is fetched once per sync, before the adaptor cycle.
+    std::function<void (const QList<ReplyParser::AddressBookInformation> &)> m_addressbooksListHandler;
+    QList<ReplyParser::AddressBookInformation> m_preflightAddressbooks;
+    bool m_havePreflightAddressbooks;
 
     // auth related
     int m_accountId;
@@ -119,13 +236,11 @@ private:
     // the ctag and sync token for each particular addressbook, as stored during the previous sync cycle.
     QHash<QString, QPair<QString, QString> > m_previousCtagSyncToken; // uri to ctag+synctoken.
     QHash<QString, QContactCollection> m_currentCollections;
-    QHash<QString, QHash<QString, QString> > m_localContactUrisEtags;
+    QHash<QString, ReplyParser::LocalContactIndex> m_localContactIndex; // collection uri to local contacts
 
-    // colletion uri to contact uri (sync target) to contact info
-    QHash<QString, QHash<QString, ReplyParser::ContactInformation> > m_remoteAdditions;
-    QHash<QString, QHash<QString, ReplyParser::ContactInformation> > m_remoteModifications;
-    QHash<QString, QHash<QString, ReplyParser::ContactInformation> > m_remoteRemovals;
-    QHash<QString, QHash<QString, ReplyParser::ContactInformation> > m_remoteUnmodified;
+    QHash<QString, RemoteContactChanges> m_remoteChanges; // collection uri to remote contact A/M/R/U
+    QSet<QString> m_completeListings; // collection uris whose contacts were listed in full
+    QHash<QString, QHash<QString, QString> > m_syncStateSnapshots; // collection uri to contact uri to etag, after the upsync
 
     // for change detection
     struct AMRU {
@@ -133,6 +248,13 @@ private:
         QList<QContact> modified;
         QList<QContact> removed;
         QList<QContact> unmodified;
+
+        const QList<QContact> &contacts(ReplyParser::LocalContactInformation::ChangeType changeType) const {
+            return changeType == ReplyParser::LocalContactInformation::Added ? added
+                 : changeType == ReplyParser::LocalContactInformation::Modified ? modified
+                 : changeType == ReplyParser::LocalContactInformation::Removed ? removed
+                 : unmodified;
+        }
     };
     QHash<QString, AMRU> m_collectionAMRU; // collection uri to AMRU
 };
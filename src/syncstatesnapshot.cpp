@@ -0,0 +1,245 @@
+/*
+ * This file is part of buteo-sync-plugin-carddav package
+ *
+ * Copyright (C) 2026 Jolla Ltd.
+ *
+ * This program/library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 2.1 as published by the Free Software Foundation.
+ *
+ * This program/library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this program/library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+
+#include "syncstatesnapshot_p.h"
+#include "logging.h"
+
+#include <QByteArray>
+#include <QCryptographicHash>
+#include <QDir>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QStandardPaths>
+
+#include <algorithm>
+#include <string.h>
+#include <limits.h>
+
+namespace {
+    const char Magic[4] = { 'C', 'D', 'S', 'S' };
+    const QString Suffix = QStringLiteral(".snapshot");
+    const quint32 Version = 2;
+
+    struct Header {
+        char magic[4];
+        quint32 version;
+        quint32 count;
+        quint32 stringsSize;
+    };
+
+    struct EncodedEntry {
+        QByteArray uri;
+        QByteArray etag;
+    };
+
+    int compareUtf8(const char *lhs, int lhsLength, const char *rhs, int rhsLength)
+    {
+        const int cmp = memcmp(lhs, rhs, qMin(lhsLength, rhsLength));
+        return cmp != 0 ? cmp : lhsLength - rhsLength;
+    }
+}
+
+SyncStateSnapshot::SyncStateSnapshot()
+    : m_data(nullptr)
+    , m_strings(nullptr)
+    , m_stringsSize(0)
+    , m_count(0)
+{
+}
+
+SyncStateSnapshot::~SyncStateSnapshot()
+{
+    close();
+}
+
+QString SyncStateSnapshot::filePath(int accountId, const QString &addressbookUrl)
+{
+    const QByteArray name = QCryptographicHash::hash(addressbookUrl.toUtf8(), QCryptographicHash::Sha1).toHex();
+    return directoryPath(accountId) + QLatin1Char('/') + QString::fromLatin1(name) + Suffix;
+}
+
+void SyncStateSnapshot::removeAll(int accountId)
+{
+    QDir(directoryPath(accountId)).removeRecursively();
+}
+
+QString SyncStateSnapshot::directoryPath(int accountId)
+{
+    // the snapshots can be regenerated by a full sync, so they are kept as cache data.
+    return QStringLiteral("%1/buteo-sync-plugin-carddav/%2")
+            .arg(QStandardPaths::writableLocation(QStandardPaths::GenericCacheLocation))
+            .arg(accountId);
+}
+
+bool SyncStateSnapshot::write(const QString &path, const QVector<Entry> &entries)
+{
+    QVector<EncodedEntry> encoded;
+    encoded.reserve(entries.size());
+    quint64 stringsSize = 0;
+    for (const Entry &entry : entries) {
+        EncodedEntry e = { entry.uri.toUtf8(), entry.etag.toUtf8() };
+        stringsSize += e.uri.size() + e.etag.size();
+        encoded.append(e);
+    }
+    if (stringsSize > 0xffffffffu) {
+        return false;
+    }
+
+    // sorted by the UTF-8 bytes of the uri, as compared by find().
+    std::sort(encoded.begin(), encoded.end(), [] (const EncodedEntry &lhs, const EncodedEntry &rhs) {
+        return compareUtf8(lhs.uri.constData(), lhs.uri.size(), rhs.uri.constData(), rhs.uri.size()) < 0;
+    });
+
+    Header header;
+    memcpy(header.magic, Magic, sizeof(Magic));
+    header.version = Version;
+    header.count = encoded.size();
+    header.stringsSize = stringsSize;
+
+    QByteArray records;
+    records.reserve(encoded.size() * sizeof(Record));
+    QByteArray strings;
+    strings.reserve(stringsSize);
+    for (const EncodedEntry &e : encoded) {
+        Record record;
+        record.uriOffset = strings.size();
+        record.uriLength = e.uri.size();
+        strings.append(e.uri);
+        record.etagOffset = strings.size();
+        record.etagLength = e.etag.size();
+        strings.append(e.etag);
+        records.append(reinterpret_cast<const char *>(&record), sizeof(Record));
+    }
+
+    if (!QDir().mkpath(QFileInfo(path).absolutePath())) {
+        qCWarning(lcCardDav) << Q_FUNC_INFO << "unable to create directory for sync state snapshot:" << path;
+        return false;
+    }
+
+    QSaveFile file(path);
+    if (!file.open(QIODevice::WriteOnly)
+            || file.write(reinterpret_cast<const char *>(&header), sizeof(Header)) != sizeof(Header)
+            || file.write(records) != records.size()
+            || file.write(strings) != strings.size()
+            || !file.commit()) {
+        qCWarning(lcCardDav) << Q_FUNC_INFO << "unable to write sync state snapshot:" << path << file.errorString();
+        return false;
+    }
+
+    return true;
+}
+
+bool SyncStateSnapshot::open(const QString &path)
+{
+    close();
+    m_file.setFileName(path);
+    if (!m_file.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+
+    const qint64 fileSize = m_file.size();
+    if (fileSize < static_cast<qint64>(sizeof(Header))) {
+        close();
+        return false;
+    }
+
+    const uchar *data = m_file.map(0, fileSize);
+    if (!data) {
+        close();
+        return false;
+    }
+
+    Header header;
+    memcpy(&header, data, sizeof(Header));
+    const quint64 expectedSize = sizeof(Header) + quint64(header.count) * sizeof(Record) + header.stringsSize;
+    if (memcmp(header.magic, Magic, sizeof(Magic)) != 0
+            || header.version != Version
+            || header.count > INT_MAX
+            || expectedSize != static_cast<quint64>(fileSize)) {
+        qCWarning(lcCardDav) << Q_FUNC_INFO << "ignoring invalid sync state snapshot:" << path;
+        m_file.unmap(const_cast<uchar *>(data));
+        close();
+        return false;
+    }
+
+    m_data = data;
+    m_count = header.count;
+    m_strings = reinterpret_cast<const char *>(data) + sizeof(Header) + m_count * sizeof(Record);
+    m_stringsSize = header.stringsSize;
+
+    // reject records which refer outside of the strings.
+    for (int i = 0; i < m_count; ++i) {
+        const Record &r(record(i));
+        if (quint64(r.uriOffset) + r.uriLength > m_stringsSize
+                || quint64(r.etagOffset) + r.etagLength > m_stringsSize) {
+            qCWarning(lcCardDav) << Q_FUNC_INFO << "ignoring corrupted sync state snapshot:" << path;
+            close();
+            return false;
+        }
+    }
+
+    return true;
+}
+
+void SyncStateSnapshot::close()
+{
+    if (m_data) {
+        m_file.unmap(const_cast<uchar *>(m_data));
+    }
+    m_file.close();
+    m_data = nullptr;
+    m_strings = nullptr;
+    m_stringsSize = 0;
+    m_count = 0;
+}
+
+bool SyncStateSnapshot::find(const QString &uri, QString *etag) const
+{
+    const QByteArray key = uri.toUtf8();
+    int lower = 0;
+    int upper = m_count;
+    while (lower < upper) {
+        const int middle = lower + (upper - lower) / 2;
+        const Record &r(record(middle));
+        const int cmp = compareUtf8(m_strings + r.uriOffset, r.uriLength, key.constData(), key.size());
+        if (cmp == 0) {
+            if (etag) {
+                *etag = string(r.etagOffset, r.etagLength);
+            }
+            return true;
+        } else if (cmp < 0) {
+            lower = middle + 1;
+        } else {
+            upper = middle;
+        }
+    }
+    return false;
+}
+
+const SyncStateSnapshot::Record &SyncStateSnapshot::record(int index) const
+{
+    return reinterpret_cast<const Record *>(m_data + sizeof(Header))[index];
+}
+
+QString SyncStateSnapshot::string(quint32 offset, quint32 length) const
+{
+    return QString::fromUtf8(m_strings + offset, length);
+}
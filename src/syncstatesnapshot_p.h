@@ -0,0 +1,77 @@
+/*
+ * This file is part of buteo-sync-plugin-carddav package
+ *
+ * Copyright (C) 2026 Jolla Ltd.
+ *
+ * This program/library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 2.1 as published by the Free Software Foundation.
+ *
+ * This program/library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this program/library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+
+#ifndef SYNCSTATESNAPSHOT_P_H
+#define SYNCSTATESNAPSHOT_P_H
+
+#include <QFile>
+#include <QString>
+#include <QVector>
+
+// The contacts of an addressbook as of the last successful sync, i.e.
+// the etag of each contact uri.
+//
+// The snapshot is stored as a table of fixed-size records sorted by uri,
+// followed by the UTF-8 strings they refer to.  The file is memory-mapped
+// when read, so that a server listing can be compared against it without
+// loading the local contacts, or even the whole snapshot, into memory.
+class SyncStateSnapshot
+{
+public:
+    struct Entry {
+        QString uri;
+        QString etag;
+    };
+
+    SyncStateSnapshot();
+    ~SyncStateSnapshot();
+
+    static QString filePath(int accountId, const QString &addressbookUrl);
+    static bool write(const QString &path, const QVector<Entry> &entries);
+    static void removeAll(int accountId);
+
+    bool open(const QString &path);
+    void close();
+    bool isOpen() const { return m_data != nullptr; }
+
+    int size() const { return m_count; }
+    bool find(const QString &uri, QString *etag) const;
+
+private:
+    struct Record {
+        quint32 uriOffset;
+        quint32 uriLength;
+        quint32 etagOffset;
+        quint32 etagLength;
+    };
+
+    static QString directoryPath(int accountId);
+    const Record &record(int index) const;
+    QString string(quint32 offset, quint32 length) const;
+
+    QFile m_file;
+    const uchar *m_data;
+    const char *m_strings;
+    quint32 m_stringsSize;
+    int m_count;
+};
+
+#endif // SYNCSTATESNAPSHOT_P_H
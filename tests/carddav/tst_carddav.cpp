@@ -0,0 +1,129 @@
+#include <QtTest>
+#include <QObject>
+#include <QString>
+
+#include "carddav_p.h"
+
+#include <QContact>
+#include <QContactName>
+#include <QContactSyncTarget>
+
+QTCONTACTS_USE_NAMESPACE
+
+namespace {
+
+QList<QContact> downsyncedModifications(int count, ReplyParser::LocalContactIndex *localContacts)
+{
+    QList<QContact> contacts;
+    contacts.reserve(count);
+    for (int i = 0; i < count; ++i) {
+        const QString uri = QStringLiteral("/addressbooks/johndoe/contacts/%1.vcf").arg(i);
+        QContact c;
+        QContactSyncTarget st;
+        st.setSyncTarget(uri);
+        c.saveDetail(&st);
+        QContactName name;
+        name.setFirstName(QStringLiteral("First%1").arg(i));
+        name.setLastName(QStringLiteral("Last%1").arg(i));
+        c.saveDetail(&name);
+        contacts.append(c);
+
+        ReplyParser::LocalContactInformation info;
+        info.id = QContactId(QStringLiteral("qtcontacts:org.nemomobile.contacts.sqlite:"),
+                             QByteArray("sql-") + QByteArray::number(i + 1));
+        info.changeType = ReplyParser::LocalContactInformation::Modified;
+        info.position = i;
+        localContacts->insert(uri, info);
+    }
+    return contacts;
+}
+
+}
+
+class tst_carddav : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void setLocalContactIds();
+    void setLocalContactIdsBenchmark();
+
+    void listingType_data();
+    void listingType();
+};
+
+void tst_carddav::setLocalContactIds()
+{
+    ReplyParser::LocalContactIndex localContacts;
+    QList<QContact> contacts = downsyncedModifications(3, &localContacts);
+    QContact unknown;
+    QContactSyncTarget st;
+    st.setSyncTarget(QStringLiteral("/addressbooks/johndoe/contacts/unknown.vcf"));
+    unknown.saveDetail(&st);
+    contacts.append(unknown);
+
+    CardDav::setLocalContactIds(&contacts, localContacts);
+    QCOMPARE(contacts.size(), 4);
+    for (int i = 0; i < 3; ++i) {
+        QCOMPARE(contacts.at(i).id(), localContacts.value(contacts.at(i).detail<QContactSyncTarget>().syncTarget()).id);
+    }
+    QVERIFY(contacts.at(3).id().isNull());
+}
+
+void tst_carddav::setLocalContactIdsBenchmark()
+{
+    // the downsynced modifications of a 20k-contact addressbook are
+    // only referenced by the list which is handed to the adaptor, so
+    // their ids are set without copying the list or the contacts.
+    const int count = 20000;
+    ReplyParser::LocalContactIndex localContacts;
+    QList<QContact> contacts = downsyncedModifications(count, &localContacts);
+    QBENCHMARK {
+        CardDav::setLocalContactIds(&contacts, localContacts);
+    }
+}
+
+void tst_carddav::listingType_data()
+{
+    QTest::addColumn<QString>("newSyncToken");
+    QTest::addColumn<QString>("newCtag");
+    QTest::addColumn<QString>("oldSyncToken");
+    QTest::addColumn<QString>("oldCtag");
+    QTest::addColumn<int>("expectedType");
+
+    QTest::newRow("no sync token or ctag")
+        << QString() << QString() << QString() << QString()
+        << static_cast<int>(CardDav::MetadataListing);
+    QTest::newRow("first sync with ctag")
+        << QString() << QStringLiteral("ctag-2") << QString() << QString()
+        << static_cast<int>(CardDav::MetadataListing);
+    QTest::newRow("changed ctag")
+        << QString() << QStringLiteral("ctag-2") << QString() << QStringLiteral("ctag-1")
+        << static_cast<int>(CardDav::MetadataListing);
+    QTest::newRow("unchanged ctag")
+        << QString() << QStringLiteral("ctag-1") << QString() << QStringLiteral("ctag-1")
+        << static_cast<int>(CardDav::NoListing);
+    QTest::newRow("first sync with sync token")
+        << QStringLiteral("token-2") << QStringLiteral("ctag-2") << QString() << QString()
+        << static_cast<int>(CardDav::FullDeltaListing);
+    QTest::newRow("changed sync token")
+        << QStringLiteral("token-2") << QStringLiteral("ctag-2") << QStringLiteral("token-1") << QStringLiteral("ctag-1")
+        << static_cast<int>(CardDav::DeltaListing);
+    QTest::newRow("unchanged sync token")
+        << QStringLiteral("token-1") << QStringLiteral("ctag-2") << QStringLiteral("token-1") << QStringLiteral("ctag-1")
+        << static_cast<int>(CardDav::NoListing);
+}
+
+void tst_carddav::listingType()
+{
+    QFETCH(QString, newSyncToken);
+    QFETCH(QString, newCtag);
+    QFETCH(QString, oldSyncToken);
+    QFETCH(QString, oldCtag);
+    QFETCH(int, expectedType);
+
+    QCOMPARE(static_cast<int>(CardDav::listingType(newSyncToken, newCtag, oldSyncToken, oldCtag)), expectedType);
+}
+
+#include "tst_carddav.moc"
+QTEST_MAIN(tst_carddav)
@@ -0,0 +1,208 @@
+/*
+ * This file is part of buteo-sync-plugin-carddav package
+ *
+ * Copyright (C) 2026 Jolla Ltd.
+ *
+ * This program/library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 2.1 as published by the Free Software Foundation.
+ *
+ * This program/library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this program/library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+#include "networkconditionemulator.h"
+
+#include <cstring>
+
+namespace {
+    // responses are delivered in chunks at this interval,
+    // when the bandwidth is limited.
+    const int ChunkInterval = 50; // msecs
+}
+
+NetworkConditionEmulator::NetworkConditionEmulator(QObject *parent)
+    : QNetworkAccessManager(parent)
+{
+}
+
+NetworkConditions NetworkConditionEmulator::conditions() const
+{
+    return m_conditions;
+}
+
+void NetworkConditionEmulator::setConditions(const NetworkConditions &conditions)
+{
+    m_conditions = conditions;
+    m_random.seed(conditions.seed);
+}
+
+QNetworkReply *NetworkConditionEmulator::createRequest(Operation op, const QNetworkRequest &request, QIODevice *outgoingData)
+{
+    QNetworkReply *upstream = QNetworkAccessManager::createRequest(op, request, outgoingData);
+    return new EmulatedReply(upstream, m_conditions, m_random(), this);
+}
+
+EmulatedReply::EmulatedReply(QNetworkReply *upstream, const NetworkConditions &conditions, quint32 seed, QObject *parent)
+    : QNetworkReply(parent)
+    , m_upstream(upstream)
+    , m_conditions(conditions)
+    , m_random(seed)
+    , m_delivered(0)
+    , m_failAt(-1)
+    , m_stalled(false)
+{
+    setRequest(upstream->request());
+    setUrl(upstream->url());
+    setOperation(upstream->operation());
+    open(QIODevice::ReadOnly | QIODevice::Unbuffered);
+
+    m_timer.setSingleShot(true);
+    connect(&m_timer, SIGNAL(timeout()), this, SLOT(deliverChunk()));
+    connect(upstream, SIGNAL(finished()), this, SLOT(upstreamFinished()));
+    connect(upstream, SIGNAL(uploadProgress(qint64,qint64)), this, SIGNAL(uploadProgress(qint64,qint64)));
+    connect(upstream, SIGNAL(sslErrors(QList<QSslError>)), this, SIGNAL(sslErrors(QList<QSslError>)));
+}
+
+void EmulatedReply::abort()
+{
+    if (isFinished()) {
+        return;
+    }
+
+    m_timer.stop();
+    if (m_upstream) {
+        m_upstream->disconnect(this);
+        m_upstream->abort();
+        m_upstream->deleteLater();
+        m_upstream = 0;
+    }
+    m_pending.clear();
+    finish(QNetworkReply::OperationCanceledError, QStringLiteral("Operation canceled"));
+}
+
+qint64 EmulatedReply::bytesAvailable() const
+{
+    return m_buffer.size() + QNetworkReply::bytesAvailable();
+}
+
+bool EmulatedReply::isSequential() const
+{
+    return true;
+}
+
+qint64 EmulatedReply::readData(char *data, qint64 maxSize)
+{
+    if (m_buffer.isEmpty()) {
+        return isFinished() ? -1 : 0;
+    }
+
+    const qint64 count = qMin(maxSize, qint64(m_buffer.size()));
+    memcpy(data, m_buffer.constData(), count);
+    m_buffer.remove(0, count);
+    return count;
+}
+
+void EmulatedReply::upstreamFinished()
+{
+    // take the response metadata from the real reply.
+    for (const QNetworkReply::RawHeaderPair &header : m_upstream->rawHeaderPairs()) {
+        setRawHeader(header.first, header.second);
+    }
+    const QNetworkRequest::Attribute attributes[] = {
+        QNetworkRequest::HttpStatusCodeAttribute,
+        QNetworkRequest::HttpReasonPhraseAttribute,
+        QNetworkRequest::RedirectionTargetAttribute
+    };
+    for (QNetworkRequest::Attribute attribute : attributes) {
+        setAttribute(attribute, m_upstream->attribute(attribute));
+    }
+    setError(m_upstream->error(), m_upstream->errorString());
+
+    m_pending = m_upstream->readAll();
+    m_upstream->deleteLater();
+    m_upstream = 0;
+
+    if (randomChance(m_conditions.errorRate)) {
+        // the connection will be dropped part-way through the response.
+        m_failAt = m_pending.isEmpty() ? 0 : randomDelay(m_pending.size() - 1);
+    }
+
+    m_timer.start(m_conditions.latency + randomDelay(m_conditions.jitter));
+}
+
+void EmulatedReply::deliverChunk()
+{
+    if (!m_stalled && randomChance(m_conditions.stallProbability)) {
+        // deliver nothing for a while.
+        m_stalled = true;
+        m_timer.start(m_conditions.stallDuration);
+        return;
+    }
+    m_stalled = false;
+
+    if (m_delivered == 0) {
+        emit metaDataChanged();
+    }
+
+    qint64 chunkSize = m_conditions.bandwidth > 0
+                     ? qMax(qint64(1), qint64(m_conditions.bandwidth) * ChunkInterval / 1000)
+                     : qint64(m_pending.size());
+    if (m_failAt >= 0) {
+        chunkSize = qMin(chunkSize, m_failAt - m_delivered);
+    }
+
+    if (chunkSize > 0) {
+        m_buffer.append(m_pending.constData(), chunkSize);
+        m_pending.remove(0, chunkSize);
+        m_delivered += chunkSize;
+        emit readyRead();
+        emit downloadProgress(m_delivered, m_delivered + m_pending.size());
+    }
+
+    if (m_failAt >= 0 && m_delivered >= m_failAt) {
+        m_pending.clear();
+        finish(QNetworkReply::RemoteHostClosedError, QStringLiteral("Connection closed (emulated)"));
+    } else if (m_pending.isEmpty()) {
+        finish(error(), errorString());
+    } else {
+        m_timer.start(ChunkInterval + randomDelay(m_conditions.jitter));
+    }
+}
+
+void EmulatedReply::finish(QNetworkReply::NetworkError networkError, const QString &errorString)
+{
+    setError(networkError, errorString);
+    setFinished(true);
+    if (networkError != QNetworkReply::NoError) {
+#if QT_VERSION >= QT_VERSION_CHECK(5, 15, 0)
+        emit errorOccurred(networkError);
+#else
+        emit error(networkError);
+#endif
+    }
+    emit finished();
+}
+
+int EmulatedReply::randomDelay(int maximum)
+{
+    if (maximum <= 0) {
+        return 0;
+    }
+    return std::uniform_int_distribution<int>(0, maximum)(m_random);
+}
+
+bool EmulatedReply::randomChance(double probability)
+{
+    if (probability <= 0.0) {
+        return false;
+    }
+    return std::uniform_real_distribution<double>(0.0, 1.0)(m_random) < probability;
+}
@@ -0,0 +1,98 @@
+/*
+ * This file is part of buteo-sync-plugin-carddav package
+ *
+ * Copyright (C) 2026 Jolla Ltd.
+ *
+ * This program/library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 2.1 as published by the Free Software Foundation.
+ *
+ * This program/library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this program/library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+#ifndef NETWORKCONDITIONEMULATOR_H
+#define NETWORKCONDITIONEMULATOR_H
+
+#include <QNetworkAccessManager>
+#include <QNetworkReply>
+#include <QByteArray>
+#include <QTimer>
+
+#include <random>
+
+// The conditions which are applied to every response.
+// All randomness is derived from the seed, so that runs are repeatable.
+struct NetworkConditions
+{
+    int latency = 0;                // msecs before the response starts to arrive
+    int jitter = 0;                 // maximum random delay added to each chunk, msecs
+    int bandwidth = 0;              // bytes per second, or zero for unlimited
+    double stallProbability = 0.0;  // probability that delivery stalls before each chunk
+    int stallDuration = 0;          // msecs
+    double errorRate = 0.0;         // probability that a response fails part-way
+    quint32 seed = 0;
+};
+
+// A QNetworkAccessManager which performs requests as normal (e.g. against a
+// local server), but delivers the responses as if over a poor network.
+class NetworkConditionEmulator : public QNetworkAccessManager
+{
+    Q_OBJECT
+
+public:
+    explicit NetworkConditionEmulator(QObject *parent = 0);
+
+    NetworkConditions conditions() const;
+    void setConditions(const NetworkConditions &conditions);
+
+protected:
+    QNetworkReply *createRequest(Operation op, const QNetworkRequest &request, QIODevice *outgoingData) override;
+
+private:
+    NetworkConditions m_conditions;
+    std::mt19937 m_random;
+};
+
+class EmulatedReply : public QNetworkReply
+{
+    Q_OBJECT
+
+public:
+    EmulatedReply(QNetworkReply *upstream, const NetworkConditions &conditions, quint32 seed, QObject *parent);
+
+    void abort() override;
+    qint64 bytesAvailable() const override;
+    bool isSequential() const override;
+
+protected:
+    qint64 readData(char *data, qint64 maxSize) override;
+
+private Q_SLOTS:
+    void upstreamFinished();
+    void deliverChunk();
+
+private:
+    void finish(QNetworkReply::NetworkError error, const QString &errorString);
+    int randomDelay(int maximum);
+    bool randomChance(double probability);
+
+    QNetworkReply *m_upstream;
+    NetworkConditions m_conditions;
+    std::mt19937 m_random;
+    QTimer m_timer;
+    QByteArray m_pending;   // received from upstream, not yet delivered
+    QByteArray m_buffer;    // delivered, not yet read
+    qint64 m_delivered;
+    qint64 m_failAt;        // number of bytes after which the response fails, or -1
+    bool m_stalled;
+};
+
+#endif // NETWORKCONDITIONEMULATOR_H
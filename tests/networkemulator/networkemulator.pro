@@ -0,0 +1,8 @@
+TEMPLATE = app
+TARGET = tst_networkemulator
+include($$PWD/../../src/src.pri)
+QT += testlib
+HEADERS += networkconditionemulator.h
+SOURCES += networkconditionemulator.cpp tst_networkemulator.cpp
+target.path = /opt/tests/buteo/plugins/carddav/
+INSTALLS += target
@@ -0,0 +1,286 @@
+#include <QtTest>
+#include <QObject>
+#include <QString>
+#include <QByteArray>
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <QElapsedTimer>
+#include <QPointer>
+#include <QHash>
+
+#include "networkconditionemulator.h"
+#include "requestgenerator_p.h"
+#include "carddav_p.h"
+#include "syncer_p.h"
+
+namespace {
+
+// A minimal HTTP server which responds to every request
+// with the same multistatus response.
+class LocalDavServer : public QTcpServer
+{
+    Q_OBJECT
+
+public:
+    LocalDavServer(const QByteArray &body)
+        : m_body(body)
+    {
+        connect(this, &QTcpServer::newConnection, this, [this] () {
+            while (QTcpSocket *socket = nextPendingConnection()) {
+                connect(socket, &QTcpSocket::readyRead, socket, [this, socket] () {
+                    QByteArray &request(m_requests[socket]);
+                    request.append(socket->readAll());
+                    if (!request.contains("\r\n\r\n")) {
+                        return;
+                    }
+                    m_requests.remove(socket);
+                    m_requestCount += 1;
+                    socket->write("HTTP/1.1 207 Multi-Status\r\n"
+                                  "Content-Type: application/xml; charset=utf-8\r\n"
+                                  "Content-Length: " + QByteArray::number(m_body.size()) + "\r\n"
+                                  "Connection: close\r\n"
+                                  "\r\n");
+                    socket->write(m_body);
+                    socket->disconnectFromHost();
+                });
+                connect(socket, &QTcpSocket::disconnected, socket, &QObject::deleteLater);
+            }
+        });
+    }
+
+    QString url() const
+    {
+        return QStringLiteral("http://127.0.0.1:%1/").arg(serverPort());
+    }
+
+    int requestCount() const
+    {
+        return m_requestCount;
+    }
+
+private:
+    QByteArray m_body;
+    QHash<QTcpSocket *, QByteArray> m_requests; // received until the end of the headers
+    int m_requestCount = 0;
+};
+
+QByteArray multistatusBody(int responses)
+{
+    QByteArray body("<d:multistatus xmlns:d=\"DAV:\">");
+    for (int i = 0; i < responses; ++i) {
+        body.append("<d:response><d:href>/addressbooks/johndoe/contacts/contact-");
+        body.append(QByteArray::number(i));
+        body.append(".vcf</d:href><d:propstat><d:prop><d:getetag>\"0001\"</d:getetag></d:prop>"
+                    "<d:status>HTTP/1.1 200 OK</d:status></d:propstat></d:response>");
+    }
+    body.append("</d:multistatus>");
+    return body;
+}
+
+struct ReplyResult
+{
+    bool finished = false;
+    QNetworkReply::NetworkError error = QNetworkReply::NoError;
+    bool transient = false;
+    QByteArray data;
+};
+
+}
+
+class tst_networkemulator : public QObject
+{
+    Q_OBJECT
+
+public:
+    tst_networkemulator()
+        : m_s(Q_NULLPTR, Q_NULLPTR, 7357) {}
+
+private slots:
+    void init();
+    void cleanup();
+
+    void latency();
+    void bandwidth();
+    void errorRate();
+    void stallTriggersWatchdog();
+    void contactPagesInFlight();
+
+private:
+    void performRequest(RequestGenerator *generator, int timeout, ReplyResult *result);
+
+    Syncer m_s;
+    NetworkConditionEmulator m_emulator;
+    LocalDavServer *m_server = Q_NULLPTR;
+};
+
+void tst_networkemulator::init()
+{
+    m_server = new LocalDavServer(multistatusBody(100));
+    QVERIFY(m_server->listen(QHostAddress::LocalHost));
+    m_s.setNetworkAccessManager(&m_emulator);
+}
+
+void tst_networkemulator::cleanup()
+{
+    m_s.setNetworkAccessManager(Q_NULLPTR);
+    delete m_server;
+    m_server = Q_NULLPTR;
+}
+
+void tst_networkemulator::performRequest(RequestGenerator *generator, int timeout, ReplyResult *result)
+{
+    // the reply deletes itself once finished, so capture the result on completion.
+    QPointer<QNetworkReply> reply = generator->contactEtags(m_server->url(), QStringLiteral("/addressbooks/johndoe/contacts/"));
+    QVERIFY(reply);
+    connect(reply.data(), &QNetworkReply::finished, this, [reply, result] () {
+        result->finished = true;
+        result->error = reply->error();
+        result->transient = RequestGenerator::isTransientError(reply);
+        result->data = reply->readAll();
+    });
+    QElapsedTimer timer;
+    timer.start();
+    while (!result->finished && timer.elapsed() < timeout) {
+        QTest::qWait(10);
+    }
+    if (reply) {
+        reply->disconnect(this);
+    }
+}
+
+void tst_networkemulator::latency()
+{
+    NetworkConditions conditions;
+    conditions.latency = 300;
+    m_emulator.setConditions(conditions);
+
+    RequestGenerator generator(&m_s, QStringLiteral("user"), QStringLiteral("pass"));
+    QElapsedTimer timer;
+    timer.start();
+    ReplyResult result;
+    performRequest(&generator, 5000, &result);
+    QVERIFY(result.finished);
+    QVERIFY(timer.elapsed() >= conditions.latency);
+    QCOMPARE(result.error, QNetworkReply::NoError);
+    QCOMPARE(result.data, multistatusBody(100));
+}
+
+void tst_networkemulator::bandwidth()
+{
+    // the body is roughly 17KB, so takes at least half a second at 32KB/s.
+    NetworkConditions conditions;
+    conditions.bandwidth = 32 * 1024;
+    m_emulator.setConditions(conditions);
+
+    RequestGenerator generator(&m_s, QStringLiteral("user"), QStringLiteral("pass"));
+    QElapsedTimer timer;
+    timer.start();
+    ReplyResult result;
+    performRequest(&generator, 10000, &result);
+    QVERIFY(result.finished);
+    QVERIFY(timer.elapsed() >= multistatusBody(100).size() * 1000 / conditions.bandwidth - 100);
+    QCOMPARE(result.error, QNetworkReply::NoError);
+    QCOMPARE(result.data, multistatusBody(100));
+}
+
+void tst_networkemulator::errorRate()
+{
+    NetworkConditions conditions;
+    conditions.errorRate = 1.0;
+    conditions.bandwidth = 64 * 1024;
+    conditions.seed = 7357;
+    m_emulator.setConditions(conditions);
+
+    RequestGenerator generator(&m_s, QStringLiteral("user"), QStringLiteral("pass"));
+    ReplyResult result;
+    performRequest(&generator, 10000, &result);
+    QVERIFY(result.finished);
+    QCOMPARE(result.error, QNetworkReply::RemoteHostClosedError);
+    QVERIFY(result.transient);
+    QVERIFY(result.data.size() < multistatusBody(100).size());
+}
+
+void tst_networkemulator::stallTriggersWatchdog()
+{
+    NetworkConditions conditions;
+    conditions.stallProbability = 1.0;
+    conditions.stallDuration = 5000;
+    m_emulator.setConditions(conditions);
+
+    RequestGenerator generator(&m_s, QStringLiteral("user"), QStringLiteral("pass"));
+    generator.setInactivityTimeout(500);
+    ReplyResult result;
+    performRequest(&generator, 3000, &result);
+    QVERIFY(result.finished);
+    QCOMPARE(result.error, QNetworkReply::OperationCanceledError);
+    QVERIFY(result.transient);
+}
+
+void tst_networkemulator::contactPagesInFlight()
+{
+    // the responses are held back, so that the pages which are requested
+    // before the first page is received can be counted.
+    NetworkConditions conditions;
+    conditions.latency = 1000;
+    m_emulator.setConditions(conditions);
+
+    const QString addressbookUrl = QStringLiteral("/addressbooks/johndoe/contacts/");
+    CardDav::DownsyncedContacts downsynced;
+    for (int i = 0; i < 500; ++i) {
+        downsynced.pendingUris.append(addressbookUrl + QStringLiteral("contact-%1.vcf").arg(i));
+    }
+
+    // several pages are in flight at once, up to the limit on concurrent requests.
+    m_s.m_maxConcurrentListings = 3;
+    CardDav cardDav(&m_s, m_server->url(), QStringLiteral("/addressbooks/johndoe/"),
+                    QStringLiteral("user"), QStringLiteral("pass"));
+    cardDav.m_downsyncedChanges.insert(addressbookUrl, downsynced);
+    cardDav.fetchContactsPage(addressbookUrl);
+    QCOMPARE(cardDav.m_downsyncedChanges.value(addressbookUrl).activePages, 3);
+    QTRY_COMPARE_WITH_TIMEOUT(m_server->requestCount(), 3, 500);
+
+    // further pages are only requested as the previous pages are received.
+    QTest::qWait(200);
+    QCOMPARE(m_server->requestCount(), 3);
+    QTRY_COMPARE_WITH_TIMEOUT(m_server->requestCount(), 5, 5000);
+    QVERIFY(cardDav.m_downsyncedChanges.value(addressbookUrl).pendingUris.isEmpty());
+    QVERIFY(cardDav.m_downsyncedChanges.value(addressbookUrl).activePages <= 3);
+    cardDav.abortRequests();
+
+    // a memory-bounded sync holds only one page at a time.
+    m_s.m_memoryBudget = 1024 * 1024;
+    CardDav boundedCardDav(&m_s, m_server->url(), QStringLiteral("/addressbooks/johndoe/"),
+                           QStringLiteral("user"), QStringLiteral("pass"));
+    boundedCardDav.m_downsyncedChanges.insert(addressbookUrl, downsynced);
+    boundedCardDav.fetchContactsPage(addressbookUrl);
+    QCOMPARE(boundedCardDav.m_downsyncedChanges.value(addressbookUrl).activePages, 1);
+    boundedCardDav.abortRequests();
+    m_s.m_memoryBudget = 0;
+
+    // on a metered connection, the pages in flight share the byte budget.
+    // The listing does not report the vCard sizes, so 4 KiB is assumed for
+    // each, and the budget covers two and a half pages.
+    const qint64 meteredByteBudget = m_s.m_meteredByteBudget;
+    m_s.m_syncTier = Syncer::MeteredSyncTier;
+    m_s.m_meteredByteBudget = 250 * 4 * 1024;
+    m_s.m_downloadedBytes = 0;
+    m_s.m_fetchedContacts = 0;
+    CardDav meteredCardDav(&m_s, m_server->url(), QStringLiteral("/addressbooks/johndoe/"),
+                           QStringLiteral("user"), QStringLiteral("pass"));
+    meteredCardDav.m_downsyncedChanges.insert(addressbookUrl, downsynced);
+    meteredCardDav.fetchContactsPage(addressbookUrl);
+    QCOMPARE(meteredCardDav.m_downsyncedChanges.value(addressbookUrl).activePages, 3);
+    QCOMPARE(m_s.m_fetchedContacts, 250);
+    QCOMPARE(m_s.m_downloadedBytes, m_s.m_meteredByteBudget);
+    QCOMPARE(meteredCardDav.m_downsyncedChanges.value(addressbookUrl).pendingUris.size(), 250);
+    meteredCardDav.abortRequests();
+
+    m_s.m_syncTier = Syncer::FullSyncTier;
+    m_s.m_meteredByteBudget = meteredByteBudget;
+    m_s.m_downloadedBytes = 0;
+    m_s.m_maxConcurrentListings = 4;
+    m_s.m_fetchedContacts = 0;
+}
+
+#include "tst_networkemulator.moc"
+QTEST_MAIN(tst_networkemulator)
@@ -0,0 +1,197 @@
+#include <QtTest>
+#include <QObject>
+#include <QString>
+#include <QStringList>
+#include <QHash>
+
+#include "remotecontactchanges_p.h"
+
+namespace {
+
+const QString AddressbookUrl = QStringLiteral("/addressbooks/johndoe/contacts/");
+
+ReplyParser::ContactInformation contactInformation(
+        ReplyParser::ContactInformation::ModificationType modType,
+        const QString &uri, const QString &etag, qint64 size = -1)
+{
+    ReplyParser::ContactInformation info;
+    info.modType = modType;
+    info.uri = uri;
+    info.etag = etag;
+    info.size = size;
+    return info;
+}
+
+ReplyParser::ContactInformation syntheticContactInformation(int i)
+{
+    // a typical listing: uuid-named resources and quoted hex etags.
+    const ReplyParser::ContactInformation::ModificationType modType
+            = static_cast<ReplyParser::ContactInformation::ModificationType>(
+                ReplyParser::ContactInformation::Addition + (i % 4));
+    return contactInformation(
+            modType,
+            AddressbookUrl + QStringLiteral("%1-4a7b-11e9-9f1c-%2.vcf")
+                    .arg(i, 8, 16, QLatin1Char('0'))
+                    .arg(i * 7919, 12, 16, QLatin1Char('0')),
+            QStringLiteral("\"%1\"").arg(qHash(i) * 2654435761u, 32, 16, QLatin1Char('0')),
+            1024 + i);
+}
+
+}
+
+class tst_remotecontactchanges : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void insertAndLookup();
+    void latestReportWins();
+    void urisOutsideAddressbook();
+    void manyEntries();
+    void insertBenchmark();
+};
+
+void tst_remotecontactchanges::insertAndLookup()
+{
+    RemoteContactChanges changes(AddressbookUrl);
+    QVERIFY(changes.isEmpty());
+    QVERIFY(!changes.contains(AddressbookUrl + QStringLiteral("first.vcf")));
+
+    changes.insert(contactInformation(ReplyParser::ContactInformation::Addition,
+                                      AddressbookUrl + QStringLiteral("first.vcf"), QStringLiteral("\"1\""), 512));
+    changes.insert(contactInformation(ReplyParser::ContactInformation::Modification,
+                                      AddressbookUrl + QStringLiteral("second.vcf"), QStringLiteral("\"2\"")));
+    changes.insert(contactInformation(ReplyParser::ContactInformation::Deletion,
+                                      AddressbookUrl + QStringLiteral("third.vcf"), QString()));
+    changes.insert(contactInformation(ReplyParser::ContactInformation::Unmodified,
+                                      AddressbookUrl + QStringLiteral("fourth.vcf"), QStringLiteral("\"4\"")));
+    changes.insert(contactInformation(ReplyParser::ContactInformation::Uninitialized,
+                                      AddressbookUrl + QStringLiteral("fifth.vcf"), QStringLiteral("\"5\"")));
+
+    QCOMPARE(changes.size(), 4);
+    QCOMPARE(changes.count(ReplyParser::ContactInformation::Addition), 1);
+    QCOMPARE(changes.count(ReplyParser::ContactInformation::Modification), 1);
+    QCOMPARE(changes.count(ReplyParser::ContactInformation::Deletion), 1);
+    QCOMPARE(changes.count(ReplyParser::ContactInformation::Unmodified), 1);
+
+    QCOMPARE(changes.modificationType(AddressbookUrl + QStringLiteral("second.vcf")),
+             ReplyParser::ContactInformation::Modification);
+    QCOMPARE(changes.modificationType(AddressbookUrl + QStringLiteral("fifth.vcf")),
+             ReplyParser::ContactInformation::Uninitialized);
+    QVERIFY(!changes.contains(QStringLiteral("first.vcf")));
+
+    const ReplyParser::ContactInformation first = changes.information(AddressbookUrl + QStringLiteral("first.vcf"));
+    QCOMPARE(first.modType, ReplyParser::ContactInformation::Addition);
+    QCOMPARE(first.uri, AddressbookUrl + QStringLiteral("first.vcf"));
+    QCOMPARE(first.etag, QStringLiteral("\"1\""));
+    QCOMPARE(first.size, qint64(512));
+    QCOMPARE(changes.information(AddressbookUrl + QStringLiteral("second.vcf")).size, qint64(-1));
+
+    QCOMPARE(changes.uris(ReplyParser::ContactInformation::Deletion),
+             QStringList() << AddressbookUrl + QStringLiteral("third.vcf"));
+
+    changes.clear();
+    QVERIFY(changes.isEmpty());
+    QCOMPARE(changes.count(ReplyParser::ContactInformation::Addition), 0);
+    QVERIFY(!changes.contains(AddressbookUrl + QStringLiteral("first.vcf")));
+}
+
+void tst_remotecontactchanges::latestReportWins()
+{
+    // a later page of a paged listing may report a newer state for a contact.
+    RemoteContactChanges changes(AddressbookUrl);
+    const QString uri = AddressbookUrl + QStringLiteral("first.vcf");
+    changes.insert(contactInformation(ReplyParser::ContactInformation::Addition, uri, QStringLiteral("\"1\""), 100));
+    changes.insert(contactInformation(ReplyParser::ContactInformation::Modification, uri, QStringLiteral("\"2\""), 200));
+
+    QCOMPARE(changes.size(), 1);
+    QCOMPARE(changes.count(ReplyParser::ContactInformation::Addition), 0);
+    QCOMPARE(changes.count(ReplyParser::ContactInformation::Modification), 1);
+    const ReplyParser::ContactInformation info = changes.information(uri);
+    QCOMPARE(info.modType, ReplyParser::ContactInformation::Modification);
+    QCOMPARE(info.etag, QStringLiteral("\"2\""));
+    QCOMPARE(info.size, qint64(200));
+
+    changes.insert(contactInformation(ReplyParser::ContactInformation::Deletion, uri, QString()));
+    QCOMPARE(changes.uris(ReplyParser::ContactInformation::Modification), QStringList());
+    QCOMPARE(changes.uris(ReplyParser::ContactInformation::Deletion), QStringList() << uri);
+    QCOMPARE(changes.information(uri).etag, QString());
+}
+
+void tst_remotecontactchanges::urisOutsideAddressbook()
+{
+    // some servers report hrefs which are not below the addressbook url,
+    // and these must not collide with relative slugs of the same name.
+    RemoteContactChanges changes(AddressbookUrl);
+    const QString inside = AddressbookUrl + QStringLiteral("first.vcf");
+    const QString outside = QStringLiteral("first.vcf");
+    const QString absolute = QStringLiteral("https://example.com/other/first.vcf");
+    changes.insert(contactInformation(ReplyParser::ContactInformation::Addition, inside, QStringLiteral("\"1\"")));
+    changes.insert(contactInformation(ReplyParser::ContactInformation::Modification, outside, QStringLiteral("\"2\"")));
+    changes.insert(contactInformation(ReplyParser::ContactInformation::Unmodified, absolute, QStringLiteral("\"3\"")));
+    changes.insert(contactInformation(ReplyParser::ContactInformation::Deletion, AddressbookUrl, QString()));
+
+    QCOMPARE(changes.size(), 4);
+    QCOMPARE(changes.modificationType(inside), ReplyParser::ContactInformation::Addition);
+    QCOMPARE(changes.modificationType(outside), ReplyParser::ContactInformation::Modification);
+    QCOMPARE(changes.modificationType(absolute), ReplyParser::ContactInformation::Unmodified);
+    QCOMPARE(changes.modificationType(AddressbookUrl), ReplyParser::ContactInformation::Deletion);
+    QCOMPARE(changes.uris(ReplyParser::ContactInformation::Modification), QStringList() << outside);
+    QCOMPARE(changes.uris(ReplyParser::ContactInformation::Unmodified), QStringList() << absolute);
+
+    // without an addressbook url, all uris are stored as-is.
+    RemoteContactChanges unrooted;
+    unrooted.insert(contactInformation(ReplyParser::ContactInformation::Addition, inside, QStringLiteral("\"1\"")));
+    QCOMPARE(unrooted.uris(ReplyParser::ContactInformation::Addition), QStringList() << inside);
+}
+
+void tst_remotecontactchanges::manyEntries()
+{
+    // exercise the index growth, and compare against the naive representation.
+    const int count = 20000;
+    RemoteContactChanges changes(AddressbookUrl);
+    QHash<QString, ReplyParser::ContactInformation> expected;
+    for (int i = 0; i < count; ++i) {
+        const ReplyParser::ContactInformation info = syntheticContactInformation(i);
+        changes.insert(info);
+        expected.insert(info.uri, info);
+    }
+
+    QCOMPARE(changes.size(), count);
+    int additions = 0;
+    for (QHash<QString, ReplyParser::ContactInformation>::const_iterator it = expected.constBegin();
+            it != expected.constEnd(); ++it) {
+        const ReplyParser::ContactInformation info = changes.information(it.key());
+        QCOMPARE(info.modType, it->modType);
+        QCOMPARE(info.etag, it->etag);
+        QCOMPARE(info.size, it->size);
+        if (it->modType == ReplyParser::ContactInformation::Addition) {
+            additions += 1;
+        }
+    }
+    QCOMPARE(changes.count(ReplyParser::ContactInformation::Addition), additions);
+    QCOMPARE(changes.uris(ReplyParser::ContactInformation::Addition).size(), additions);
+    QCOMPARE(changes.uris(ReplyParser::ContactInformation::Addition).first(), syntheticContactInformation(0).uri);
+}
+
+void tst_remotecontactchanges::insertBenchmark()
+{
+    // the cost of recording the listing of a large addressbook.
+    const int count = 100000;
+    QList<ReplyParser::ContactInformation> listing;
+    listing.reserve(count);
+    for (int i = 0; i < count; ++i) {
+        listing.append(syntheticContactInformation(i));
+    }
+
+    QBENCHMARK {
+        RemoteContactChanges changes(AddressbookUrl);
+        for (const ReplyParser::ContactInformation &info : listing) {
+            changes.insert(info);
+        }
+        QCOMPARE(changes.size(), count);
+    }
+}
+
+#include "tst_remotecontactchanges.moc"
+QTEST_MAIN(tst_remotecontactchanges)
@@ -47,6 +47,17 @@ void dumpContact(const QContact &c)
     }
 }
 
+ReplyParser::LocalContactIndex localContactIndex(const QHash<QString, QString> &contactUrisEtags)
+{
+    ReplyParser::LocalContactIndex index;
+    for (QHash<QString, QString>::const_iterator it = contactUrisEtags.constBegin(); it != contactUrisEtags.constEnd(); ++it) {
+        ReplyParser::LocalContactInformation info;
+        info.etag = it.value();
+        index.insert(it.key(), info);
+    }
+    return index;
+}
+
 QContact removeIgnorableFields(const QContact &c)
 {
     QContact ret;
@@ -96,6 +107,9 @@ private slots:
     void parseContactData_data();
     void parseContactData();
 
+    void parseSupportedReportSet_data();
+    void parseSupportedReportSet();
+
 private:
     CardDavVCardConverter m_vcc;
     Syncer m_s;
@@ -114,16 +128,31 @@ void tst_replyparser::parseUserPrincipal_data()
 {
     QTest::addColumn<QString>("xmlFilename");
     QTest::addColumn<QString>("expectedUserPrincipal");
+    QTest::addColumn<QString>("expectedAddressbooksHomePath");
     QTest::addColumn<int>("expectedResponseType");
 
     QTest::newRow("empty user information response")
         << QStringLiteral("data/replyparser_userprincipal_empty.xml")
         << QString()
+        << QString()
         << static_cast<int>(ReplyParser::UserPrincipalResponse);
 
     QTest::newRow("single user principal in well-formed response")
         << QStringLiteral("data/replyparser_userprincipal_single-well-formed.xml")
         << QStringLiteral("/principals/users/johndoe/")
+        << QString()
+        << static_cast<int>(ReplyParser::UserPrincipalResponse);
+
+    QTest::newRow("user principal and addressbook home set in well-formed response")
+        << QStringLiteral("data/replyparser_userprincipal_with-home-set.xml")
+        << QStringLiteral("/principals/users/johndoe/")
+        << QStringLiteral("/addressbooks/johndoe/")
+        << static_cast<int>(ReplyParser::UserPrincipalResponse);
+
+    QTest::newRow("user principal with addressbook home set not found in separate propstat")
+        << QStringLiteral("data/replyparser_userprincipal_home-set-not-found.xml")
+        << QStringLiteral("/principals/users/johndoe/")
+        << QString()
         << static_cast<int>(ReplyParser::UserPrincipalResponse);
 }
 
@@ -131,6 +160,7 @@ void tst_replyparser::parseUserPrincipal()
 {
     QFETCH(QString, xmlFilename);
     QFETCH(QString, expectedUserPrincipal);
+    QFETCH(QString, expectedAddressbooksHomePath);
     QFETCH(int, expectedResponseType);
 
     QFile f(QStringLiteral("%1/%2").arg(QCoreApplication::applicationDirPath(), xmlFilename));
@@ -140,9 +170,11 @@ void tst_replyparser::parseUserPrincipal()
 
     QByteArray userInformationResponse = f.readAll();
     ReplyParser::ResponseType responseType = ReplyParser::UserPrincipalResponse;
-    QString userPrincipal = m_rp.parseUserPrincipal(userInformationResponse, &responseType);
+    QString addressbooksHomePath;
+    QString userPrincipal = m_rp.parseUserPrincipal(userInformationResponse, &responseType, &addressbooksHomePath);
 
     QCOMPARE(userPrincipal, expectedUserPrincipal);
+    QCOMPARE(addressbooksHomePath, expectedAddressbooksHomePath);
     QCOMPARE(responseType, static_cast<ReplyParser::ResponseType>(expectedResponseType));
 }
 
@@ -305,6 +337,7 @@ void tst_replyparser::parseSyncTokenDelta_data()
     QTest::addColumn<QString>("xmlFilename");
     QTest::addColumn<QHashStringString>("injectContactUrisEtags");
     QTest::addColumn<QString>("expectedNewSyncToken");
+    QTest::addColumn<bool>("expectedTruncated");
     QTest::addColumn<QList<ReplyParser::ContactInformation> >("expectedContactInformation");
 
     QList<ReplyParser::ContactInformation> infos;
@@ -312,6 +345,7 @@ void tst_replyparser::parseSyncTokenDelta_data()
         << QStringLiteral("data/replyparser_synctokendelta_empty.xml")
         << QHash<QString, QString>()
         << QString()
+        << false
         << infos;
 
     infos.clear();
@@ -324,6 +358,14 @@ void tst_replyparser::parseSyncTokenDelta_data()
         << QStringLiteral("data/replyparser_synctokendelta_single-well-formed-addition.xml")
         << QHash<QString, QString>()
         << QString()
+        << false
+        << infos;
+
+    QTest::newRow("single contact addition in truncated sync token delta response")
+        << QStringLiteral("data/replyparser_synctokendelta_truncated.xml")
+        << QHash<QString, QString>()
+        << QStringLiteral("http://sabredav.org/ns/sync/5002")
+        << true
         << infos;
 
     infos.clear();
@@ -343,6 +385,7 @@ void tst_replyparser::parseSyncTokenDelta_data()
         << QStringLiteral("data/replyparser_synctokendelta_single-well-formed-add-mod-rem.xml")
         << mContactUrisEtags
         << QStringLiteral("http://sabredav.org/ns/sync/5001")
+        << false
         << infos;
 }
 
@@ -350,7 +393,8 @@ bool operator==(const ReplyParser::ContactInformation& first, const ReplyParser:
 {
     return first.modType == second.modType
         && first.uri == second.uri
-        && first.etag == second.etag;
+        && first.etag == second.etag
+        && first.size == second.size;
 }
 
 void tst_replyparser::parseSyncTokenDelta()
@@ -358,6 +402,7 @@ void tst_replyparser::parseSyncTokenDelta()
     QFETCH(QString, xmlFilename);
     QFETCH(QHashStringString, injectContactUrisEtags);
     QFETCH(QString, expectedNewSyncToken);
+    QFETCH(bool, expectedTruncated);
     QFETCH(QList<ReplyParser::ContactInformation>, expectedContactInformation);
 
     QFile f(QStringLiteral("%1/%2").arg(QCoreApplication::applicationDirPath(), xmlFilename));
@@ -366,13 +411,15 @@ void tst_replyparser::parseSyncTokenDelta()
     }
 
     const QString addressbookUrl = QStringLiteral("test/addressbook/path");
-    m_s.m_localContactUrisEtags.insert(addressbookUrl, injectContactUrisEtags);
+    m_s.m_localContactIndex.insert(addressbookUrl, localContactIndex(injectContactUrisEtags));
 
     QString newSyncToken;
+    bool truncated = false;
     QByteArray syncTokenDeltaResponse = f.readAll();
-    QList<ReplyParser::ContactInformation> contactInfo = m_rp.parseSyncTokenDelta(syncTokenDeltaResponse, addressbookUrl, &newSyncToken);
+    QList<ReplyParser::ContactInformation> contactInfo = m_rp.parseSyncTokenDelta(syncTokenDeltaResponse, addressbookUrl, &newSyncToken, &truncated);
 
     QCOMPARE(newSyncToken, expectedNewSyncToken);
+    QCOMPARE(truncated, expectedTruncated);
     QCOMPARE(contactInfo.size(), expectedContactInformation.size());
     if (contactInfo != expectedContactInformation) {
         for (int i = 0; i < contactInfo.size(); ++i) {
@@ -390,7 +437,7 @@ void tst_replyparser::parseSyncTokenDelta()
         QFAIL("contact information different");
     }
 
-    m_s.m_localContactUrisEtags.clear();
+    m_s.m_localContactIndex.clear();
 }
 
 void tst_replyparser::parseContactMetadata_data()
@@ -398,6 +445,7 @@ void tst_replyparser::parseContactMetadata_data()
     QTest::addColumn<QString>("xmlFilename");
     QTest::addColumn<QString>("addressbookUrl");
     QTest::addColumn<QHashStringString>("injectContactEtags");
+    QTest::addColumn<bool>("expectedTruncated");
     QTest::addColumn<QList<ReplyParser::ContactInformation> >("expectedContactInformation");
 
     QList<ReplyParser::ContactInformation> infos;
@@ -405,6 +453,7 @@ void tst_replyparser::parseContactMetadata_data()
         << QStringLiteral("data/replyparser_contactmetadata_empty.xml")
         << QStringLiteral("/addressbooks/johndoe/contacts/")
         << QHash<QString, QString>()
+        << false
         << infos;
 
     infos.clear();
@@ -433,6 +482,16 @@ void tst_replyparser::parseContactMetadata_data()
         << QStringLiteral("data/replyparser_contactmetadata_single-well-formed-add-mod-rem-unch.xml")
         << QStringLiteral("/addressbooks/johndoe/contacts/")
         << mContactEtags
+        << false
+        << infos;
+
+    infos.clear();
+    infos << c1;
+    QTest::newRow("single contact addition in truncated contact metadata response, no removals inferred")
+        << QStringLiteral("data/replyparser_contactmetadata_truncated.xml")
+        << QStringLiteral("/addressbooks/johndoe/contacts/")
+        << mContactEtags
+        << true
         << infos;
 
     infos.clear();
@@ -450,6 +509,25 @@ void tst_replyparser::parseContactMetadata_data()
         << QStringLiteral("data/replyparser_contactmetadata_single-vcf-and-non-vcf.xml")
         << QStringLiteral("/addressbooks/johndoe/contacts/")
         << mContactEtags
+        << false
+        << infos;
+
+    infos.clear();
+    ReplyParser::ContactInformation c7;
+    c7.modType = ReplyParser::ContactInformation::Addition;
+    c7.uri = QStringLiteral("/addressbooks/johndoe/contacts/small.vcf");
+    c7.etag = QStringLiteral("\"0031-0031\"");
+    c7.size = 412;
+    ReplyParser::ContactInformation c8;
+    c8.modType = ReplyParser::ContactInformation::Addition;
+    c8.uri = QStringLiteral("/addressbooks/johndoe/contacts/nolength.vcf");
+    c8.etag = QStringLiteral("\"0032-0032\"");
+    infos << c7 << c8;
+    QTest::newRow("two contact additions with and without content length in contact metadata response")
+        << QStringLiteral("data/replyparser_contactmetadata_contentlength.xml")
+        << QStringLiteral("/addressbooks/johndoe/contacts/")
+        << mContactEtags
+        << false
         << infos;
 }
 
@@ -458,6 +536,7 @@ void tst_replyparser::parseContactMetadata()
     QFETCH(QString, xmlFilename);
     QFETCH(QString, addressbookUrl);
     QFETCH(QHashStringString, injectContactEtags);
+    QFETCH(bool, expectedTruncated);
     QFETCH(QList<ReplyParser::ContactInformation>, expectedContactInformation);
 
     QFile f(QStringLiteral("%1/%2").arg(QCoreApplication::applicationDirPath(), xmlFilename));
@@ -465,26 +544,31 @@ void tst_replyparser::parseContactMetadata()
         QFAIL("Data file does not exist or cannot be opened for reading!");
     }
 
-    m_s.m_localContactUrisEtags.insert(addressbookUrl, injectContactEtags);
+    m_s.m_localContactIndex.insert(addressbookUrl, localContactIndex(injectContactEtags));
 
     QByteArray contactMetadataResponse = f.readAll();
-    QList<ReplyParser::ContactInformation> contactInfo = m_rp.parseContactMetadata(contactMetadataResponse, addressbookUrl, injectContactEtags);
+    bool truncated = false;
+    QList<ReplyParser::ContactInformation> contactInfo = m_rp.parseContactMetadata(
+            contactMetadataResponse, addressbookUrl, m_s.m_localContactIndex.value(addressbookUrl), &truncated);
 
+    QCOMPARE(truncated, expectedTruncated);
     QCOMPARE(contactInfo, expectedContactInformation);
 
-    m_s.m_localContactUrisEtags.clear();
+    m_s.m_localContactIndex.clear();
 }
 
 void tst_replyparser::parseContactData_data()
 {
     QTest::addColumn<QString>("xmlFilename");
     QTest::addColumn<QString>("addressbookUrl");
+    QTest::addColumn<bool>("readOnly");
     QTest::addColumn<QHashStringContact>("expectedContactInformation");
 
     QHash<QString, QContact> infos;
     QTest::newRow("empty contact data response")
         << QStringLiteral("data/replyparser_contactdata_empty.xml")
         << QStringLiteral("/addressbooks/johndoe/contacts/")
+        << false
         << infos;
 
     infos.clear();
@@ -519,6 +603,18 @@ void tst_replyparser::parseContactData_data()
     QTest::newRow("single contact in well-formed contact data response")
         << QStringLiteral("data/replyparser_contactdata_single-well-formed.xml")
         << QStringLiteral("/addressbooks/johndoe/contacts/")
+        << false
+        << infos;
+
+    // unsupported properties are not preserved for contacts from read-only addressbooks
+    QContact readOnlyContact = contact;
+    readOnlyContact.removeDetail(&cu);
+    infos.clear();
+    infos.insert(QStringLiteral("/addressbooks/johndoe/contacts/testytestperson.vcf"), readOnlyContact);
+    QTest::newRow("single contact in well-formed contact data response from read-only addressbook")
+        << QStringLiteral("data/replyparser_contactdata_single-well-formed.xml")
+        << QStringLiteral("/addressbooks/johndoe/contacts/")
+        << true
         << infos;
 
     cu.setData(QStringList());
@@ -538,6 +634,7 @@ void tst_replyparser::parseContactData_data()
     QTest::newRow("single contact with fully-specified, hyphen-separated UTC ISO8601 BDAY")
         << QStringLiteral("data/replyparser_contactdata_single-hs-utc-iso8601-bday.xml")
         << QStringLiteral("/addressbooks/johndoe/contacts/")
+        << false
         << infos;
 
     cg.setGuid(QStringLiteral("%1:AB:%2:%3").arg(QString::number(7357),
@@ -551,6 +648,7 @@ void tst_replyparser::parseContactData_data()
     QTest::newRow("single contact with fully-specified, non-separated UTC ISO8601 BDAY")
         << QStringLiteral("data/replyparser_contactdata_single-ns-utc-iso8601-bday.xml")
         << QStringLiteral("/addressbooks/johndoe/contacts/")
+        << false
         << infos;
 
     cb.setDateTime(QDateTime(QDate(1990, 12, 31), QTime(2, 0, 0), Qt::LocalTime));
@@ -566,6 +664,7 @@ void tst_replyparser::parseContactData_data()
     QTest::newRow("single contact with fully-specified, hyphen-separated no-tz ISO8601 BDAY")
         << QStringLiteral("data/replyparser_contactdata_single-hs-notz-iso8601-bday.xml")
         << QStringLiteral("/addressbooks/johndoe/contacts/")
+        << false
         << infos;
 
     cg.setGuid(QStringLiteral("%1:AB:%2:%3").arg(QString::number(7357),
@@ -579,6 +678,7 @@ void tst_replyparser::parseContactData_data()
     QTest::newRow("single contact with fully-specified, non-separated no-tz ISO8601 BDAY")
         << QStringLiteral("data/replyparser_contactdata_single-ns-notz-iso8601-bday.xml")
         << QStringLiteral("/addressbooks/johndoe/contacts/")
+        << false
         << infos;
 
     cb.setDate(QDate(1990, 12, 31));
@@ -594,6 +694,7 @@ void tst_replyparser::parseContactData_data()
     QTest::newRow("single contact with non-separated, date-only ISO8601 BDAY")
         << QStringLiteral("data/replyparser_contactdata_single-ns-do-iso8601-bday.xml")
         << QStringLiteral("/addressbooks/johndoe/contacts/")
+        << false
         << infos;
 
     cg.setGuid(QStringLiteral("%1:AB:%2:%3").arg(QString::number(7357),
@@ -607,6 +708,7 @@ void tst_replyparser::parseContactData_data()
     QTest::newRow("single contact with multiple non-separated, date-only ISO8601 BDAY fields")
         << QStringLiteral("data/replyparser_contactdata_single-ns-do-iso8601-bday-multiple.xml")
         << QStringLiteral("/addressbooks/johndoe/contacts/")
+        << false
         << infos;
 
     cg.setGuid(QStringLiteral("%1:AB:%2:%3").arg(QString::number(7357),
@@ -620,6 +722,7 @@ void tst_replyparser::parseContactData_data()
     QTest::newRow("single contact with multiple FN fields")
         << QStringLiteral("data/replyparser_contactdata_single-contact-multiple-formattedname.xml")
         << QStringLiteral("/addressbooks/johndoe/contacts/")
+        << false
         << infos;
 
     cg.setGuid(QStringLiteral("%1:AB:%2:%3").arg(QString::number(7357),
@@ -633,6 +736,7 @@ void tst_replyparser::parseContactData_data()
     QTest::newRow("single contact with multiple N fields")
         << QStringLiteral("data/replyparser_contactdata_single-contact-multiple-name.xml")
         << QStringLiteral("/addressbooks/johndoe/contacts/")
+        << false
         << infos;
 
     QContactGender cgender;
@@ -649,6 +753,7 @@ void tst_replyparser::parseContactData_data()
     QTest::newRow("single contact with multiple X-GENDER fields")
         << QStringLiteral("data/replyparser_contactdata_single-contact-multiple-xgender.xml")
         << QStringLiteral("/addressbooks/johndoe/contacts/")
+        << false
         << infos;
 
     QContactTimestamp ct;
@@ -665,6 +770,7 @@ void tst_replyparser::parseContactData_data()
     QTest::newRow("single contact with multiple REV fields")
         << QStringLiteral("data/replyparser_contactdata_single-contact-multiple-rev.xml")
         << QStringLiteral("/addressbooks/johndoe/contacts/")
+        << false
         << infos;
 
     ct.setLastModified(QDateTime::fromString(QStringLiteral("1995-10-31T22:27:10Z"), Qt::ISODate));
@@ -680,6 +786,7 @@ void tst_replyparser::parseContactData_data()
     QTest::newRow("single contact with multiple UID fields")
         << QStringLiteral("data/replyparser_contactdata_single-contact-multiple-uid.xml")
         << QStringLiteral("/addressbooks/johndoe/contacts/")
+        << false
         << infos;
 }
 
@@ -714,6 +821,7 @@ void tst_replyparser::parseContactData()
 {
     QFETCH(QString, xmlFilename);
     QFETCH(QString, addressbookUrl);
+    QFETCH(bool, readOnly);
     QFETCH(QHashStringContact, expectedContactInformation);
 
     QFile f(QStringLiteral("%1/%2").arg(QCoreApplication::applicationDirPath(), xmlFilename));
@@ -721,8 +829,13 @@ void tst_replyparser::parseContactData()
         QFAIL("Data file does not exist or cannot be opened for reading!");
     }
 
+    QContactCollection collection;
+    collection.setExtendedMetaData(COLLECTION_EXTENDEDMETADATA_KEY_READONLY, readOnly);
+    m_s.m_currentCollections.insert(addressbookUrl, collection);
+
     QByteArray contactDataResponse = f.readAll();
     QHash<QString, QContact> contactInfo = m_rp.parseContactData(contactDataResponse, addressbookUrl);
+    m_s.m_currentCollections.clear();
 
     QCOMPARE(contactInfo.size(), expectedContactInformation.size());
     QCOMPARE(contactInfo.keys(), expectedContactInformation.keys());
@@ -753,5 +866,37 @@ void tst_replyparser::parseContactData()
     }
 }
 
+void tst_replyparser::parseSupportedReportSet_data()
+{
+    QTest::addColumn<QString>("xmlFilename");
+    QTest::addColumn<QStringList>("expectedReports");
+
+    QTest::newRow("empty supported report set response")
+        << QStringLiteral("data/replyparser_supportedreportset_empty.xml")
+        << QStringList();
+
+    QTest::newRow("single well-formed supported report set response")
+        << QStringLiteral("data/replyparser_supportedreportset_single-well-formed.xml")
+        << (QStringList() << QStringLiteral("addressbook-multiget")
+                          << QStringLiteral("addressbook-query")
+                          << QStringLiteral("sync-collection"));
+}
+
+void tst_replyparser::parseSupportedReportSet()
+{
+    QFETCH(QString, xmlFilename);
+    QFETCH(QStringList, expectedReports);
+
+    QFile f(QStringLiteral("%1/%2").arg(QCoreApplication::applicationDirPath(), xmlFilename));
+    if (!f.exists() || !f.open(QIODevice::ReadOnly)) {
+        QFAIL("Data file does not exist or cannot be opened for reading!");
+    }
+
+    QByteArray supportedReportSetResponse = f.readAll();
+    QStringList reports = m_rp.parseSupportedReportSet(supportedReportSetResponse);
+
+    QCOMPARE(reports, expectedReports);
+}
+
 #include "tst_replyparser.moc"
 QTEST_MAIN(tst_replyparser)
@@ -0,0 +1,303 @@
+#include <QtTest>
+#include <QObject>
+#include <QString>
+#include <QStringList>
+#include <QByteArray>
+
+#include "requestgenerator_p.h"
+
+#include <QNetworkRequest>
+#include <QNetworkReply>
+
+namespace {
+
+class FakeReply : public QNetworkReply
+{
+    Q_OBJECT
+
+public:
+    FakeReply(const QByteArray &verb, const QByteArray &ifMatch,
+              QNetworkReply::NetworkError error, int httpStatus,
+              const QByteArray &retryAfter = QByteArray())
+    {
+        QNetworkRequest request(QUrl(QStringLiteral("https://example.com/addressbooks/johndoe/contacts/")));
+        request.setAttribute(QNetworkRequest::CustomVerbAttribute, verb);
+        if (!ifMatch.isEmpty()) {
+            request.setRawHeader("If-Match", ifMatch);
+        }
+        setRequest(request);
+        setOperation(QNetworkAccessManager::CustomOperation);
+        setError(error, QString());
+        if (httpStatus > 0) {
+            setAttribute(QNetworkRequest::HttpStatusCodeAttribute, httpStatus);
+        }
+        if (!retryAfter.isEmpty()) {
+            setRawHeader("Retry-After", retryAfter);
+        }
+        setFinished(true);
+    }
+
+    void abort() override {}
+
+protected:
+    qint64 readData(char *, qint64) override { return -1; }
+};
+
+}
+
+class tst_requestgenerator : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void syncTokenDeltaRequestBody_data();
+    void syncTokenDeltaRequestBody();
+    void contactMultigetRequestBody_data();
+    void contactMultigetRequestBody();
+    void contactMultigetRequestBodyBenchmark();
+    void retryableRequest_data();
+    void retryableRequest();
+    void retryDelay();
+    void replayedWriteConflict();
+    void confirmedWrite();
+    void timedOutRequest();
+};
+
+void tst_requestgenerator::syncTokenDeltaRequestBody_data()
+{
+    QTest::addColumn<QString>("syncToken");
+    QTest::addColumn<int>("limit");
+    QTest::addColumn<QByteArray>("expectedBody");
+
+    QTest::newRow("initial listing")
+        << QString()
+        << 0
+        << QByteArrayLiteral("<?xml version=\"1.0\" encoding=\"utf-8\" ?>"
+                             "<d:sync-collection xmlns:d=\"DAV:\">"
+                             "<d:sync-token></d:sync-token>"
+                             "<d:sync-level>1</d:sync-level>"
+                             "<d:prop><d:getetag/><d:getcontentlength/></d:prop>"
+                             "</d:sync-collection>");
+
+    QTest::newRow("escaped sync token with limit")
+        << QStringLiteral("http://example.com/sync/1?a&b")
+        << 500
+        << QByteArrayLiteral("<?xml version=\"1.0\" encoding=\"utf-8\" ?>"
+                             "<d:sync-collection xmlns:d=\"DAV:\">"
+                             "<d:sync-token>http://example.com/sync/1?a&amp;b</d:sync-token>"
+                             "<d:sync-level>1</d:sync-level>"
+                             "<d:limit><d:nresults>500</d:nresults></d:limit>"
+                             "<d:prop><d:getetag/><d:getcontentlength/></d:prop>"
+                             "</d:sync-collection>");
+}
+
+void tst_requestgenerator::syncTokenDeltaRequestBody()
+{
+    QFETCH(QString, syncToken);
+    QFETCH(int, limit);
+    QFETCH(QByteArray, expectedBody);
+
+    QCOMPARE(RequestGenerator::syncTokenDeltaRequestBody(syncToken, limit), expectedBody);
+}
+
+void tst_requestgenerator::contactMultigetRequestBody_data()
+{
+    QTest::addColumn<QStringList>("contactUris");
+    QTest::addColumn<QStringList>("properties");
+    QTest::addColumn<QByteArray>("expectedBody");
+
+    QTest::newRow("full address data")
+        << (QStringList() << QStringLiteral("/addressbooks/johndoe/contacts/first.vcf")
+                          << QStringLiteral("/addressbooks/johndoe/contacts/second contact")
+                          << QStringLiteral("third"))
+        << QStringList()
+        << QByteArrayLiteral("<card:addressbook-multiget xmlns:d=\"DAV:\" xmlns:card=\"urn:ietf:params:xml:ns:carddav\">"
+                             "<d:prop><d:getetag /><card:address-data /></d:prop>"
+                             "<d:href>/addressbooks/johndoe/contacts/first.vcf</d:href>"
+                             "<d:href>/addressbooks/johndoe/contacts/second%20contact</d:href>"
+                             "<d:href>/addressbooks/johndoe/contacts//third.vcf</d:href>"
+                             "</card:addressbook-multiget>");
+
+    QTest::newRow("partial address data")
+        << (QStringList() << QStringLiteral("/addressbooks/johndoe/contacts/first.vcf"))
+        << (QStringList() << QStringLiteral("FN") << QStringLiteral("TEL"))
+        << QByteArrayLiteral("<card:addressbook-multiget xmlns:d=\"DAV:\" xmlns:card=\"urn:ietf:params:xml:ns:carddav\">"
+                             "<d:prop><d:getetag />"
+                             "<card:address-data><card:prop name=\"FN\" /><card:prop name=\"TEL\" /></card:address-data>"
+                             "</d:prop>"
+                             "<d:href>/addressbooks/johndoe/contacts/first.vcf</d:href>"
+                             "</card:addressbook-multiget>");
+}
+
+void tst_requestgenerator::contactMultigetRequestBody()
+{
+    QFETCH(QStringList, contactUris);
+    QFETCH(QStringList, properties);
+    QFETCH(QByteArray, expectedBody);
+
+    QCOMPARE(RequestGenerator::contactMultigetRequestBody(QStringLiteral("/addressbooks/johndoe/contacts/"),
+                                                          contactUris, properties),
+             expectedBody);
+}
+
+void tst_requestgenerator::contactMultigetRequestBodyBenchmark()
+{
+    const QString addressbookPath = QStringLiteral("/addressbooks/johndoe/contacts/");
+    QStringList contactUris;
+    for (int i = 0; i < 10000; ++i) {
+        contactUris.append(QStringLiteral("%1contact-%2.vcf").arg(addressbookPath).arg(i));
+    }
+
+    QByteArray body;
+    QBENCHMARK {
+        body = RequestGenerator::contactMultigetRequestBody(addressbookPath, contactUris);
+    }
+    QVERIFY(body.endsWith("</card:addressbook-multiget>"));
+}
+
+void tst_requestgenerator::retryableRequest_data()
+{
+    QTest::addColumn<QByteArray>("verb");
+    QTest::addColumn<QByteArray>("ifMatch");
+    QTest::addColumn<int>("error");
+    QTest::addColumn<int>("httpStatus");
+    QTest::addColumn<bool>("expectedTransient");
+    QTest::addColumn<bool>("expectedIdempotent");
+
+    QTest::newRow("PROPFIND with connection closed")
+        << QByteArrayLiteral("PROPFIND") << QByteArray()
+        << int(QNetworkReply::RemoteHostClosedError) << 0
+        << true << true;
+    QTest::newRow("REPORT with service unavailable")
+        << QByteArrayLiteral("REPORT") << QByteArray()
+        << int(QNetworkReply::ServiceUnavailableError) << 503
+        << true << true;
+    QTest::newRow("REPORT with not found")
+        << QByteArrayLiteral("REPORT") << QByteArray()
+        << int(QNetworkReply::ContentNotFoundError) << 404
+        << false << true;
+    QTest::newRow("conditional PUT with too many requests")
+        << QByteArrayLiteral("PUT") << QByteArrayLiteral("\"0001\"")
+        << int(QNetworkReply::UnknownContentError) << 429
+        << true << true;
+    QTest::newRow("unconditional PUT with gateway timeout")
+        << QByteArrayLiteral("PUT") << QByteArray()
+        << int(QNetworkReply::UnknownServerError) << 504
+        << true << false;
+    QTest::newRow("conditional DELETE with precondition failed")
+        << QByteArrayLiteral("DELETE") << QByteArrayLiteral("\"0001\"")
+        << int(QNetworkReply::UnknownContentError) << 412
+        << false << true;
+}
+
+void tst_requestgenerator::retryableRequest()
+{
+    QFETCH(QByteArray, verb);
+    QFETCH(QByteArray, ifMatch);
+    QFETCH(int, error);
+    QFETCH(int, httpStatus);
+    QFETCH(bool, expectedTransient);
+    QFETCH(bool, expectedIdempotent);
+
+    FakeReply reply(verb, ifMatch, static_cast<QNetworkReply::NetworkError>(error), httpStatus);
+    QCOMPARE(RequestGenerator::isTransientError(&reply), expectedTransient);
+    QCOMPARE(RequestGenerator::isIdempotentRequest(&reply), expectedIdempotent);
+}
+
+void tst_requestgenerator::retryDelay()
+{
+    // exponential backoff with jitter
+    FakeReply closed("REPORT", QByteArray(), QNetworkReply::RemoteHostClosedError, 0);
+    for (int attempt = 1; attempt <= 3; ++attempt) {
+        const int backoff = 1000 << (attempt - 1);
+        const int delay = RequestGenerator::retryDelay(&closed, attempt);
+        QVERIFY(delay >= backoff / 2);
+        QVERIFY(delay < backoff);
+    }
+
+    // Retry-After given in seconds is honoured
+    FakeReply throttled("REPORT", QByteArray(), QNetworkReply::UnknownContentError, 429, "5");
+    QCOMPARE(RequestGenerator::retryDelay(&throttled, 1), 5000);
+
+    // Retry-After which is too far in the future is not retried
+    FakeReply unavailable("REPORT", QByteArray(), QNetworkReply::ServiceUnavailableError, 503, "3600");
+    QCOMPARE(RequestGenerator::retryDelay(&unavailable, 1), -1);
+}
+
+void tst_requestgenerator::replayedWriteConflict()
+{
+    // a conditional write whose first attempt fails the precondition is a genuine conflict
+    FakeReply conflict("PUT", "\"0001\"", QNetworkReply::UnknownContentError, 412);
+    QVERIFY(!RequestGenerator::isReplayedWriteConflict(&conflict));
+
+    // as is a replayed one, if every earlier attempt was rejected by the server
+    QVERIFY(!RequestGenerator::isUnknownOutcome(&conflict));
+    FakeReply unavailable("PUT", "\"0001\"", QNetworkReply::ServiceUnavailableError, 503);
+    QVERIFY(!RequestGenerator::isUnknownOutcome(&unavailable));
+    FakeReply replayedAfterUnavailable("PUT", "\"0001\"", QNetworkReply::UnknownContentError, 412);
+    replayedAfterUnavailable.setProperty("requestAttempt", 1);
+    replayedAfterUnavailable.setProperty("requestOutcomeUnknown", false);
+    QVERIFY(!RequestGenerator::isReplayedWriteConflict(&replayedAfterUnavailable));
+
+    // but an earlier attempt without a response may have been applied
+    FakeReply closed("PUT", "\"0001\"", QNetworkReply::RemoteHostClosedError, 0);
+    QVERIFY(RequestGenerator::isUnknownOutcome(&closed));
+    FakeReply timedOut("DELETE", "\"0001\"", QNetworkReply::OperationCanceledError, 0);
+    timedOut.setProperty("requestTimedOut", true);
+    QVERIFY(RequestGenerator::isUnknownOutcome(&timedOut));
+    FakeReply replayedPut("PUT", "\"0001\"", QNetworkReply::UnknownContentError, 412);
+    replayedPut.setProperty("requestAttempt", 1);
+    replayedPut.setProperty("requestOutcomeUnknown", true);
+    QVERIFY(RequestGenerator::isReplayedWriteConflict(&replayedPut));
+    FakeReply replayedDelete("DELETE", "\"0001\"", QNetworkReply::UnknownContentError, 412);
+    replayedDelete.setProperty("requestAttempt", 2);
+    replayedDelete.setProperty("requestOutcomeUnknown", true);
+    QVERIFY(RequestGenerator::isReplayedWriteConflict(&replayedDelete));
+
+    // other failures of replayed writes are not
+    FakeReply replayedUnavailable("PUT", "\"0001\"", QNetworkReply::ServiceUnavailableError, 503);
+    replayedUnavailable.setProperty("requestAttempt", 1);
+    replayedUnavailable.setProperty("requestOutcomeUnknown", true);
+    QVERIFY(!RequestGenerator::isReplayedWriteConflict(&replayedUnavailable));
+}
+
+void tst_requestgenerator::confirmedWrite()
+{
+    // a replayed PUT was applied if the resource holds what was written
+    const QByteArray vcard("BEGIN:VCARD\r\nVERSION:3.0\r\nFN:John Doe\r\nEND:VCARD\r\n");
+    FakeReply written("GET", QByteArray(), QNetworkReply::NoError, 200);
+    written.setProperty("writtenVerb", QByteArrayLiteral("PUT"));
+    written.setProperty("writtenData", vcard);
+    QVERIFY(RequestGenerator::isConfirmedWrite(&written, vcard));
+    QVERIFY(RequestGenerator::isConfirmedWrite(&written, QByteArray(vcard).replace("\r\n", "\n")));
+
+    // but not if it was changed concurrently, or removed
+    QVERIFY(!RequestGenerator::isConfirmedWrite(&written, QByteArray(vcard).replace("John", "Jane")));
+    FakeReply missing("GET", QByteArray(), QNetworkReply::ContentNotFoundError, 404);
+    missing.setProperty("writtenVerb", QByteArrayLiteral("PUT"));
+    missing.setProperty("writtenData", vcard);
+    QVERIFY(!RequestGenerator::isConfirmedWrite(&missing, QByteArray()));
+
+    // a replayed DELETE was applied if the resource no longer exists
+    FakeReply deleted("GET", QByteArray(), QNetworkReply::ContentNotFoundError, 404);
+    deleted.setProperty("writtenVerb", QByteArrayLiteral("DELETE"));
+    QVERIFY(RequestGenerator::isConfirmedWrite(&deleted, QByteArray()));
+    FakeReply modified("GET", QByteArray(), QNetworkReply::NoError, 200);
+    modified.setProperty("writtenVerb", QByteArrayLiteral("DELETE"));
+    QVERIFY(!RequestGenerator::isConfirmedWrite(&modified, vcard));
+}
+
+void tst_requestgenerator::timedOutRequest()
+{
+    // a request aborted by the user or due to connectivity loss is not retried
+    FakeReply canceled("REPORT", QByteArray(), QNetworkReply::OperationCanceledError, 0);
+    QVERIFY(!RequestGenerator::isTransientError(&canceled));
+
+    // but a request aborted by the deadline or inactivity watchdog is
+    FakeReply timedOut("REPORT", QByteArray(), QNetworkReply::OperationCanceledError, 0);
+    timedOut.setProperty("requestTimedOut", true);
+    QVERIFY(RequestGenerator::isTransientError(&timedOut));
+}
+
+#include "tst_requestgenerator.moc"
+QTEST_MAIN(tst_requestgenerator)
@@ -0,0 +1,7 @@
+TEMPLATE = app
+TARGET = tst_syncer
+include($$PWD/../../src/src.pri)
+QT += testlib
+SOURCES += tst_syncer.cpp
+target.path = /opt/tests/buteo/plugins/carddav/
+INSTALLS += target
@@ -0,0 +1,254 @@
+#include <QtTest>
+#include <QObject>
+#include <QString>
+
+#include "syncer_p.h"
+
+#include <QContactCollection>
+#include <QContactCollectionFilter>
+#include <QContactName>
+#include <QContactSyncTarget>
+#include <QContactExtendedDetail>
+#include <qtcontacts-extensions.h>
+
+#include <limits.h>
+
+QTCONTACTS_USE_NAMESPACE
+
+namespace {
+
+const QString AddressbookUrl = QStringLiteral("/addressbooks/johndoe/batched/");
+
+QList<QContact> remoteAdditions(int first, int count)
+{
+    QList<QContact> contacts;
+    for (int i = first; i < first + count; ++i) {
+        QContact c;
+        QContactSyncTarget st;
+        st.setSyncTarget(AddressbookUrl + QStringLiteral("%1.vcf").arg(i));
+        c.saveDetail(&st);
+        QContactExtendedDetail etag;
+        etag.setName(KEY_ETAG);
+        etag.setData(QStringLiteral("\"%1\"").arg(i));
+        c.saveDetail(&etag);
+        QContactName name;
+        name.setFirstName(QStringLiteral("Batched%1").arg(i));
+        c.saveDetail(&name);
+        contacts.append(c);
+    }
+    return contacts;
+}
+
+}
+
+class tst_syncer : public QObject
+{
+    Q_OBJECT
+
+public:
+    tst_syncer()
+        : m_s(Q_NULLPTR, Q_NULLPTR, 7357) {}
+
+private slots:
+    void prioritizeAddressbooks();
+    void storeRemoteAdditions();
+    void remainingRunBudget();
+    void hasSkippedContacts();
+    void aggregateDeferredCollections();
+
+private:
+    Syncer m_s;
+};
+
+void tst_syncer::prioritizeAddressbooks()
+{
+    auto addressbook = [] (const QString &path, const QVariant &contactCount) {
+        QContactCollection collection;
+        collection.setExtendedMetaData(COLLECTION_EXTENDEDMETADATA_KEY_REMOTEPATH, path);
+        if (contactCount.isValid()) {
+            collection.setExtendedMetaData(KEY_CONTACTCOUNT, contactCount);
+        }
+        return collection;
+    };
+    auto paths = [] (const QList<QContactCollection> &collections) {
+        QStringList retn;
+        for (const QContactCollection &collection : collections) {
+            retn.append(collection.extendedMetaData(COLLECTION_EXTENDEDMETADATA_KEY_REMOTEPATH).toString());
+        }
+        return retn;
+    };
+
+    // prioritized addressbooks first, then from the smallest to the largest,
+    // and those of unknown size last, otherwise in the order given.
+    m_s.m_addressbookPriorities.insert(QStringLiteral("/shared/team/"), 0);
+    m_s.m_addressbookPriorities.insert(QStringLiteral("/shared/company/"), 1);
+    QList<QContactCollection> addressbooks;
+    addressbooks << addressbook(QStringLiteral("/new/"), QVariant())
+                 << addressbook(QStringLiteral("/large/"), 20000)
+                 << addressbook(QStringLiteral("/shared/company/"), 50000)
+                 << addressbook(QStringLiteral("/small/"), 10)
+                 << addressbook(QStringLiteral("/newer/"), QVariant())
+                 << addressbook(QStringLiteral("/shared/team/"), QVariant())
+                 << addressbook(QStringLiteral("/empty/"), 0);
+    m_s.prioritizeAddressbooks(&addressbooks);
+    QCOMPARE(paths(addressbooks), QStringList()
+             << QStringLiteral("/shared/team/") << QStringLiteral("/shared/company/")
+             << QStringLiteral("/empty/") << QStringLiteral("/small/") << QStringLiteral("/large/")
+             << QStringLiteral("/new/") << QStringLiteral("/newer/"));
+
+    // added and modified addressbooks are listed in a common order.
+    QList<QContactCollection> added;
+    added << addressbook(QStringLiteral("/new/"), QVariant())
+          << addressbook(QStringLiteral("/shared/company/"), QVariant());
+    QList<QContactCollection> modified;
+    modified << addressbook(QStringLiteral("/large/"), 20000)
+             << addressbook(QStringLiteral("/shared/team/"), 300)
+             << addressbook(QStringLiteral("/small/"), 10);
+    QList<QContactCollection> listed = added + modified;
+    m_s.prioritizeAddressbooks(&listed);
+    QCOMPARE(paths(listed), QStringList()
+             << QStringLiteral("/shared/team/") << QStringLiteral("/shared/company/")
+             << QStringLiteral("/small/") << QStringLiteral("/large/") << QStringLiteral("/new/"));
+
+    // disabled addressbooks are not added locally.
+    ReplyParser::AddressBookInformation enabled;
+    enabled.url = QStringLiteral("/small/");
+    ReplyParser::AddressBookInformation disabled;
+    disabled.url = QStringLiteral("/large/");
+    m_s.m_disabledAddressbooks.insert(disabled.url);
+    const QList<ReplyParser::AddressBookInformation> infos = m_s.enabledAddressbooks(
+            QList<ReplyParser::AddressBookInformation>() << disabled << enabled);
+    QCOMPARE(infos.size(), 1);
+    QCOMPARE(infos.first().url, enabled.url);
+
+    m_s.m_addressbookPriorities.clear();
+    m_s.m_disabledAddressbooks.clear();
+}
+
+void tst_syncer::storeRemoteAdditions()
+{
+    // an addressbook which is new locally is added along with the first batch.
+    QContactCollection addressbook;
+    addressbook.setMetaData(QContactCollection::KeyName, QStringLiteral("batched"));
+    addressbook.setExtendedMetaData(COLLECTION_EXTENDEDMETADATA_KEY_APPLICATIONNAME, QStringLiteral("carddav"));
+    addressbook.setExtendedMetaData(COLLECTION_EXTENDEDMETADATA_KEY_ACCOUNTID, 7357);
+    addressbook.setExtendedMetaData(COLLECTION_EXTENDEDMETADATA_KEY_REMOTEPATH, AddressbookUrl);
+    addressbook.setExtendedMetaData(KEY_CTAG, QStringLiteral("ctag-2"));
+    m_s.m_currentCollections.insert(AddressbookUrl, addressbook);
+
+    QList<QContact> first = remoteAdditions(0, 2);
+    QVERIFY(m_s.storeRemoteAdditions(AddressbookUrl, &first));
+    const QContactCollectionId collectionId = m_s.m_currentCollections.value(AddressbookUrl).id();
+    QVERIFY(!collectionId.isNull());
+
+    // later batches are stored into the same collection.
+    QList<QContact> second = remoteAdditions(2, 3);
+    QVERIFY(m_s.storeRemoteAdditions(AddressbookUrl, &second));
+    QCOMPARE(m_s.m_currentCollections.value(AddressbookUrl).id(), collectionId);
+    QContactCollectionFilter collectionFilter;
+    collectionFilter.setCollectionIds(QSet<QContactCollectionId>() << collectionId);
+    QCOMPARE(m_s.m_contactManager.contactIds(collectionFilter).size(), 5);
+
+    // the ctag is only advanced once all changes have been stored.
+    QCOMPARE(m_s.m_contactManager.collection(collectionId).extendedMetaData(KEY_CTAG).toString(), QString());
+    QCOMPARE(m_s.m_currentCollections.value(AddressbookUrl).extendedMetaData(KEY_CTAG).toString(),
+             QStringLiteral("ctag-2"));
+
+    // the change flags are left for the adaptor to clear after the upsync.
+    QVERIFY(m_s.hasLocalContactChanges(QSet<QContactCollectionId>() << collectionId));
+
+    QVERIFY(m_s.m_contactManager.removeCollection(collectionId));
+    m_s.m_currentCollections.clear();
+}
+
+void tst_syncer::remainingRunBudget()
+{
+    // by default, runs are unbounded.
+    m_s.m_maxContactsPerRun = 0;
+    m_s.m_maxSecondsPerRun = 0;
+    m_s.m_fetchedContacts = 0;
+    m_s.m_syncTimer.start();
+    QCOMPARE(m_s.remainingRunBudget(), INT_MAX);
+
+    // the contacts which remain to be fetched during this run.
+    m_s.m_maxContactsPerRun = 10;
+    m_s.m_fetchedContacts = 4;
+    QCOMPARE(m_s.remainingRunBudget(), 6);
+    m_s.m_fetchedContacts = 12;
+    QCOMPARE(m_s.remainingRunBudget(), 0);
+
+    // no further contacts are fetched once the time of the run is up.
+    m_s.m_maxContactsPerRun = 0;
+    m_s.m_fetchedContacts = 0;
+    m_s.m_maxSecondsPerRun = 1;
+    QCOMPARE(m_s.remainingRunBudget(), INT_MAX);
+    QTest::qWait(1100);
+    QCOMPARE(m_s.remainingRunBudget(), 0);
+
+    m_s.m_maxSecondsPerRun = 0;
+    m_s.m_syncTimer.invalidate();
+}
+
+void tst_syncer::hasSkippedContacts()
+{
+    // the contacts skipped by a memory-bounded sync are pending work for
+    // the next sync which is not memory-bounded.
+    QContactCollection addressbook;
+    addressbook.setExtendedMetaData(COLLECTION_EXTENDEDMETADATA_KEY_REMOTEPATH, AddressbookUrl);
+    m_s.m_memoryBudget = 0;
+    QVERIFY(!m_s.hasSkippedContacts(addressbook));
+    addressbook.setExtendedMetaData(KEY_SKIPPEDCONTACTS, QStringList() << AddressbookUrl + QStringLiteral("large.vcf"));
+    QVERIFY(m_s.hasSkippedContacts(addressbook));
+
+    // but not for another memory-bounded sync.
+    m_s.m_memoryBudget = 1024 * 1024;
+    QVERIFY(!m_s.hasSkippedContacts(addressbook));
+
+    m_s.m_memoryBudget = 0;
+}
+
+void tst_syncer::aggregateDeferredCollections()
+{
+    // the contacts of a bulk-imported addressbook are stored without being aggregated.
+    QContactCollection addressbook;
+    addressbook.setMetaData(QContactCollection::KeyName, QStringLiteral("imported"));
+    addressbook.setExtendedMetaData(COLLECTION_EXTENDEDMETADATA_KEY_APPLICATIONNAME, QStringLiteral("carddav"));
+    addressbook.setExtendedMetaData(COLLECTION_EXTENDEDMETADATA_KEY_ACCOUNTID, 7357);
+    addressbook.setExtendedMetaData(COLLECTION_EXTENDEDMETADATA_KEY_REMOTEPATH, AddressbookUrl);
+    m_s.m_bulkImport = true;
+    m_s.deferAggregation(&addressbook);
+    m_s.m_currentCollections.insert(AddressbookUrl, addressbook);
+    QList<QContact> contacts = remoteAdditions(0, 250);
+    QVERIFY(m_s.storeRemoteAdditions(AddressbookUrl, &contacts));
+    const QContactCollectionId collectionId = m_s.m_currentCollections.value(AddressbookUrl).id();
+    QVERIFY(!m_s.m_contactManager.collection(collectionId).extendedMetaData(COLLECTION_EXTENDEDMETADATA_KEY_AGGREGABLE).toBool());
+
+    // they are aggregated in batches from the event loop, the marker is
+    // removed along with the last batch, and only then is success reported.
+    QSignalSpy aggregatedSpy(&m_s, SIGNAL(contactsAggregated(int)));
+    QSignalSpy succeededSpy(&m_s, SIGNAL(syncSucceeded()));
+    m_s.aggregateDeferredCollections();
+    QCOMPARE(aggregatedSpy.count(), 0);
+    QCOMPARE(succeededSpy.count(), 0);
+    QTRY_COMPARE(succeededSpy.count(), 1);
+    QCOMPARE(aggregatedSpy.count(), 2);
+    QCOMPARE(aggregatedSpy.at(0).at(0).toInt(), 200);
+    QCOMPARE(aggregatedSpy.at(1).at(0).toInt(), 50);
+    const QContactCollection aggregated = m_s.m_contactManager.collection(collectionId);
+    QVERIFY(aggregated.extendedMetaData(COLLECTION_EXTENDEDMETADATA_KEY_AGGREGABLE).toBool());
+    QVERIFY(!aggregated.extendedMetaData(KEY_DEFERREDAGGREGATION).toBool());
+
+    // the change flags are not cleared by the aggregation.
+    QVERIFY(m_s.hasLocalContactChanges(QSet<QContactCollectionId>() << collectionId));
+
+    // with nothing left to aggregate, success is reported immediately.
+    m_s.aggregateDeferredCollections();
+    QCOMPARE(succeededSpy.count(), 2);
+    QCOMPARE(aggregatedSpy.count(), 2);
+
+    QVERIFY(m_s.m_contactManager.removeCollection(collectionId));
+    m_s.m_currentCollections.clear();
+}
+
+#include "tst_syncer.moc"
+QTEST_MAIN(tst_syncer)
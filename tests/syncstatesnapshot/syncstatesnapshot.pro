@@ -0,0 +1,7 @@
+TEMPLATE = app
+TARGET = tst_syncstatesnapshot
+include($$PWD/../../src/src.pri)
+QT += testlib
+SOURCES += tst_syncstatesnapshot.cpp
+target.path = /opt/tests/buteo/plugins/carddav/
+INSTALLS += target
@@ -0,0 +1,153 @@
+#include <QtTest>
+#include <QObject>
+#include <QString>
+#include <QFile>
+#include <QTemporaryDir>
+
+#include "syncstatesnapshot_p.h"
+
+namespace {
+
+SyncStateSnapshot::Entry snapshotEntry(const QString &uri, const QString &etag)
+{
+    SyncStateSnapshot::Entry entry;
+    entry.uri = uri;
+    entry.etag = etag;
+    return entry;
+}
+
+}
+
+class tst_syncstatesnapshot : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void writeAndFind();
+    void emptySnapshot();
+    void manyEntries();
+    void invalidFiles();
+
+private:
+    QTemporaryDir m_dir;
+};
+
+void tst_syncstatesnapshot::writeAndFind()
+{
+    const QString path = m_dir.filePath(QStringLiteral("writeAndFind/addressbook.snapshot"));
+    QVector<SyncStateSnapshot::Entry> entries;
+    entries << snapshotEntry(QStringLiteral("/addressbooks/johndoe/contacts/second.vcf"), QStringLiteral("\"2\""))
+            << snapshotEntry(QStringLiteral("/addressbooks/johndoe/contacts/first.vcf"), QStringLiteral("\"1\""))
+            << snapshotEntry(QStringLiteral("/addressbooks/johndoe/contacts/café.vcf"), QStringLiteral("\"3\""))
+            << snapshotEntry(QStringLiteral("/addressbooks/johndoe/contacts/Zed.vcf"), QString());
+    QVERIFY(SyncStateSnapshot::write(path, entries));
+
+    SyncStateSnapshot snapshot;
+    QVERIFY(!snapshot.isOpen());
+    QVERIFY(snapshot.open(path));
+    QVERIFY(snapshot.isOpen());
+    QCOMPARE(snapshot.size(), entries.size());
+
+    for (const SyncStateSnapshot::Entry &entry : entries) {
+        QString etag;
+        QVERIFY(snapshot.find(entry.uri, &etag));
+        QCOMPARE(etag, entry.etag);
+    }
+
+    QString etag;
+    QVERIFY(!snapshot.find(QStringLiteral("/addressbooks/johndoe/contacts/"), &etag));
+    QVERIFY(!snapshot.find(QStringLiteral("/addressbooks/johndoe/contacts/first.vcf.bak"), &etag));
+    QVERIFY(!snapshot.find(QStringLiteral("first.vcf"), &etag));
+
+    snapshot.close();
+    QVERIFY(!snapshot.isOpen());
+    QCOMPARE(snapshot.size(), 0);
+    QVERIFY(!snapshot.find(entries.first().uri, &etag));
+}
+
+void tst_syncstatesnapshot::emptySnapshot()
+{
+    const QString path = m_dir.filePath(QStringLiteral("empty.snapshot"));
+    QVERIFY(SyncStateSnapshot::write(path, QVector<SyncStateSnapshot::Entry>()));
+
+    SyncStateSnapshot snapshot;
+    QVERIFY(snapshot.open(path));
+    QCOMPARE(snapshot.size(), 0);
+    QString etag;
+    QVERIFY(!snapshot.find(QStringLiteral("first.vcf"), &etag));
+}
+
+void tst_syncstatesnapshot::manyEntries()
+{
+    const int count = 20000;
+    QVector<SyncStateSnapshot::Entry> entries;
+    entries.reserve(count);
+    for (int i = 0; i < count; ++i) {
+        entries.append(snapshotEntry(QStringLiteral("/addressbooks/johndoe/contacts/%1.vcf").arg(i * 7919 % count),
+                                     QStringLiteral("\"%1\"").arg(i)));
+    }
+    const QString path = m_dir.filePath(QStringLiteral("many.snapshot"));
+    QVERIFY(SyncStateSnapshot::write(path, entries));
+
+    // writing again replaces the previous snapshot.
+    QVERIFY(SyncStateSnapshot::write(path, entries));
+
+    SyncStateSnapshot snapshot;
+    QVERIFY(snapshot.open(path));
+    QCOMPARE(snapshot.size(), count);
+    for (const SyncStateSnapshot::Entry &entry : entries) {
+        QString etag;
+        QVERIFY(snapshot.find(entry.uri, &etag));
+        QCOMPARE(etag, entry.etag);
+    }
+}
+
+void tst_syncstatesnapshot::invalidFiles()
+{
+    SyncStateSnapshot snapshot;
+    QVERIFY(!snapshot.open(m_dir.filePath(QStringLiteral("missing.snapshot"))));
+
+    const QString path = m_dir.filePath(QStringLiteral("invalid.snapshot"));
+    QVector<SyncStateSnapshot::Entry> entries;
+    entries << snapshotEntry(QStringLiteral("first.vcf"), QStringLiteral("\"1\""))
+            << snapshotEntry(QStringLiteral("second.vcf"), QStringLiteral("\"2\""));
+    QVERIFY(SyncStateSnapshot::write(path, entries));
+
+    QFile file(path);
+    QVERIFY(file.open(QIODevice::ReadOnly));
+    const QByteArray valid = file.readAll();
+    file.close();
+
+    auto rewrite = [&file] (const QByteArray &data) {
+        if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+            return false;
+        }
+        const bool written = file.write(data) == data.size();
+        file.close();
+        return written;
+    };
+
+    // truncated
+    QVERIFY(rewrite(valid.left(valid.size() - 1)));
+    QVERIFY(!snapshot.open(path));
+
+    // not a snapshot
+    QByteArray corrupted = valid;
+    corrupted[0] = 'X';
+    QVERIFY(rewrite(corrupted));
+    QVERIFY(!snapshot.open(path));
+
+    // a record which refers past the end of the strings
+    corrupted = valid;
+    corrupted[16] = char(0x7f);
+    QVERIFY(rewrite(corrupted));
+    QVERIFY(!snapshot.open(path));
+    QVERIFY(!snapshot.isOpen());
+
+    QVERIFY(rewrite(valid));
+    QVERIFY(snapshot.open(path));
+    QCOMPARE(snapshot.size(), 2);
+}
+
+#include "tst_syncstatesnapshot.moc"
+QTEST_MAIN(tst_syncstatesnapshot)